@@ -47,3 +47,9 @@ set(CMAKE_CXX_STANDARD 14)
 set(CMAKE_CXX_STANDARD_REQUIRED ON)
 set(CMAKE_CXX_EXTENSIONS OFF)
 
+
+option(KAD_PROFILE_EVENTLOOP "Record per handler EventLoop latency histograms" OFF)
+
+if (KAD_PROFILE_EVENTLOOP)
+  add_definitions(-DKAD_PROFILE_EVENTLOOP)
+endif (KAD_PROFILE_EVENTLOOP)
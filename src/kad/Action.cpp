@@ -28,6 +28,8 @@
 #include <assert.h>
 #include "Thread.h"
 #include "PackageDispatcher.h"
+#include "KBuckets.h"
+#include "Config.h"
 #include "Action.h"
 
 namespace kad
@@ -46,4 +48,64 @@ namespace kad
     this->onComplete = onComplete;
     this->onCompleteSender = onCompleteSender;
   }
-}
\ No newline at end of file
+
+
+  const std::pair<KeyPtr, ContactPtr> * Action::NextCandidate(const std::map<Key, std::pair<KeyPtr, ContactPtr>> & candidates,
+    const std::set<Key> & offline, const std::set<Key> & validating, const std::map<Key, ContactPtr> & validated) const
+  {
+    const std::pair<KeyPtr, ContactPtr> * result = nullptr;
+    int bit = 0;
+    uint32_t rtt = 0;
+    size_t alternatives = 0;
+    size_t idx = 0;
+
+    for (const auto & candidate : candidates)
+    {
+      const Key & key = * candidate.second.first;
+
+      if (offline.find(key) != offline.end())
+      {
+        continue;
+      }
+
+      if ((idx++) >= KBuckets::SizeK)
+      {
+        break;
+      }
+
+      if (validated.find(key) != validated.end() || validating.find(key) != validating.end())
+      {
+        continue;
+      }
+
+      if (!result)
+      {
+        result = & candidate.second;
+
+        if (!this->estimator || (rtt = this->estimator(key)) == 0)
+        {
+          break;
+        }
+
+        bit = candidate.first.GetHighestBit();
+        continue;
+      }
+
+      // Candidates come closest first, so the first one further off ends the near ties
+      if (candidate.first.GetHighestBit() != bit || ++ alternatives >= Config::Parallelism())
+      {
+        break;
+      }
+
+      uint32_t other = this->estimator(key);
+
+      if (other != 0 && other < rtt)
+      {
+        result = & candidate.second;
+        rtt = other;
+      }
+    }
+
+    return result;
+  }
+}
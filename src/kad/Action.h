@@ -27,7 +27,12 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <map>
+#include <set>
+#include "Key.h"
+#include "Contact.h"
 
 namespace kad
 {
@@ -36,6 +41,13 @@ namespace kad
 
   class Action
   {
+  public:
+
+    using FailureHandler = std::function<void(KeyPtr)>;
+
+    // Smoothed round trip to a contact in microseconds, 0 when unknown
+    using RttEstimator = std::function<uint32_t(const Key &)>;
+
   public:
 
     explicit Action(Thread * owner, PackageDispatcher * dispatcher);
@@ -44,6 +56,12 @@ namespace kad
 
     void SetOnCompleteHandler(EventHandler onComplete, void * onCompleteSender);
 
+    // Told about each contact that does not answer a request
+    void SetOnFailureHandler(FailureHandler onFailure)   { this->onFailure = onFailure; }
+
+    // Lets the lookup prefer the faster of candidates that are about as close
+    void SetRttEstimator(RttEstimator estimator)          { this->estimator = estimator; }
+
     virtual bool Start() = 0;
 
     bool IsCompleted() const    { return this->completed; }
@@ -52,6 +70,14 @@ namespace kad
 
     void Complete()             { this->completed = true; }
 
+    void Fail(KeyPtr key)       { if (this->onFailure) { this->onFailure(key); } }
+
+    // The closest candidate not asked yet among the SizeK closest that answer, keyed by
+    // distance to the target. Within the next Parallelism() unasked ones that share its
+    // highest distance bit, the one with the shortest known round trip goes first.
+    const std::pair<KeyPtr, ContactPtr> * NextCandidate(const std::map<Key, std::pair<KeyPtr, ContactPtr>> & candidates,
+      const std::set<Key> & offline, const std::set<Key> & validating, const std::map<Key, ContactPtr> & validated) const;
+
   protected:
 
     Thread * owner;
@@ -62,6 +88,10 @@ namespace kad
 
     void * onCompleteSender = nullptr;
 
+    FailureHandler onFailure = nullptr;
+
+    RttEstimator estimator = nullptr;
+
   private:
 
     bool completed = false;
@@ -0,0 +1,90 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#include <algorithm>
+#include <new>
+#include "Arena.h"
+
+namespace kad
+{
+  const size_t Arena::INLINE_SIZE;
+
+  const size_t Arena::BLOCK_SIZE;
+
+  thread_local Arena * Arena::current = nullptr;
+
+
+  Arena::Arena()
+    : cursor(storage)
+    , end(storage + INLINE_SIZE)
+  {
+  }
+
+
+  Arena::~Arena()
+  {
+    while (this->blocks)
+    {
+      Block * next = this->blocks->next;
+      free(this->blocks);
+      this->blocks = next;
+    }
+  }
+
+
+  void * Arena::Allocate(size_t size, size_t align)
+  {
+    uintptr_t ptr = (reinterpret_cast<uintptr_t>(this->cursor) + align - 1) & ~(uintptr_t)(align - 1);
+
+    if (ptr + size > reinterpret_cast<uintptr_t>(this->end))
+    {
+      size_t header = (sizeof(Block) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+      size_t length = std::max(BLOCK_SIZE, header + size + align);
+
+      Block * block = static_cast<Block *>(malloc(length));
+
+      if (!block)
+      {
+        throw std::bad_alloc();
+      }
+
+      block->next = this->blocks;
+      this->blocks = block;
+
+      this->cursor = reinterpret_cast<uint8_t *>(block) + header;
+      this->end = reinterpret_cast<uint8_t *>(block) + length;
+
+      ptr = (reinterpret_cast<uintptr_t>(this->cursor) + align - 1) & ~(uintptr_t)(align - 1);
+    }
+
+    this->cursor = reinterpret_cast<uint8_t *>(ptr + size);
+
+    this->AddRef();
+
+    return reinterpret_cast<void *>(ptr);
+  }
+}
@@ -0,0 +1,212 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace kad
+{
+  // A bump allocator for the objects decoded from one message. Memory is handed out
+  // from an inline block (and from extra blocks if that runs out) and is released all
+  // at once when the last object allocated from it is gone. Every object holds one
+  // reference on its arena, so handles to decoded keys, contacts and payloads stay
+  // valid for as long as anyone holds them, on any thread.
+  //
+  // Arenas are filled by one thread, while an ArenaScope is active.
+  class Arena
+  {
+  public:
+
+    // Both sized so the arena and its blocks come from malloc's small-size caches
+    static const size_t INLINE_SIZE = 960;
+
+    static const size_t BLOCK_SIZE = 1024;
+
+  public:
+
+    Arena(const Arena &) = delete;
+
+    Arena & operator=(const Arena &) = delete;
+
+    // Allocate size bytes and take a reference for them. Pair with Release.
+    void * Allocate(size_t size, size_t align);
+
+    void AddRef()     { this->refs.fetch_add(1, std::memory_order_relaxed); }
+
+    void Release()
+    {
+      if (this->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+        delete this;
+      }
+    }
+
+    // The arena of the innermost ArenaScope on this thread, or nullptr
+    static Arena * Current()      { return current; }
+
+    // std::make_shared, from the current arena when there is one
+    template<typename T, typename... Args>
+    static std::shared_ptr<T> MakeShared(Args &&... args);
+
+    // Take ownership of ptr, with the reference count in the current arena when there is one
+    template<typename T>
+    static std::shared_ptr<T> Adopt(T * ptr);
+
+  private:
+
+    friend class ArenaScope;
+
+    struct Block
+    {
+      Block * next;
+    };
+
+    Arena();
+
+    ~Arena();
+
+  private:
+
+    static thread_local Arena * current;
+
+    std::atomic<size_t> refs{1};
+
+    uint8_t * cursor;
+
+    uint8_t * end;
+
+    Block * blocks = nullptr;
+
+    alignas(std::max_align_t) uint8_t storage[INLINE_SIZE];
+  };
+
+
+  // Create an arena and route Arena::MakeShared (and Instruction allocations) on this
+  // thread to it until the scope ends. The arena lives on while anything allocated
+  // from it does.
+  class ArenaScope
+  {
+  public:
+
+    ArenaScope()
+      : arena(new Arena())
+      , previous(Arena::current)
+    {
+      Arena::current = this->arena;
+    }
+
+    ~ArenaScope()
+    {
+      Arena::current = this->previous;
+      this->arena->Release();
+    }
+
+    ArenaScope(const ArenaScope &) = delete;
+
+    ArenaScope & operator=(const ArenaScope &) = delete;
+
+  private:
+
+    Arena * arena;
+
+    Arena * previous;
+  };
+
+
+  // Copies are free; each allocation holds one arena reference until deallocated
+  template<typename T>
+  class ArenaAllocator
+  {
+  public:
+
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena * arena)
+      : arena(arena)
+    {
+    }
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> & other)
+      : arena(other.arena)
+    {
+    }
+
+    T * allocate(size_t n)
+    {
+      return static_cast<T *>(this->arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t)
+    {
+      this->arena->Release();
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> & other) const     { return this->arena == other.arena; }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U> & other) const     { return this->arena != other.arena; }
+
+  private:
+
+    template<typename U>
+    friend class ArenaAllocator;
+
+    Arena * arena;
+  };
+
+
+  template<typename T, typename... Args>
+  std::shared_ptr<T> Arena::MakeShared(Args &&... args)
+  {
+    if (current)
+    {
+      return std::allocate_shared<T>(ArenaAllocator<T>(current), std::forward<Args>(args)...);
+    }
+
+    return std::make_shared<T>(std::forward<Args>(args)...);
+  }
+
+
+  template<typename T>
+  std::shared_ptr<T> Arena::Adopt(T * ptr)
+  {
+    if (current)
+    {
+      return std::shared_ptr<T>(ptr, std::default_delete<T>(), ArenaAllocator<T>(current));
+    }
+
+    return std::shared_ptr<T>(ptr);
+  }
+}
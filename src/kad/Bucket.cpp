@@ -25,65 +25,247 @@
  * =============================================================================
  */
 
+
+#include <assert.h>
+#include <algorithm>
 #include "Bucket.h"
 
 namespace kad
 {
+  const size_t Bucket::Capacity;
+
+  const size_t Bucket::ReplacementCapacity;
+
+
+  int Bucket::Find(const Key & key) const
+  {
+    for (size_t i = 0; i < this->size; ++i)
+    {
+      if (this->keys[i] == key)
+      {
+        return static_cast<int>(i);
+      }
+    }
+
+    return -1;
+  }
+
+
+  void Bucket::Rotate(size_t idx)
+  {
+    assert(idx < this->size);
+
+    size_t last = this->size - 1;
+
+    Key key = this->keys[idx];
+    KeyPtr handle = std::move(this->handles[idx]);
+    ContactPtr contact = std::move(this->contacts[idx]);
+    auto seen = this->lastSeen[idx];
+    uint32_t time = this->rtt[idx];
+
+    // Keys and times are trivially copyable, so these two are plain memmoves
+    std::copy(this->keys + idx + 1, this->keys + this->size, this->keys + idx);
+    std::copy(this->lastSeen + idx + 1, this->lastSeen + this->size, this->lastSeen + idx);
+    std::copy(this->rtt + idx + 1, this->rtt + this->size, this->rtt + idx);
+    std::move(this->handles + idx + 1, this->handles + this->size, this->handles + idx);
+    std::move(this->contacts + idx + 1, this->contacts + this->size, this->contacts + idx);
+
+    this->keys[last] = key;
+    this->handles[last] = std::move(handle);
+    this->contacts[last] = std::move(contact);
+    this->lastSeen[last] = seen;
+    this->rtt[last] = time;
+  }
+
+
   ContactPtr Bucket::FindContact(KeyPtr key)
   {
-    auto itr = this->values.find(key);
-    return itr != this->values.end() ? itr->second.contact : nullptr;
+    int idx = this->Find(* key);
+    return idx >= 0 ? this->contacts[idx] : nullptr;
   }
 
 
   ContactPtr Bucket::UpdateContact(KeyPtr key)
   {
-    auto itr = this->values.find(key);
+    int idx = this->Find(* key);
 
-    if (itr == this->values.end())
+    if (idx < 0)
     {
       return nullptr;
     }
 
-    this->keys.splice(this->keys.end(), this->keys, itr->second.iter);
+    this->Rotate(idx);
 
-    itr->second.iter = (-- this->keys.end());
+    this->lastSeen[this->size - 1] = std::chrono::steady_clock::now();
 
-    return itr->second.contact;
+    return this->contacts[this->size - 1];
   }
 
 
-  KeyPtr Bucket::GetKeyFromIndx(size_t idx)
+  bool Bucket::SetContact(KeyPtr key, ContactPtr contact)
   {
-    if (idx >= this->keys.size())
+    int idx = this->Find(* key);
+
+    if (idx < 0)
     {
-      return nullptr;
+      return false;
+    }
+
+    // A new address is a new path
+    this->contacts[idx] = contact;
+    this->rtt[idx] = 0;
+
+    return true;
+  }
+
+
+  KeyPtr Bucket::GetKeyFromIndx(size_t idx) const
+  {
+    return idx < this->size ? this->handles[idx] : nullptr;
+  }
+
+
+  ContactPtr Bucket::GetContactFromIndx(size_t idx) const
+  {
+    return idx < this->size ? this->contacts[idx] : nullptr;
+  }
+
+
+  std::chrono::steady_clock::time_point Bucket::GetLastSeenFromIndx(size_t idx) const
+  {
+    return idx < this->size ? this->lastSeen[idx] : std::chrono::steady_clock::time_point();
+  }
+
+
+  uint32_t Bucket::GetRttFromIndx(size_t idx) const
+  {
+    return idx < this->size ? this->rtt[idx] : 0;
+  }
+
+
+  uint32_t Bucket::GetRtt(const Key & key) const
+  {
+    int idx = this->Find(key);
+    return idx >= 0 ? this->rtt[idx] : 0;
+  }
+
+
+  int Bucket::FindReplacement(const Key & key) const
+  {
+    for (size_t i = 0; i < this->replacementSize; ++i)
+    {
+      if (this->replacements[i].key == key)
+      {
+        return static_cast<int>(i);
+      }
+    }
+
+    return -1;
+  }
+
+
+  // The usual smoothing of TCP: each sample moves the estimate an eighth of the way
+  static uint32_t Smooth(uint32_t rtt, uint32_t sample)
+  {
+    return rtt == 0 ? std::max<uint32_t>(sample, 1) : static_cast<uint32_t>((uint64_t(rtt) * 7 + sample) / 8);
+  }
+
+
+  bool Bucket::UpdateRtt(const Key & key, uint32_t micros)
+  {
+    int idx = this->Find(key);
+
+    if (idx >= 0)
+    {
+      this->rtt[idx] = Smooth(this->rtt[idx], micros);
+      return true;
+    }
+
+    idx = this->FindReplacement(key);
+
+    if (idx >= 0)
+    {
+      this->replacements[idx].rtt = Smooth(this->replacements[idx].rtt, micros);
+      return true;
+    }
+
+    return false;
+  }
+
+
+  bool Bucket::SetHistory(const Key & key, std::chrono::steady_clock::time_point seen, uint32_t rtt)
+  {
+    int idx = this->Find(key);
+
+    if (idx < 0)
+    {
+      return false;
+    }
+
+    this->lastSeen[idx] = seen;
+    this->rtt[idx] = rtt;
+
+    return true;
+  }
+
+
+  bool Bucket::PromoteFaster(const Key & key)
+  {
+    int candidate = this->FindReplacement(key);
+
+    if (candidate < 0 || this->replacements[candidate].rtt == 0 || this->size < Capacity)
+    {
+      return false;
     }
 
-    auto itr = this->keys.begin();
+    size_t slowest = 0;
+
+    for (size_t i = 1; i < this->size; ++i)
+    {
+      if (this->rtt[i] > this->rtt[slowest])
+      {
+        slowest = i;
+      }
+    }
 
-    for (size_t i = 0; i < idx; ++i) {
-      ++ itr;
+    if (uint64_t(this->replacements[candidate].rtt) * 2 >= this->rtt[slowest])
+    {
+      return false;
     }
 
-    return * itr;
+    Replacement & other = this->replacements[candidate];
+
+    std::swap(this->keys[slowest], other.key);
+    std::swap(this->contacts[slowest], other.contact);
+    std::swap(this->lastSeen[slowest], other.seen);
+    std::swap(this->rtt[slowest], other.rtt);
+
+    this->handles[slowest] = std::make_shared<Key>(this->keys[slowest]);
+
+    // It has just answered us
+    this->Rotate(slowest);
+    this->lastSeen[this->size - 1] = std::chrono::steady_clock::now();
+
+    return true;
   }
 
 
   ContactPtr Bucket::EraseContact(KeyPtr key)
   {
-    auto itr = this->values.find(key);
+    int idx = this->Find(* key);
 
-    if (itr == this->values.end())
+    if (idx < 0)
     {
       return nullptr;
     }
 
-    this->keys.erase(itr->second.iter);
+    this->Rotate(idx);
 
-    auto result = itr->second.contact;
+    -- this->size;
 
-    this->values.erase(itr);
+    auto result = std::move(this->contacts[this->size]);
+
+    this->handles[this->size] = nullptr;
 
     return result;
   }
@@ -91,18 +273,20 @@ namespace kad
 
   bool Bucket::AddContact(KeyPtr key, ContactPtr contact)
   {
-    if (this->values.find(key) != this->values.end())
+    if (this->size >= Capacity || this->Find(* key) >= 0)
     {
       return false;
     }
 
-    this->keys.push_back(key);
+    this->keys[this->size] = * key;
 
-    Entry entry;
-    entry.iter = (-- this->keys.end());
-    entry.contact = contact;
+    // Own a copy: a key decoded from a package would otherwise pin its arena
+    this->handles[this->size] = std::make_shared<Key>(* key);
+    this->contacts[this->size] = contact;
+    this->lastSeen[this->size] = std::chrono::steady_clock::now();
+    this->rtt[this->size] = 0;
 
-    this->values.emplace(key, std::move(entry));
+    ++ this->size;
 
     return true;
   }
@@ -110,9 +294,9 @@ namespace kad
 
   void Bucket::GetAllContacts(std::vector<std::pair<KeyPtr, ContactPtr>> & result) const
   {
-    for (auto value : this->values)
+    for (size_t i = 0; i < this->size; ++i)
     {
-      result.emplace_back(std::make_pair(value.first, value.second.contact));
+      result.emplace_back(std::make_pair(this->handles[i], this->contacts[i]));
     }
   }
 
@@ -121,4 +305,139 @@ namespace kad
   {
     this->lastLookupTime = std::chrono::steady_clock::now();
   }
-}
\ No newline at end of file
+
+
+  void Bucket::Split(size_t bit, Bucket & upper)
+  {
+    assert(upper.size == 0);
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < this->size; ++i)
+    {
+      if (this->keys[i].Bit(bit))
+      {
+        upper.keys[upper.size] = this->keys[i];
+        upper.handles[upper.size] = std::move(this->handles[i]);
+        upper.contacts[upper.size] = std::move(this->contacts[i]);
+        upper.lastSeen[upper.size] = this->lastSeen[i];
+        upper.rtt[upper.size] = this->rtt[i];
+
+        ++ upper.size;
+      }
+      else
+      {
+        if (kept != i)
+        {
+          this->keys[kept] = this->keys[i];
+          this->handles[kept] = std::move(this->handles[i]);
+          this->contacts[kept] = std::move(this->contacts[i]);
+          this->lastSeen[kept] = this->lastSeen[i];
+          this->rtt[kept] = this->rtt[i];
+        }
+
+        ++ kept;
+      }
+    }
+
+    for (size_t i = kept; i < this->size; ++i)
+    {
+      this->handles[i] = nullptr;
+      this->contacts[i] = nullptr;
+    }
+
+    this->size = kept;
+
+    upper.lastLookupTime = this->lastLookupTime;
+
+    kept = 0;
+
+    for (size_t i = 0; i < this->replacementSize; ++i)
+    {
+      if (this->replacements[i].key.Bit(bit))
+      {
+        upper.replacements[upper.replacementSize++] = std::move(this->replacements[i]);
+      }
+      else if (kept++ != i)
+      {
+        this->replacements[kept - 1] = std::move(this->replacements[i]);
+      }
+    }
+
+    for (size_t i = kept; i < this->replacementSize; ++i)
+    {
+      this->replacements[i].contact = nullptr;
+    }
+
+    this->replacementSize = kept;
+
+    if (this->probing && this->probeKey.Bit(bit))
+    {
+      upper.SetProbe(this->probeKey);
+      this->ClearProbe();
+    }
+  }
+
+
+  void Bucket::AddReplacement(KeyPtr key, ContactPtr contact)
+  {
+    size_t idx = 0;
+
+    while (idx < this->replacementSize && this->replacements[idx].key != * key)
+    {
+      ++ idx;
+    }
+
+    // A candidate seen before keeps its RTT
+    uint32_t time = idx < this->replacementSize ? this->replacements[idx].rtt : 0;
+
+    // Take out the entry seen before, or the oldest one when full, and append
+    if (idx == this->replacementSize)
+    {
+      idx = this->replacementSize < ReplacementCapacity ? this->replacementSize++ : 0;
+    }
+
+    std::move(this->replacements + idx + 1, this->replacements + this->replacementSize, this->replacements + idx);
+
+    Replacement & last = this->replacements[this->replacementSize - 1];
+
+    last.key = * key;
+    last.contact = contact;
+    last.rtt = time;
+    last.seen = std::chrono::steady_clock::now();
+  }
+
+
+  bool Bucket::ReplaceContact(KeyPtr key)
+  {
+    if (this->Find(* key) < 0)
+    {
+      return false;
+    }
+
+    // A candidate may have joined the bucket some other way since
+    while (this->replacementSize > 0 && this->Find(this->replacements[this->replacementSize - 1].key) >= 0)
+    {
+      this->replacements[-- this->replacementSize].contact = nullptr;
+    }
+
+    if (this->replacementSize == 0)
+    {
+      return false;
+    }
+
+    this->EraseContact(key);
+
+    Replacement & last = this->replacements[-- this->replacementSize];
+
+    this->keys[this->size] = last.key;
+    this->handles[this->size] = std::make_shared<Key>(last.key);
+    this->contacts[this->size] = std::move(last.contact);
+    this->lastSeen[this->size] = last.seen;
+    this->rtt[this->size] = last.rtt;
+
+    ++ this->size;
+
+    return true;
+  }
+}
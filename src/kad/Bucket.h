@@ -25,10 +25,9 @@
  * =============================================================================
  */
 
+
 #pragma once
 
-#include <list>
-#include <map>
 #include <vector>
 #include <chrono>
 #include "Key.h"
@@ -36,33 +35,85 @@
 
 namespace kad
 {
+  // Up to Capacity contacts, least recently seen first, held in fixed arrays inside the
+  // bucket. The ids sit next to each other so a lookup scans a few cache lines and the
+  // XOR kernels can read them in place; the shared handles given out live alongside.
   class Bucket
   {
-  private:
+  public:
 
-    struct Entry
-    {
-      std::list<KeyPtr>::const_iterator iter;
-      ContactPtr contact;
-    };
+    static const size_t Capacity = 20;
+
+    // Candidates kept for when a contact fails
+    static const size_t ReplacementCapacity = 8;
 
   public:
 
     ContactPtr FindContact(KeyPtr key);
 
+    // Marks the contact as just seen, moving it to the back
     ContactPtr UpdateContact(KeyPtr key);
 
-    KeyPtr GetKeyFromIndx(size_t idx);
+    bool SetContact(KeyPtr key, ContactPtr contact);
+
+    KeyPtr GetKeyFromIndx(size_t idx) const;
+
+    ContactPtr GetContactFromIndx(size_t idx) const;
+
+    std::chrono::steady_clock::time_point GetLastSeenFromIndx(size_t idx) const;
+
+    // Smoothed round trip in microseconds, 0 until one was measured
+    uint32_t GetRttFromIndx(size_t idx) const;
+
+    uint32_t GetRtt(const Key & key) const;
+
+    // Folds a measured round trip into the smoothed RTT of a contact or candidate. Fails
+    // for a key that is neither.
+    bool UpdateRtt(const Key & key, uint32_t micros);
+
+    // Restores what was known of a contact, as when the table is loaded from disk
+    bool SetHistory(const Key & key, std::chrono::steady_clock::time_point seen, uint32_t rtt);
+
+    // Swaps a candidate in for the slowest contact when its RTT is under half of that
+    // contact's. The contact, alive but slow, becomes a candidate in its place.
+    bool PromoteFaster(const Key & key);
 
     ContactPtr EraseContact(KeyPtr key);
 
+    // Fails when the key is already here or the bucket is full
     bool AddContact(KeyPtr key, ContactPtr contact);
 
     void GetAllContacts(std::vector<std::pair<KeyPtr, ContactPtr>> & result) const;
 
     void UpdateLookupTime();
 
-    size_t Size() const     { return this->keys.size(); }
+    // Moves the contacts whose key has the bit set to the back of upper, an empty bucket,
+    // keeping their order and times. Both keep this bucket's lookup time.
+    void Split(size_t bit, Bucket & upper);
+
+    // Remembers a contact that found the bucket full, most recently seen last. The oldest
+    // candidate makes room when the cache is full.
+    void AddReplacement(KeyPtr key, ContactPtr contact);
+
+    // Swaps the contact for the most recently seen candidate. Fails, keeping the contact,
+    // when it is unknown or there is no candidate.
+    bool ReplaceContact(KeyPtr key);
+
+    size_t ReplacementSize() const    { return this->replacementSize; }
+
+    // The least recently seen contact is being pinged while this is set
+    bool IsProbing() const      { return this->probing; }
+
+    const Key & ProbeKey() const      { return this->probeKey; }
+
+    void SetProbe(const Key & key)    { this->probing = true; this->probeKey = key; }
+
+    void ClearProbe()           { this->probing = false; }
+
+    size_t Size() const         { return this->size; }
+
+    // The ids of the Size() contacts, in the same order as the index accessors
+    const Key * Keys() const    { return this->keys; }
 
     const std::chrono::steady_clock::time_point & LastLookupTime() const
     {
@@ -71,10 +122,43 @@ namespace kad
 
   private:
 
-    std::list<KeyPtr> keys;
+    int Find(const Key & key) const;
+
+    int FindReplacement(const Key & key) const;
+
+    // Shifts the records after idx down by one, leaving idx at the back
+    void Rotate(size_t idx);
+
+  private:
+
+    Key keys[Capacity];
+
+    KeyPtr handles[Capacity];
+
+    ContactPtr contacts[Capacity];
 
-    std::map<KeyPtr, Entry, KeyCompare> values;
+    std::chrono::steady_clock::time_point lastSeen[Capacity];
+
+    uint32_t rtt[Capacity] = {};
+
+    size_t size = 0;
 
     std::chrono::steady_clock::time_point lastLookupTime;
+
+    struct Replacement
+    {
+      Key key;
+      ContactPtr contact;
+      std::chrono::steady_clock::time_point seen;
+      uint32_t rtt = 0;
+    };
+
+    Replacement replacements[ReplacementCapacity];
+
+    size_t replacementSize = 0;
+
+    bool probing = false;
+
+    Key probeKey;
   };
-}
\ No newline at end of file
+}
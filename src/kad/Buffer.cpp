@@ -25,6 +25,7 @@
  * =============================================================================
  */
 
+#include <assert.h>
 #include <string.h>
 #include "Buffer.h"
 
@@ -48,6 +49,16 @@ namespace kad
   }
 
 
+  Buffer::Buffer(std::shared_ptr<Buffer> parent, size_t offset, size_t len)
+    : parent(std::move(parent))
+  {
+    assert(this->parent && offset + len <= this->parent->size);
+
+    this->data = this->parent->data + offset;
+    this->size = len;
+  }
+
+
   Buffer::~Buffer()
   {
     if (this->owned && this->data)
@@ -38,6 +38,9 @@ namespace kad
 
     explicit Buffer(const uint8_t * buffer, size_t len, bool copy = false, bool owned = false);
 
+    // A view of len bytes of parent starting at offset. Keeps parent alive instead of copying.
+    explicit Buffer(std::shared_ptr<Buffer> parent, size_t offset, size_t len);
+
     ~Buffer();
 
     void * Data() const   { return this->data; }
@@ -51,6 +54,8 @@ namespace kad
     size_t size = 0;
 
     bool owned = false;
+
+    std::shared_ptr<Buffer> parent;
   };
 
   using BufferPtr = std::shared_ptr<Buffer>;
@@ -32,6 +32,7 @@
 #include <arpa/inet.h>
 #endif
 
+#include "Arena.h"
 #include "BufferedInputStream.h"
 
 namespace kad
@@ -48,10 +49,23 @@ namespace kad
 
     this->isValid = true;
 
+    this->backing = nullptr;
+
     return true;
   }
 
 
+  BufferedInputStream::BufferedInputStream(BufferPtr backing)
+    : buffer(backing ? static_cast<const uint8_t *>(backing->Data()) : NULL)
+    , length(backing ? backing->Size() : 0)
+    , offset(0)
+    , needFree(false)
+    , isValid(true)
+    , backing(backing)
+  {
+  }
+
+
   BufferedInputStream::~BufferedInputStream(void)
   {
     if (this->needFree)
@@ -91,4 +105,24 @@ namespace kad
 
     return length;
   }
-}
\ No newline at end of file
+
+  BufferPtr BufferedInputStream::ReadBuffer(size_t length)
+  {
+    if (!this->backing)
+    {
+      return IInputStream::ReadBuffer(length);
+    }
+
+    if (this->length - this->offset < length)
+    {
+      this->isValid = false;
+      return nullptr;
+    }
+
+    auto result = Arena::MakeShared<kad::Buffer>(this->backing, this->offset, length);
+
+    this->offset += length;
+
+    return result;
+  }
+}
@@ -39,10 +39,12 @@ namespace kad
     size_t offset;
     bool needFree;
     bool isValid;
+    BufferPtr backing;
 
   public:
     BufferedInputStream() : buffer(NULL), length(0), offset(0), needFree(false), isValid(true) { }
     BufferedInputStream(const uint8_t * buffer, size_t length) : buffer(buffer), length(length), offset(0), needFree(false), isValid(true) {}
+    explicit BufferedInputStream(BufferPtr backing);
     ~BufferedInputStream(void);
 
     bool Initialize(IInputStream * stream);
@@ -60,5 +62,7 @@ namespace kad
     size_t Read(void * buffer, size_t length);
     size_t Peek(void * buffer, size_t length);
     bool IsValid() { return isValid; }
+    BufferPtr ReadBuffer(size_t length);
+    BufferPtr Backing() { return backing; }
   };
 }
\ No newline at end of file
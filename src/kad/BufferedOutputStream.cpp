@@ -37,6 +37,11 @@ namespace kad
   {
   }
 
+  BufferedOutputStream::BufferedOutputStream(size_t capacity) : buffer(NULL), length(0), offset(0)
+  {
+    EnsureBuffer(capacity);
+  }
+
   BufferedOutputStream::~BufferedOutputStream()
   {
     free(this->buffer);
@@ -46,9 +51,11 @@ namespace kad
   {
     if ((this->offset + length) > this->length)
     {
-      this->length = this->length + length + 64;
+      // Grow geometrically so a stream written piece by piece reallocates O(log n) times
+      size_t required = this->offset + length;
+      size_t grown = this->length * 2;
 
-      this->length &= ~63;
+      this->length = ((grown > required ? grown : required) + 63) & ~(size_t)63;
 
       this->buffer = (uint8_t *)realloc(this->buffer, this->length);
 
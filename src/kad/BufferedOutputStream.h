@@ -38,12 +38,16 @@ namespace kad
     size_t length;
     size_t offset;
 
-    inline bool EnsureBuffer(size_t length);
+    bool EnsureBuffer(size_t length);
 
   public:
     BufferedOutputStream();
+    explicit BufferedOutputStream(size_t capacity);
     ~BufferedOutputStream(void);
 
+    // Make room for at least length more bytes with a single allocation
+    bool Reserve(size_t length) { return EnsureBuffer(length); }
+
     bool Reset() { offset = 0; return true; }
     size_t Write(const void * ary, size_t length);
 
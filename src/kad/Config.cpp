@@ -28,6 +28,7 @@
 #include <ctime>
 #include <cstdlib>
 #include "Config.h"
+#include "Instruction.h"
 
 namespace kad
 {
@@ -49,12 +50,28 @@ namespace kad
 
   int Config::refreshTimerInterval = 5 * 60 * 1000;
 
+  size_t Config::refreshParallelism = 4;
+
+  int Config::refreshJitter = 30 * 1000;
+
   uint32_t Config::connectTimeout = 5;
 
   uint32_t Config::sendTimeout = 5;
 
   uint32_t Config::recvTimeout = 5;
 
+  // 0 means one compute thread per hardware thread
+  size_t Config::computeThreads = 0;
+
+  // Microseconds; only used when built with KAD_PROFILE_EVENTLOOP. 0 disables the report.
+  uint64_t Config::slowHandlerThreshold = 10000;
+
+  uint8_t Config::wireVersion = Instruction::LATEST_WIRE_VERSION;
+
+  bool Config::relaxedRouting = false;
+
+  bool Config::proximityRouting = true;
+
 
   void Config::Initialize(TSTRING rootPath, TSTRING defcontPath)
   {
@@ -61,12 +61,47 @@ namespace kad
 
     static int RefreshTimerInterval()     { return refreshTimerInterval; }
 
+    // Bucket refresh lookups a refresh cycle keeps in flight at once
+    static size_t RefreshParallelism()    { return refreshParallelism; }
+
+    static void SetRefreshParallelism(size_t value) { refreshParallelism = value > 0 ? value : 1; }
+
+    // Milliseconds each refresh cycle starts early or late by at most, so nodes started
+    // together do not refresh in step
+    static int RefreshJitter()            { return refreshJitter; }
+
+    static void SetRefreshJitter(int value) { refreshJitter = value > 0 ? value : 0; }
+
     static int ConnectTimeout()           { return connectTimeout; }
 
     static int SendTimeout()              { return sendTimeout; }
 
     static int RecvTimeout()              { return recvTimeout; }
 
+    static size_t ComputeThreads()        { return computeThreads; }
+
+    static void SetComputeThreads(size_t value) { computeThreads = value; }
+
+    static uint64_t SlowHandlerThreshold() { return slowHandlerThreshold; }
+
+    static void SetSlowHandlerThreshold(uint64_t value) { slowHandlerThreshold = value; }
+
+    // Highest wire version this node speaks; each peer is sent the highest both share
+    static uint8_t WireVersion()          { return wireVersion; }
+
+    static void SetWireVersion(uint8_t value) { wireVersion = value; }
+
+    // Whether the routing table also splits full buckets to keep our whole neighbourhood
+    static bool RelaxedRouting()          { return relaxedRouting; }
+
+    static void SetRelaxedRouting(bool value) { relaxedRouting = value; }
+
+    // Whether buckets favour contacts with short round trips and lookups break near ties
+    // between candidates by round trip
+    static bool ProximityRouting()        { return proximityRouting; }
+
+    static void SetProximityRouting(bool value) { proximityRouting = value; }
+
   private:
 
     static void InitKey();
@@ -91,10 +126,24 @@ namespace kad
 
     static int refreshTimerInterval;
 
+    static size_t refreshParallelism;
+
+    static int refreshJitter;
+
     static uint32_t connectTimeout;
 
     static uint32_t sendTimeout;
 
     static uint32_t recvTimeout;
+
+    static size_t computeThreads;
+
+    static uint64_t slowHandlerThreshold;
+
+    static uint8_t wireVersion;
+
+    static bool relaxedRouting;
+
+    static bool proximityRouting;
   };
 }
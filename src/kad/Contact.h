@@ -32,6 +32,7 @@
 #include <string>
 #include "IOutputStream.h"
 #include "IInputStream.h"
+#include "SpanReader.h"
 
 namespace kad
 {
@@ -60,6 +61,22 @@ namespace kad
       return true;
     }
 
+
+    bool Deserialize(SpanReader & input)
+    {
+      int32_t addr = 0;
+      int16_t port = 0;
+
+      if (!input.Read(addr) || !input.Read(port))
+      {
+        return false;
+      }
+
+      this->addr = static_cast<unsigned long>(addr);
+      this->port = static_cast<unsigned short>(port);
+      return true;
+    }
+
     std::string ToString() const
     {
       char buffer[32];
@@ -34,21 +34,30 @@ namespace kad
 {
   Digest::Digest()
   {
-    SHA1_Init(&sha);
+    ctx = EVP_MD_CTX_new();
+
+    if (ctx && EVP_DigestInit_ex(ctx, EVP_sha1(), nullptr) != 1)
+    {
+      EVP_MD_CTX_free(ctx);
+      ctx = nullptr;
+    }
   }
 
-  bool Digest::Update(const void * buffer, size_t size)
+  Digest::~Digest()
   {
-    SHA1_Update(&sha, buffer, size);
+    EVP_MD_CTX_free(ctx);
+  }
 
-    return true;
+  bool Digest::Update(const void * buffer, size_t size)
+  {
+    return ctx && EVP_DigestUpdate(ctx, buffer, size) == 1;
   }
 
   bool Digest::Finish(sha1_t digest)
   {
-    SHA1_Final(digest, &sha);
+    unsigned int len = 0;
 
-    return true;
+    return ctx && EVP_DigestFinal_ex(ctx, digest, &len) == 1 && len == sizeof(sha1_t);
   }
 
   bool Digest::Compute(const void * buffer, size_t size, sha1_t digest)
@@ -58,6 +67,33 @@ namespace kad
     return true;
   }
 
+  bool Digest::ComputeBatch(const void * const * buffers, const size_t * sizes, size_t count, sha1_t * digests)
+  {
+    EVP_MD_CTX * ctx = EVP_MD_CTX_new();
+    const EVP_MD * md = EVP_sha1();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      unsigned int len = 0;
+
+      // After the first buffer a null type reuses the digest the context already has
+      if (ctx &&
+          EVP_DigestInit_ex(ctx, i == 0 ? md : nullptr, nullptr) == 1 &&
+          EVP_DigestUpdate(ctx, buffers[i], sizes[i]) == 1 &&
+          EVP_DigestFinal_ex(ctx, digests[i], &len) == 1 &&
+          len == sizeof(sha1_t))
+      {
+        continue;
+      }
+
+      SHA1((const unsigned char *)buffers[i], sizes[i], digests[i]);
+    }
+
+    EVP_MD_CTX_free(ctx);
+
+    return true;
+  }
+
   bool Digest::Compare(const void * buffer, size_t size, sha1_t digest)
   {
     sha1_t computed;
@@ -29,6 +29,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <openssl/evp.h>
 #include <openssl/sha.h>
 
 #include <string>
@@ -39,14 +40,23 @@ namespace kad
 
   class Digest
   {
-    SHA_CTX sha;
+    EVP_MD_CTX * ctx;
 
   public:
     Digest();
+    ~Digest();
+    Digest(const Digest &) = delete;
+    Digest & operator=(const Digest &) = delete;
     bool Update(const void * buffer, size_t size);
     bool Finish(sha1_t digest);
 
     static bool Compute(const void * buffer, size_t size, sha1_t digest);
+
+    // Hashes count independent buffers, buffers[i] of sizes[i] bytes into digests[i].
+    // One EVP context is set up for the whole batch and reset between buffers, so the
+    // digest is only looked up once; OpenSSL runs it on the SHA extensions where the
+    // CPU has them. Falls back to one-shot SHA1() if the context cannot be created.
+    static bool ComputeBatch(const void * const * buffers, const size_t * sizes, size_t count, sha1_t * digests);
     static bool Compare(const void * buffer, size_t size, sha1_t digest);
     static void Print(sha1_t digest);
     static std::string ToString(sha1_t digest);
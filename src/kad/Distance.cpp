@@ -0,0 +1,196 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <string.h>
+#include <algorithm>
+#include "EndianUtil.h"
+#include "Distance.h"
+
+namespace kad
+{
+  static_assert(sizeof(Key) == Key::KEY_LEN, "Key arrays should be tightly packed");
+
+  const size_t Distance::LANES;
+
+
+  static inline uint64_t Word64(const uint8_t * ptr)
+  {
+    uint64_t value;
+    memcpy(& value, ptr, sizeof(value));
+    return be64toh(value);
+  }
+
+
+  static inline uint32_t Word32(const uint8_t * ptr)
+  {
+    uint32_t value;
+    memcpy(& value, ptr, sizeof(value));
+    return be32toh(value);
+  }
+
+
+  void Distance::Compute(const Key & target, const Key * keys, size_t count, Key * distances)
+  {
+    const uint8_t * src = reinterpret_cast<const uint8_t *>(keys);
+    uint8_t * dst = reinterpret_cast<uint8_t *>(distances);
+    size_t i = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    // The target repeated 8 times: 8 keys span 5 AVX2 registers, 4 keys span 5 SSE2 ones
+    uint8_t pattern[Key::KEY_LEN * 8];
+
+    for (size_t j = 0; j < 8; ++j)
+    {
+      memcpy(pattern + j * Key::KEY_LEN, target.Buffer(), Key::KEY_LEN);
+    }
+#endif
+
+#if defined(__AVX2__)
+    __m256i wide[5];
+
+    for (size_t j = 0; j < 5; ++j)
+    {
+      wide[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pattern + j * sizeof(__m256i)));
+    }
+
+    for (; i + 8 <= count; i += 8)
+    {
+      for (size_t j = 0; j < 5; ++j)
+      {
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + j * sizeof(__m256i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + j * sizeof(__m256i)), _mm256_xor_si256(value, wide[j]));
+      }
+
+      src += Key::KEY_LEN * 8;
+      dst += Key::KEY_LEN * 8;
+    }
+#endif
+
+#if defined(__SSE2__)
+    __m128i narrow[5];
+
+    for (size_t j = 0; j < 5; ++j)
+    {
+      narrow[j] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern + j * sizeof(__m128i)));
+    }
+
+    for (; i + 4 <= count; i += 4)
+    {
+      for (size_t j = 0; j < 5; ++j)
+      {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + j * sizeof(__m128i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + j * sizeof(__m128i)), _mm_xor_si128(value, narrow[j]));
+      }
+
+      src += Key::KEY_LEN * 4;
+      dst += Key::KEY_LEN * 4;
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+      distances[i] = keys[i].GetDistance(target);
+    }
+  }
+
+
+  size_t Distance::SelectClosest(const Key & target, const Key * keys, size_t count, size_t k, Entry * entries)
+  {
+    Key chunk[LANES];
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += LANES)
+    {
+      size_t len = std::min(LANES, count - i);
+
+      Compute(target, keys + i, len, chunk);
+
+      for (size_t j = 0; j < len; ++j)
+      {
+        const uint8_t * distance = chunk[j].Buffer();
+        Entry & entry = entries[i + j];
+
+        entry.high = Word64(distance);
+        entry.middle = Word64(distance + 8);
+        entry.low = Word32(distance + 16);
+        entry.index = static_cast<uint32_t>(i + j);
+      }
+    }
+
+    // Too few keys left to fill a register: XOR the words directly, which is the same
+    // since byte swapping commutes with XOR
+    const uint8_t * t = target.Buffer();
+
+    for (; i < count; ++i)
+    {
+      const uint8_t * key = keys[i].Buffer();
+      Entry & entry = entries[i];
+
+      entry.high = Word64(key) ^ Word64(t);
+      entry.middle = Word64(key + 8) ^ Word64(t + 8);
+      entry.low = Word32(key + 16) ^ Word32(t + 16);
+      entry.index = static_cast<uint32_t>(i);
+    }
+
+    if (k >= count)
+    {
+      std::sort(entries, entries + count);
+      return count;
+    }
+
+    std::partial_sort(entries, entries + k, entries + count);
+    return k;
+  }
+
+
+  void Distance::Merge(const Key & target, const std::vector<std::pair<KeyPtr, ContactPtr>> & nodes, std::map<Key, std::pair<KeyPtr, ContactPtr>> & candidates)
+  {
+    Key chunk[LANES];
+
+    for (size_t i = 0; i < nodes.size(); i += LANES)
+    {
+      size_t len = std::min(LANES, nodes.size() - i);
+
+      for (size_t j = 0; j < len; ++j)
+      {
+        chunk[j] = * nodes[i + j].first;
+      }
+
+      Compute(target, chunk, len, chunk);
+
+      for (size_t j = 0; j < len; ++j)
+      {
+        candidates[chunk[j]] = nodes[i + j];
+      }
+    }
+  }
+}
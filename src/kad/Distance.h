@@ -0,0 +1,90 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include "Key.h"
+#include "Contact.h"
+
+namespace kad
+{
+  // Bulk XOR distance over contiguous arrays of keys. The XOR runs on AVX2 or SSE2 when
+  // the compiler targets them and falls back to scalar code otherwise. Nothing here
+  // allocates.
+  class Distance
+  {
+  public:
+
+    // The distance to keys[index], split into big-endian words so it orders like the Key
+    struct Entry
+    {
+      uint64_t high;
+
+      uint64_t middle;
+
+      uint32_t low;
+
+      uint32_t index;
+
+      bool operator<(const Entry & other) const
+      {
+        if (this->high != other.high)
+        {
+          return this->high < other.high;
+        }
+
+        if (this->middle != other.middle)
+        {
+          return this->middle < other.middle;
+        }
+
+        return this->low < other.low;
+      }
+    };
+
+  public:
+
+    // distances[i] = target ^ keys[i]. The two arrays may be the same.
+    static void Compute(const Key & target, const Key * keys, size_t count, Key * distances);
+
+    // Leaves the k entries closest to target at the front of entries, closest first, and
+    // returns how many that is. entries must have room for count items.
+    static size_t SelectClosest(const Key & target, const Key * keys, size_t count, size_t k, Entry * entries);
+
+    // Adds nodes to candidates, keyed by their distance to target
+    static void Merge(const Key & target, const std::vector<std::pair<KeyPtr, ContactPtr>> & nodes, std::map<Key, std::pair<KeyPtr, ContactPtr>> & candidates);
+
+  private:
+
+    // Keys staged on the stack per call to Compute
+    static const size_t LANES = 8;
+  };
+}
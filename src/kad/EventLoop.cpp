@@ -31,6 +31,15 @@
 
 namespace kad
 {
+  const size_t EventLoop::DefaultCapacity;
+
+
+  EventLoop::EventLoop(size_t capacity)
+    : events(capacity, QueueFullPolicy::Block)
+  {
+  }
+
+
   EventLoop::~EventLoop()
   {
     this->Quit();
@@ -39,29 +48,47 @@ namespace kad
 
   void EventLoop::Run()
   {
+    this->consumer = std::this_thread::get_id();
+
     this->alive = true;
 
     while (!this->quit)
     {
-      EventHandlerEntry * entry = nullptr;
+      // Drain everything that is already queued in one pass
+      size_t count = this->events.ConsumeAll([this](EventHandlerEntry && entry) { this->Execute(entry); });
+
+      std::deque<EventHandlerEntry> spilled;
 
-      if (this->events.Consume(entry))
       {
-        entry->handler(entry->sender, entry->args);
-        if (entry->completed && entry->mutex && entry->cond)
-        {
-          std::unique_lock<std::mutex> lock(* entry->mutex);
-          * entry->completed = true;
-          entry->cond->notify_all();
-        }
+        std::unique_lock<std::mutex> lock(this->overflowMutex);
+        spilled.swap(this->overflow);
+      }
 
-        delete entry;
+      for (auto & entry : spilled)
+      {
+        this->Execute(entry);
       }
-      else
+
+      count += spilled.size();
+
+      if (count == 0)
       {
         std::unique_lock<std::mutex> lock(this->mutex);
 
-        this->cond.wait(lock);
+        this->sleeping = true;
+
+        this->cond.wait(lock, [this]()
+        {
+          if (this->quit || !this->events.Empty())
+          {
+            return true;
+          }
+
+          std::unique_lock<std::mutex> lock(this->overflowMutex);
+          return !this->overflow.empty();
+        });
+
+        this->sleeping = false;
       }
     }
 
@@ -85,47 +112,111 @@ namespace kad
   }
 
 
-  void EventLoop::BeginInvoke(EventHandler handler, void * sender, void * args)
+  void EventLoop::BeginInvoke(EventHandler handler, void * sender, void * args, const char * tag)
   {
     assert(handler != nullptr);
 
-    auto entry = new EventHandlerEntry();
-    entry->handler = std::move(handler);
-    entry->sender = sender;
-    entry->args = args;
-
-    this->events.Produce(entry);
-
-    std::unique_lock<std::mutex> lock(this->mutex);
-    this->cond.notify_one();
+    EventHandlerEntry entry;
+    entry.handler = std::move(handler);
+    entry.sender = sender;
+    entry.args = args;
+#ifdef KAD_PROFILE_EVENTLOOP
+    entry.tag = tag;
+    entry.posted = std::chrono::steady_clock::now();
+#else
+    (void)tag;
+#endif
+
+    this->Post(std::move(entry));
   }
 
 
-  void EventLoop::Invoke(EventHandler handler, void * sender, void * args)
+  void EventLoop::Invoke(EventHandler handler, void * sender, void * args, const char * tag)
   {
     assert(handler != nullptr);
 
-    auto entry = new EventHandlerEntry();
-    entry->handler = std::move(handler);
-    entry->sender = sender;
-    entry->args = args;
+    EventHandlerEntry entry;
+    entry.handler = std::move(handler);
+    entry.sender = sender;
+    entry.args = args;
+#ifdef KAD_PROFILE_EVENTLOOP
+    entry.tag = tag;
+    entry.posted = std::chrono::steady_clock::now();
+#else
+    (void)tag;
+#endif
 
     // Make sure we do not access the same instance of shared_ptr on different threads by making copies on each thread
-    auto completed = entry->completed = std::make_shared<std::atomic<bool>>(false);
-    auto m = entry->mutex = std::make_shared<std::mutex>();
-    auto c = entry->cond = std::make_shared<std::condition_variable>();
+    auto completed = entry.completed = std::make_shared<std::atomic<bool>>(false);
+    auto m = entry.mutex = std::make_shared<std::mutex>();
+    auto c = entry.cond = std::make_shared<std::condition_variable>();
+
+    this->Post(std::move(entry));
+
+    std::unique_lock<std::mutex> lock(* m);
+    if (! (* completed))
+    {
+      c->wait(lock);
+    }
+  }
+
+
+  void EventLoop::Post(EventHandlerEntry && entry)
+  {
+    if (std::this_thread::get_id() == this->consumer)
+    {
+      if (!this->events.TryProduce(entry))
+      {
+        std::unique_lock<std::mutex> lock(this->overflowMutex);
+        this->overflow.emplace_back(std::move(entry));
+      }
+
+      // The loop is running this very call, so it cannot be asleep
+      return;
+    }
 
     this->events.Produce(entry);
 
+    // Only take the lock when the loop may be waiting for work. Both sides use
+    // sequentially consistent operations, so either the loop sees the new item
+    // before it sleeps or we see it sleeping.
+    if (this->sleeping)
     {
       std::unique_lock<std::mutex> lock(this->mutex);
       this->cond.notify_one();
     }
+  }
+
+
+  void EventLoop::Execute(EventHandlerEntry & entry)
+  {
+    {
+#ifdef KAD_PROFILE_EVENTLOOP
+      EventLoopProfiler::Scope scope(
+        &this->profiler,
+        entry.tag,
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - entry.posted).count()
+      );
+#endif
+
+      entry.handler(entry.sender, entry.args);
+    }
 
-    std::unique_lock<std::mutex> lock(* m);
-    if (! (* completed))
+    if (entry.completed && entry.mutex && entry.cond)
     {
-      c->wait(lock);
+      std::unique_lock<std::mutex> lock(* entry.mutex);
+      * entry.completed = true;
+      entry.cond->notify_all();
     }
   }
-}
\ No newline at end of file
+
+
+  void EventLoop::PrintProfile(const char * name) const
+  {
+#ifdef KAD_PROFILE_EVENTLOOP
+    this->profiler.Print(name);
+#else
+    (void)name;
+#endif
+  }
+}
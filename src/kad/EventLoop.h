@@ -33,7 +33,19 @@
 #include <memory>
 #include <mutex>
 #include <condition_variable>
-#include "LockFreeQueue.h"
+#include <deque>
+#include <chrono>
+#include "RingQueue.h"
+
+#ifdef KAD_PROFILE_EVENTLOOP
+#include "EventLoopProfiler.h"
+
+// Profile the rest of the enclosing block under the function's name when it runs
+// inside an event loop handler
+#define PROFILE_SCOPE() kad::EventLoopProfiler::Scope profileScope(__PRETTY_FUNCTION__)
+#else
+#define PROFILE_SCOPE()
+#endif
 
 namespace kad
 {
@@ -51,22 +63,44 @@ namespace kad
       std::shared_ptr<std::atomic<bool>> completed;
       std::shared_ptr<std::mutex> mutex;
       std::shared_ptr<std::condition_variable> cond;
+#ifdef KAD_PROFILE_EVENTLOOP
+      const char * tag = nullptr;
+      std::chrono::steady_clock::time_point posted;
+#endif
     };
 
   public:
 
+    // Posts from other threads wait while the ring is full and the loop's own posts
+    // spill, so it only has to absorb bursts. Every slot is preallocated per thread.
+    static const size_t DefaultCapacity = 4096;
+
+  public:
+
+    explicit EventLoop(size_t capacity = DefaultCapacity);
+
     ~EventLoop();
 
     void Run();
 
     void Quit();
 
-    void BeginInvoke(EventHandler handler, void * sender = nullptr, void * args = nullptr);
+    // tag names the posting site for profiling and must be a string literal
+    void BeginInvoke(EventHandler handler, void * sender = nullptr, void * args = nullptr, const char * tag = nullptr);
 
-    void Invoke(EventHandler handler, void * sender = nullptr, void * args = nullptr);
+    void Invoke(EventHandler handler, void * sender = nullptr, void * args = nullptr, const char * tag = nullptr);
+
+    // Print per handler latency histograms. A no-op unless built with KAD_PROFILE_EVENTLOOP.
+    void PrintProfile(const char * name) const;
 
     bool IsRunning() const { return this->alive; }
 
+  private:
+
+    void Post(EventHandlerEntry && entry);
+
+    void Execute(EventHandlerEntry & entry);
+
   private:
 
     std::mutex mutex;
@@ -77,6 +111,20 @@ namespace kad
 
     std::atomic<bool> alive{false};
 
-    LockFreeQueue<EventHandlerEntry *> events;
+    std::atomic<bool> sleeping{false};
+
+    std::atomic<std::thread::id> consumer{std::thread::id()};
+
+    RingQueue<EventHandlerEntry> events;
+
+    // Handlers posted by the loop's own thread while the ring is full. Blocking there
+    // would deadlock, so they spill here and are drained after the ring.
+    std::mutex overflowMutex;
+
+    std::deque<EventHandlerEntry> overflow;
+
+#ifdef KAD_PROFILE_EVENTLOOP
+    EventLoopProfiler profiler;
+#endif
   };
 }
\ No newline at end of file
@@ -0,0 +1,236 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "Config.h"
+#include "EventLoopProfiler.h"
+
+namespace kad
+{
+  const size_t EventLoopProfiler::BUCKETS;
+
+
+  // The innermost open scope on this thread
+  static thread_local EventLoopProfiler::Scope * activeScope = nullptr;
+
+
+  EventLoopProfiler::Scope::Scope(EventLoopProfiler * profiler, const char * tag, uint64_t queueUs)
+    : profiler(profiler)
+    , tag(tag)
+    , queued(true)
+    , queueUs(queueUs)
+    , parent(activeScope)
+    , start(std::chrono::steady_clock::now())
+  {
+    activeScope = this;
+  }
+
+
+  EventLoopProfiler::Scope::Scope(const char * tag)
+  {
+    if (!activeScope || activeScope->tag == tag)
+    {
+      return;
+    }
+
+    this->profiler = activeScope->profiler;
+    this->tag = tag;
+    this->parent = activeScope;
+    this->start = std::chrono::steady_clock::now();
+
+    activeScope = this;
+  }
+
+
+  EventLoopProfiler::Scope::~Scope()
+  {
+    if (!this->profiler)
+    {
+      return;
+    }
+
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - this->start).count();
+
+    activeScope = this->parent;
+
+    if (this->parent)
+    {
+      this->parent->nestedUs += elapsed;
+    }
+
+    this->profiler->Record(this->tag, this->queued, this->queueUs, elapsed - std::min(elapsed, this->nestedUs));
+  }
+
+
+  void EventLoopProfiler::Histogram::Add(uint64_t us)
+  {
+    size_t idx = 0;
+
+    while (idx + 1 < BUCKETS && (1ull << idx) <= us)
+    {
+      ++ idx;
+    }
+
+    ++ this->counts[idx];
+    ++ this->total;
+    this->sum += us;
+    this->max = std::max(this->max, us);
+  }
+
+
+  uint64_t EventLoopProfiler::Histogram::Percentile(double p) const
+  {
+    uint64_t target = static_cast<uint64_t>(p * this->total + 0.5);
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+      seen += this->counts[i];
+
+      if (seen >= target && seen > 0)
+      {
+        return std::min<uint64_t>(this->max, 1ull << i);
+      }
+    }
+
+    return this->max;
+  }
+
+
+  void EventLoopProfiler::Record(const char * tag, bool queued, uint64_t queueUs, uint64_t execUs)
+  {
+    bool slow = Config::SlowHandlerThreshold() > 0 && execUs >= Config::SlowHandlerThreshold();
+
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+
+      Stats & stats = this->stats[tag];
+      stats.exec.Add(execUs);
+
+      if (queued)
+      {
+        stats.queue.Add(queueUs);
+      }
+
+      if (slow)
+      {
+        ++ stats.slow;
+      }
+    }
+
+    if (slow)
+    {
+      if (queued)
+      {
+        printf("[SLOW] %s took %lluus (queued %lluus)\n", FormatTag(tag).c_str(), (unsigned long long)execUs, (unsigned long long)queueUs);
+      }
+      else
+      {
+        printf("[SLOW] %s took %lluus (nested)\n", FormatTag(tag).c_str(), (unsigned long long)execUs);
+      }
+    }
+  }
+
+
+  void EventLoopProfiler::Print(const char * name) const
+  {
+    std::vector<std::pair<std::string, Stats>> rows;
+
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+
+      for (const auto & stats : this->stats)
+      {
+        rows.emplace_back(FormatTag(stats.first), stats.second);
+      }
+    }
+
+    // Busiest handlers first
+    std::sort(rows.begin(), rows.end(), [](const std::pair<std::string, Stats> & lhs, const std::pair<std::string, Stats> & rhs)
+    {
+      return lhs.second.exec.sum > rhs.second.exec.sum;
+    });
+
+    printf("[%s] %-40s %8s %10s %10s %10s %10s %10s %10s %6s\n", name ? name : "?", "handler", "count",
+           "queue p50", "queue p99", "queue max", "exec p50", "exec p99", "exec max", "slow");
+
+    for (const auto & row : rows)
+    {
+      const Stats & stats = row.second;
+
+      // Scopes that only ever ran nested inside another handler were never queued
+      char queue[3][24] = { "-", "-", "-" };
+
+      if (stats.queue.total > 0)
+      {
+        snprintf(queue[0], sizeof(queue[0]), "%llu", (unsigned long long)stats.queue.Percentile(0.5));
+        snprintf(queue[1], sizeof(queue[1]), "%llu", (unsigned long long)stats.queue.Percentile(0.99));
+        snprintf(queue[2], sizeof(queue[2]), "%llu", (unsigned long long)stats.queue.max);
+      }
+
+      printf("[%s] %-40s %8llu %10s %10s %10s %10llu %10llu %10llu %6llu\n", name ? name : "?", row.first.c_str(),
+             (unsigned long long)stats.exec.total,
+             queue[0], queue[1], queue[2],
+             (unsigned long long)stats.exec.Percentile(0.5), (unsigned long long)stats.exec.Percentile(0.99), (unsigned long long)stats.exec.max,
+             (unsigned long long)stats.slow);
+    }
+  }
+
+
+  std::string EventLoopProfiler::FormatTag(const char * tag)
+  {
+    if (!tag)
+    {
+      return "(untagged)";
+    }
+
+    std::string result = tag;
+
+    // Drop the parameter list and the return type
+    size_t paren = result.find('(');
+    if (paren != std::string::npos)
+    {
+      result.resize(paren);
+
+      size_t space = result.rfind(' ');
+      if (space != std::string::npos)
+      {
+        result = result.substr(space + 1);
+      }
+    }
+
+    if (result.compare(0, 5, "kad::") == 0)
+    {
+      result = result.substr(5);
+    }
+
+    return result;
+  }
+}
@@ -0,0 +1,116 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace kad
+{
+  // Per posting site statistics for one EventLoop, compiled in only with
+  // KAD_PROFILE_EVENTLOOP. Tags are string literals (usually __PRETTY_FUNCTION__)
+  // and are keyed by address, so recording never copies or hashes text.
+  class EventLoopProfiler
+  {
+  public:
+
+    // Power of two microsecond buckets: [0, 1), [1, 2), [2, 4), ... [2^30, inf)
+    static const size_t BUCKETS = 32;
+
+    struct Histogram
+    {
+      uint64_t counts[BUCKETS] = {};
+      uint64_t total = 0;
+      uint64_t sum = 0;
+      uint64_t max = 0;
+
+      void Add(uint64_t us);
+
+      // Upper bound of the bucket holding the p-th percentile (0 < p <= 1)
+      uint64_t Percentile(double p) const;
+    };
+
+    struct Stats
+    {
+      Histogram queue;
+      Histogram exec;
+      uint64_t slow = 0;
+    };
+
+    // Times a region on a loop's thread. Handlers run in one, and PROFILE_SCOPE() opens
+    // a nested one named after the enclosing function, so work a handler does inline
+    // (an action's response, a request it answers) shows up under its own tag. Time
+    // spent in nested scopes is left out of the enclosing scope's execution time.
+    class Scope
+    {
+    public:
+
+      // A handler run by profiler's loop after waiting queueUs
+      Scope(EventLoopProfiler * profiler, const char * tag, uint64_t queueUs);
+
+      // Nested in the handler running on this thread. A no-op outside of one, or
+      // directly inside a scope of the same tag (a THREAD_ENSURE hop to itself).
+      explicit Scope(const char * tag);
+
+      ~Scope();
+
+      Scope(const Scope &) = delete;
+
+      Scope & operator=(const Scope &) = delete;
+
+    private:
+
+      EventLoopProfiler * profiler = nullptr;
+      const char * tag = nullptr;
+      bool queued = false;
+      uint64_t queueUs = 0;
+      uint64_t nestedUs = 0;
+      Scope * parent = nullptr;
+      std::chrono::steady_clock::time_point start;
+    };
+
+  public:
+
+    // Called on the loop's thread as each scope closes. Nested scopes were not queued.
+    void Record(const char * tag, bool queued, uint64_t queueUs, uint64_t execUs);
+
+    void Print(const char * name) const;
+
+    // "void kad::FindNodeAction::OnResponse(kad::KeyPtr, ...)" -> "FindNodeAction::OnResponse"
+    static std::string FormatTag(const char * tag);
+
+  private:
+
+    mutable std::mutex mutex;
+
+    std::unordered_map<const char *, Stats> stats;
+  };
+}
@@ -28,6 +28,7 @@
 #include "protocol/FindNode.h"
 #include "protocol/FindNodeResponse.h"
 #include "KBuckets.h"
+#include "Distance.h"
 #include "Package.h"
 #include "Config.h"
 #include "PackageDispatcher.h"
@@ -45,12 +46,7 @@ namespace kad
   {
     this->target = target;
 
-    for (const auto & node : nodes)
-    {
-      KeyPtr distance = std::make_shared<Key>(target->GetDistance(*node.first));
-
-      this->candidates[distance] = node;
-    }
+    Distance::Merge(* target, nodes, this->candidates);
   }
 
 
@@ -86,7 +82,7 @@ namespace kad
         break;
       }
 
-      if (this->validated.find(node.second.first) != this->validated.end())
+      if (this->validated.find(* node.second.first) != this->validated.end())
       {
         result.emplace_back(std::move(node.second));
       }
@@ -100,7 +96,7 @@ namespace kad
 
     using namespace std::placeholders;
 
-    this->validating.emplace(candidate.first);
+    this->validating.emplace(* candidate.first);
 
     protocol::FindNode * findNode = new protocol::FindNode();
 
@@ -116,13 +112,16 @@ namespace kad
   {
     THREAD_ENSURE(this->owner, OnResponse, key, request, response);
 
-    this->validating.erase(key);
+    PROFILE_SCOPE();
+
+    this->validating.erase(* key);
 
     if (!this->IsCompleted())
     {
       if (!response)
       {
-        this->offline.emplace(key);
+        this->offline.emplace(* key);
+        this->Fail(key);
       }
       else
       {
@@ -130,39 +129,19 @@ namespace kad
 
         if (instr && instr->Code() == OpCode::FIND_NODE_RESPONSE)
         {
-          this->validated[key] = request->Target();
+          this->validated[* key] = request->Target();
 
           protocol::FindNodeResponse * findNodeResponse = static_cast<protocol::FindNodeResponse *>(instr);
 
-          for (const auto & node : findNodeResponse->Nodes())
-          {
-            KeyPtr distance = std::make_shared<Key>(this->target->GetDistance(*node.first));
-
-            this->candidates[distance] = node;
-          }
+          Distance::Merge(* this->target, findNodeResponse->Nodes(), this->candidates);
         }
       }
 
-      size_t idx = 0;
+      auto next = this->NextCandidate(this->candidates, this->offline, this->validating, this->validated);
 
-      for (const auto & candidate : this->candidates)
+      if (next)
       {
-        if (this->offline.find(candidate.second.first) != this->offline.end())
-        {
-          continue;
-        }
-
-        if ((idx++) >= KBuckets::SizeK)
-        {
-          break;
-        }
-
-        if (this->validated.find(candidate.second.first) == this->validated.end() &&
-            this->validating.find(candidate.second.first) == this->validating.end())
-        {
-          this->SendCandidate(candidate.second);
-          break;
-        }
+        this->SendCandidate(* next);
       }
 
       if (this->validating.empty())
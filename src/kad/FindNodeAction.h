@@ -59,12 +59,12 @@ namespace kad
 
     KeyPtr target;
 
-    std::map<KeyPtr, std::pair<KeyPtr, ContactPtr>, KeyCompare> candidates;
+    std::map<Key, std::pair<KeyPtr, ContactPtr>> candidates;
 
-    std::set<KeyPtr, KeyCompare> validating;
+    std::set<Key> validating;
 
-    std::map<KeyPtr, ContactPtr, KeyCompare> validated;
+    std::map<Key, ContactPtr> validated;
 
-    std::set<KeyPtr, KeyCompare> offline;
+    std::set<Key> offline;
   };
 }
\ No newline at end of file
@@ -66,15 +66,15 @@ namespace kad
 
     KeyPtr target;
 
-    std::map<KeyPtr, std::pair<KeyPtr, ContactPtr>, KeyCompare> candidates;
+    std::map<Key, std::pair<KeyPtr, ContactPtr>> candidates;
 
-    std::set<KeyPtr, KeyCompare> validating;
+    std::set<Key> validating;
 
-    std::map<KeyPtr, ContactPtr, KeyCompare> validated;
+    std::map<Key, ContactPtr> validated;
 
-    std::map<KeyPtr, std::pair<KeyPtr, ContactPtr>, KeyCompare> missed;
+    std::map<Key, std::pair<KeyPtr, ContactPtr>> missed;
 
-    std::set<KeyPtr, KeyCompare> offline;
+    std::set<Key> offline;
 
     BufferPtr result;
 
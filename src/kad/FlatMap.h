@@ -0,0 +1,357 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+namespace kad
+{
+  // Open-addressing hash map with linear probing over a power-of-two table, kept at most
+  // 3/4 full. Erase shifts the rest of the probe run back instead of leaving tombstones,
+  // so a miss stops at the first empty slot. Any insert or erase invalidates iterators.
+  //
+  // Mirrors the part of the std::map interface the indices use, so it can stand in for
+  // one where ordering is not needed. The table is only allocated on first insert.
+  template<typename K, typename V, typename Hash = std::hash<K>>
+  class FlatMap
+  {
+  public:
+
+    using value_type = std::pair<K, V>;
+
+  private:
+
+    struct Slot
+    {
+      bool used = false;
+      value_type value;
+    };
+
+    static const size_t MinCapacity = 16;
+
+    template<typename M, typename T>
+    class Iterator
+    {
+    public:
+
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = T;
+      using difference_type = ptrdiff_t;
+      using pointer = T *;
+      using reference = T &;
+
+      Iterator(M * map, size_t pos)
+        : map(map), pos(pos)
+      {
+        this->Skip();
+      }
+
+      // Lets an iterator convert to a const_iterator
+      template<typename N, typename U>
+      Iterator(const Iterator<N, U> & other)
+        : map(other.map), pos(other.pos)
+      {
+      }
+
+      T & operator*() const     { return this->map->slots[this->pos].value; }
+
+      T * operator->() const    { return & this->map->slots[this->pos].value; }
+
+      Iterator & operator++()
+      {
+        ++ this->pos;
+        this->Skip();
+        return * this;
+      }
+
+      bool operator==(const Iterator & other) const    { return this->pos == other.pos; }
+
+      bool operator!=(const Iterator & other) const    { return this->pos != other.pos; }
+
+    private:
+
+      void Skip()
+      {
+        size_t capacity = this->map->Capacity();
+
+        while (this->pos < capacity && !this->map->slots[this->pos].used)
+        {
+          ++ this->pos;
+        }
+      }
+
+    private:
+
+      template<typename, typename> friend class Iterator;
+
+      friend class FlatMap;
+
+      M * map;
+
+      size_t pos;
+    };
+
+  public:
+
+    using iterator = Iterator<FlatMap, value_type>;
+
+    using const_iterator = Iterator<const FlatMap, const value_type>;
+
+  public:
+
+    FlatMap() = default;
+
+    FlatMap(FlatMap && other) = default;
+
+    FlatMap & operator=(FlatMap && other) = default;
+
+    FlatMap(const FlatMap &) = delete;
+
+    FlatMap & operator=(const FlatMap &) = delete;
+
+    size_t size() const               { return this->count; }
+
+    bool empty() const                { return this->count == 0; }
+
+    iterator begin()                  { return iterator(this, 0); }
+
+    iterator end()                    { return iterator(this, this->Capacity()); }
+
+    const_iterator begin() const      { return const_iterator(this, 0); }
+
+    const_iterator end() const        { return const_iterator(this, this->Capacity()); }
+
+    iterator find(const K & key)
+    {
+      return iterator(this, this->Find(key));
+    }
+
+    const_iterator find(const K & key) const
+    {
+      return const_iterator(this, this->Find(key));
+    }
+
+    template<typename T>
+    std::pair<iterator, bool> emplace(const K & key, T && value)
+    {
+      size_t pos = this->Find(key);
+
+      if (pos != this->Capacity())
+      {
+        return std::make_pair(iterator(this, pos), false);
+      }
+
+      pos = this->Insert(key);
+      this->slots[pos].value.second = std::forward<T>(value);
+
+      return std::make_pair(iterator(this, pos), true);
+    }
+
+    V & operator[](const K & key)
+    {
+      size_t pos = this->Find(key);
+
+      if (pos == this->Capacity())
+      {
+        pos = this->Insert(key);
+      }
+
+      return this->slots[pos].value.second;
+    }
+
+    void erase(const_iterator itr)
+    {
+      this->Erase(itr.pos);
+    }
+
+    size_t erase(const K & key)
+    {
+      size_t pos = this->Find(key);
+
+      if (pos == this->Capacity())
+      {
+        return 0;
+      }
+
+      this->Erase(pos);
+      return 1;
+    }
+
+    void clear()
+    {
+      this->slots.reset();
+      this->mask = 0;
+      this->count = 0;
+    }
+
+    // Size the table so that count entries fit without growing
+    void reserve(size_t count)
+    {
+      size_t capacity = MinCapacity;
+
+      while (capacity * 3 < count * 4)
+      {
+        capacity <<= 1;
+      }
+
+      if (capacity > this->Capacity())
+      {
+        this->Rehash(capacity);
+      }
+    }
+
+  private:
+
+    size_t Capacity() const           { return this->slots ? this->mask + 1 : 0; }
+
+    size_t Home(const K & key) const  { return this->hash(key) & this->mask; }
+
+    // The slot holding key, or Capacity() when there is none
+    size_t Find(const K & key) const
+    {
+      if (!this->slots)
+      {
+        return 0;
+      }
+
+      for (size_t pos = this->Home(key); ; pos = (pos + 1) & this->mask)
+      {
+        const Slot & slot = this->slots[pos];
+
+        if (!slot.used)
+        {
+          return this->Capacity();
+        }
+
+        if (slot.value.first == key)
+        {
+          return pos;
+        }
+      }
+    }
+
+    // Claims a slot for a key known to be absent and returns it
+    size_t Insert(const K & key)
+    {
+      if ((this->count + 1) * 4 > this->Capacity() * 3)
+      {
+        this->Rehash(this->Capacity() ? this->Capacity() * 2 : MinCapacity);
+      }
+
+      size_t pos = this->Home(key);
+
+      while (this->slots[pos].used)
+      {
+        pos = (pos + 1) & this->mask;
+      }
+
+      this->slots[pos].used = true;
+      this->slots[pos].value.first = key;
+      ++ this->count;
+
+      return pos;
+    }
+
+    void Erase(size_t pos)
+    {
+      // Pull back every later entry of the run whose home slot does not lie
+      // cyclically in (pos, next], so that none of them is cut off by the hole
+      size_t next = pos;
+
+      while (true)
+      {
+        next = (next + 1) & this->mask;
+
+        if (!this->slots[next].used)
+        {
+          break;
+        }
+
+        size_t home = this->Home(this->slots[next].value.first);
+
+        bool stays = pos <= next ? (pos < home && home <= next) : (pos < home || home <= next);
+
+        if (!stays)
+        {
+          this->slots[pos].value = std::move(this->slots[next].value);
+          pos = next;
+        }
+      }
+
+      // Drop whatever the value still holds on to
+      this->slots[pos].used = false;
+      this->slots[pos].value = value_type();
+      -- this->count;
+    }
+
+    void Rehash(size_t capacity)
+    {
+      std::unique_ptr<Slot[]> old = std::move(this->slots);
+      size_t oldCapacity = old ? this->mask + 1 : 0;
+
+      this->slots.reset(new Slot[capacity]);
+      this->mask = capacity - 1;
+
+      for (size_t i = 0; i < oldCapacity; ++i)
+      {
+        if (old[i].used)
+        {
+          size_t pos = this->Home(old[i].value.first);
+
+          while (this->slots[pos].used)
+          {
+            pos = (pos + 1) & this->mask;
+          }
+
+          this->slots[pos].used = true;
+          this->slots[pos].value = std::move(old[i].value);
+        }
+      }
+    }
+
+  private:
+
+    std::unique_ptr<Slot[]> slots;
+
+    size_t mask = 0;
+
+    size_t count = 0;
+
+    Hash hash;
+  };
+
+
+  template<typename K, typename V, typename Hash>
+  const size_t FlatMap<K, V, Hash>::MinCapacity;
+}
@@ -25,6 +25,7 @@
  * =============================================================================
  */
 
+#include "Arena.h"
 #include "IInputStream.h"
 #include "EndianUtil.h"
 
@@ -270,4 +271,23 @@ namespace kad
 
     return size;
   }
-}
\ No newline at end of file
+
+
+  BufferPtr IInputStream::ReadBuffer(size_t length)
+  {
+    if (Remainder() < length)
+    {
+      return nullptr;
+    }
+
+    uint8_t * ptr = new uint8_t[length];
+
+    if (Read(ptr, length) != length)
+    {
+      delete[] ptr;
+      return nullptr;
+    }
+
+    return Arena::MakeShared<Buffer>(ptr, length, false, true);
+  }
+}
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string>
+#include "Buffer.h"
 
 namespace kad
 {
@@ -66,5 +67,13 @@ namespace kad
     virtual uint64_t ReadUInt64();
     virtual size_t ReadUInt64(uint64_t * ary, size_t length);
     virtual size_t ReadString(std::string & str);
+
+    // Read length bytes as a Buffer. Streams over a shared buffer return a slice of it
+    // rather than a copy. Returns nullptr if fewer than length bytes remain.
+    virtual BufferPtr ReadBuffer(size_t length);
+
+    // The shared buffer this stream reads from, if any. Offset 0 of the stream is the
+    // start of the buffer.
+    virtual BufferPtr Backing()     { return nullptr; }
   };
 }
\ No newline at end of file
@@ -239,4 +239,37 @@ namespace kad
       WriteInt8((int8_t*)str.data(), str.length())
     );
   }
+
+  bool IOutputStream::WriteVarUInt(uint64_t value)
+  {
+    uint8_t buffer[10];
+    size_t length = 0;
+
+    do
+    {
+      buffer[length] = static_cast<uint8_t>(value & 0x7F);
+      value >>= 7;
+
+      if (value)
+      {
+        buffer[length] |= 0x80;
+      }
+
+      ++length;
+    } while (value);
+
+    return Write(buffer, length) == length;
+  }
+
+  size_t IOutputStream::VarUIntSize(uint64_t value)
+  {
+    size_t length = 1;
+
+    while (value >>= 7)
+    {
+      ++length;
+    }
+
+    return length;
+  }
 }
\ No newline at end of file
@@ -57,5 +57,9 @@ namespace kad
     virtual bool WriteUInt64(uint64_t value);
     virtual bool WriteUInt64(const uint64_t * ary, size_t length);
     virtual bool WriteString(std::string & str);
+
+    // Unsigned LEB128: seven bits per byte, least significant group first
+    virtual bool WriteVarUInt(uint64_t value);
+    static size_t VarUIntSize(uint64_t value);
   };
 }
\ No newline at end of file
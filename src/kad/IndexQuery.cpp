@@ -60,7 +60,7 @@ namespace kad
   {
     Json::Value target;
     Json::Reader reader;
-    if (!reader.parse(content, len, target))
+    if (!reader.parse(content, content + len, target))
     {
       return false;
     }
@@ -141,7 +141,7 @@ namespace kad
 
     Json::Value valueJson;
     Json::Reader reader;
-    bool parsed = reader.parse(delim + 1, str + len - delim - 1, valueJson);
+    bool parsed = reader.parse(delim + 1, str + len, valueJson);
 
     if (!parsed)
     {
@@ -0,0 +1,79 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#include <new>
+#include "Arena.h"
+#include "Instruction.h"
+
+namespace kad
+{
+  const uint8_t Instruction::WIRE_VERSION_0;
+
+  const uint8_t Instruction::WIRE_VERSION_1;
+
+  const uint8_t Instruction::LATEST_WIRE_VERSION;
+
+
+  // Each instruction is preceded by a header naming the arena it lives in, if any.
+  // Deleting an arena instruction runs its destructor and drops its arena reference.
+  static const size_t HEADER_SIZE = alignof(std::max_align_t);
+
+
+  void * Instruction::operator new(size_t size)
+  {
+    Arena * arena = Arena::Current();
+
+    uint8_t * base = arena
+      ? static_cast<uint8_t *>(arena->Allocate(size + HEADER_SIZE, alignof(std::max_align_t)))
+      : static_cast<uint8_t *>(::operator new(size + HEADER_SIZE));
+
+    * reinterpret_cast<Arena **>(base) = arena;
+
+    return base + HEADER_SIZE;
+  }
+
+
+  void Instruction::operator delete(void * ptr)
+  {
+    if (!ptr)
+    {
+      return;
+    }
+
+    uint8_t * base = static_cast<uint8_t *>(ptr) - HEADER_SIZE;
+    Arena * arena = * reinterpret_cast<Arena **>(base);
+
+    if (arena)
+    {
+      arena->Release();
+    }
+    else
+    {
+      ::operator delete(base);
+    }
+  }
+}
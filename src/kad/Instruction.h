@@ -27,7 +27,9 @@
 
 #pragma once
 
-#include "IInputStream.h"
+#include <memory>
+#include <string>
+#include "SpanReader.h"
 #include "IOutputStream.h"
 #include "OpCode.h"
 
@@ -44,28 +46,111 @@ namespace kad
 
     virtual ~Instruction() = default;
 
+    // Instructions created while an ArenaScope is active (i.e. while decoding a
+    // package) are placed in that arena
+    static void * operator new(size_t size);
+
+    static void operator delete(void * ptr);
+
     OpCode Code() const     { return this->code; }
 
-    virtual bool Serialize(IOutputStream & output) const = 0;
+    // All encodings take the wire version of the package they belong to
+    virtual bool Serialize(IOutputStream & output, uint8_t version) const = 0;
+
+    // Exact number of bytes Serialize writes, so callers can size buffers up front
+    virtual size_t SerializedSize(uint8_t version) const = 0;
 
-    virtual bool Deserialize(IInputStream & input) = 0;
+    virtual bool Deserialize(SpanReader & input, uint8_t version) = 0;
 
     virtual void Print() const = 0;
 
+  public:
+
+    // Version 0 is the original encoding with fixed-width integers. Version 1 writes
+    // integers and lengths as LEB128 varints and compresses contact lists, and adds BATCH.
+    static const uint8_t WIRE_VERSION_0 = 0;
+
+    static const uint8_t WIRE_VERSION_1 = 1;
+
+    static const uint8_t LATEST_WIRE_VERSION = WIRE_VERSION_1;
+
   protected:
 
-    inline bool SerializeOpCode(IOutputStream & output) const
+    bool SerializeOpCode(IOutputStream & output, uint8_t version) const
     {
-      return output.WriteUInt16(static_cast<uint16_t>(this->code));
+      return WriteInteger(output, version, static_cast<uint16_t>(this->code));
     }
 
-    inline bool DeserializeOpCode(IInputStream & input)
+    size_t OpCodeSize(uint8_t version) const
     {
-      return input.Remainder() >= sizeof(uint16_t) && input.ReadUInt16() == static_cast<uint16_t>(this->code);
+      return IntegerSize(version, static_cast<uint16_t>(this->code));
     }
 
+    bool DeserializeOpCode(SpanReader & input, uint8_t version)
+    {
+      uint16_t value = 0;
+      return ReadInteger(input, version, value) && value == static_cast<uint16_t>(this->code);
+    }
+
+    // An integer field at its fixed width in version 0 and as a varint afterwards
+    template<typename T>
+    static bool WriteInteger(IOutputStream & output, uint8_t version, T value)
+    {
+      return version == WIRE_VERSION_0 ? WriteFixed(output, value) : output.WriteVarUInt(value);
+    }
+
+    template<typename T>
+    static size_t IntegerSize(uint8_t version, T value)
+    {
+      return version == WIRE_VERSION_0 ? sizeof(T) : IOutputStream::VarUIntSize(value);
+    }
+
+    template<typename T>
+    static bool ReadInteger(SpanReader & input, uint8_t version, T & value)
+    {
+      return version == WIRE_VERSION_0 ? input.Read(value) : input.ReadVarUInt(value);
+    }
+
+    // A length-prefixed string. A truncated string leaves input where it was.
+    static bool WriteString(IOutputStream & output, uint8_t version, const std::string & str)
+    {
+      return WriteInteger(output, version, static_cast<uint32_t>(str.size())) && output.Write(str.data(), str.size()) == str.size();
+    }
+
+    static size_t StringSize(uint8_t version, const std::string & str)
+    {
+      return IntegerSize(version, static_cast<uint32_t>(str.size())) + str.size();
+    }
+
+    static bool ReadString(SpanReader & input, uint8_t version, std::string & str)
+    {
+      size_t offset = input.Offset();
+      uint32_t length = 0;
+
+      if (!ReadInteger(input, version, length) || input.Remainder() < length)
+      {
+        input.Rewind(input.Offset() - offset);
+        return false;
+      }
+
+      str.assign(reinterpret_cast<const char *>(input.Data()), length);
+      return input.Skip(length);
+    }
+
+  private:
+
+    static bool WriteFixed(IOutputStream & output, uint8_t value)     { return output.WriteUInt8(value); }
+
+    static bool WriteFixed(IOutputStream & output, uint16_t value)    { return output.WriteUInt16(value); }
+
+    static bool WriteFixed(IOutputStream & output, uint32_t value)    { return output.WriteUInt32(value); }
+
+    static bool WriteFixed(IOutputStream & output, uint64_t value)    { return output.WriteUInt64(value); }
+
   protected:
 
     OpCode code;
   };
+
+  using InstructionPtr = std::shared_ptr<Instruction>;
 }
\ No newline at end of file
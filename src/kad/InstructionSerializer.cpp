@@ -39,38 +39,41 @@
 #include "protocol/StoreLogResponse.h"
 #include "protocol/QueryLog.h"
 #include "protocol/QueryLogResponse.h"
+#include "protocol/Batch.h"
 
 #include "IOutputStream.h"
-#include "IInputStream.h"
+#include "SpanReader.h"
 #include "InstructionSerializer.h"
 
 namespace kad
 {
-  bool InstructionSerializer::Serialize(IOutputStream & output, const Instruction * instr)
+  bool InstructionSerializer::Serialize(IOutputStream & output, const Instruction * instr, uint8_t version)
   {
     if (!instr)
     {
       return false;
     }
 
-    return instr->Serialize(output);
+    return instr->Serialize(output, version);
   }
 
 
-  Instruction * InstructionSerializer::Deserialize(IInputStream & input)
+  Instruction * InstructionSerializer::Deserialize(SpanReader & input, uint8_t version)
   {
-    if (input.Remainder() < sizeof(uint16_t))
+    OpCode code;
+
+    if (!PeekOpCode(input, version, code))
     {
       return nullptr;
     }
 
-    Instruction * instr = CreateInstruction(static_cast<OpCode>(input.PeekUInt16()));
+    Instruction * instr = CreateInstruction(code);
     if (!instr)
     {
       return nullptr;
     }
 
-    if (!instr->Deserialize(input))
+    if (!instr->Deserialize(input, version))
     {
       delete instr;
       return nullptr;
@@ -80,6 +83,21 @@ namespace kad
   }
 
 
+  bool InstructionSerializer::PeekOpCode(SpanReader & input, uint8_t version, OpCode & code)
+  {
+    uint16_t value = 0;
+
+    if (version == Instruction::WIRE_VERSION_0 ? !input.Peek(value) : !input.PeekVarUInt(value))
+    {
+      return false;
+    }
+
+    code = static_cast<OpCode>(value);
+
+    return true;
+  }
+
+
   Instruction * InstructionSerializer::CreateInstruction(OpCode code)
   {
     switch (code)
@@ -98,6 +116,7 @@ namespace kad
       case OpCode::STORE_LOG_RESPONSE:  return new protocol::StoreLogResponse();
       case OpCode::QUERY_LOG:           return new protocol::QueryLog();
       case OpCode::QUERY_LOG_RESPONSE:  return new protocol::QueryLogResponse();
+      case OpCode::BATCH:               return new protocol::Batch();
 
       default:                          return nullptr;
     }
@@ -27,21 +27,25 @@
 
 #pragma once
 
+#include <stdint.h>
 #include "OpCode.h"
 
 namespace kad
 {
   class Instruction;
   class IOutputStream;
-  class IInputStream;
+  class SpanReader;
 
   class InstructionSerializer
   {
   public:
 
-    static bool Serialize(IOutputStream & output, const Instruction * instr);
+    static bool Serialize(IOutputStream & output, const Instruction * instr, uint8_t version);
 
-    static Instruction * Deserialize(IInputStream & input);
+    static Instruction * Deserialize(SpanReader & input, uint8_t version);
+
+    // Opcode of the next instruction in input, without consuming it
+    static bool PeekOpCode(SpanReader & input, uint8_t version, OpCode & code);
 
   private:
 
@@ -25,6 +25,8 @@
  * =============================================================================
  */
 
+#include <string.h>
+#include <algorithm>
 #include "KBuckets.h"
 
 namespace kad
@@ -32,232 +34,442 @@ namespace kad
   const size_t KBuckets::SizeK;
 
 
-  KBuckets::KBuckets(KeyPtr selfKey)
-    : selfKey(selfKey)
+  KBuckets::KBuckets(KeyPtr selfKey, bool relaxed, bool proximity)
+    : leaves(1)
+    , selfKey(selfKey)
+    , relaxed(relaxed)
+    , proximity(proximity)
   {
   }
 
 
-  int KBuckets::FindBucket(const Key & key) const
+  Key KBuckets::Prefix(const Key & key, size_t depth)
   {
-    return this->selfKey->GetDistance(key).GetHighestBit();
+    uint8_t buffer[Key::KEY_LEN];
+
+    memcpy(buffer, key.Buffer(), Key::KEY_LEN);
+
+    size_t bytes = depth / 8;
+
+    if (bytes < Key::KEY_LEN)
+    {
+      buffer[bytes] &= static_cast<uint8_t>(0xFF00 >> (depth % 8));
+      memset(buffer + bytes + 1, 0, Key::KEY_LEN - bytes - 1);
+    }
+
+    return Key(buffer);
   }
 
 
-  ContactPtr KBuckets::FindContact(KeyPtr key)
+  size_t KBuckets::FindBucket(const Key & key) const
+  {
+    // The first bucket starts at the zero id, so there always is one at or before key
+    auto it = std::upper_bound(this->leaves.begin(), this->leaves.end(), key,
+      [](const Key & key, const Leaf & leaf) { return key < leaf.prefix; });
+
+    return static_cast<size_t>(it - this->leaves.begin()) - 1;
+  }
+
+
+  bool KBuckets::CanSplit(size_t idx, const Key & key) const
   {
-    int idx = FindBucket(* key);
+    const Leaf & leaf = this->leaves[idx];
 
-    if (idx < 0)
+    if (leaf.depth >= Key::KEY_LEN_BITS)
     {
-      return nullptr;
+      return false;
     }
-    else
+
+    if (Prefix(* this->selfKey, leaf.depth) == leaf.prefix)
     {
-      return this->buckets[idx].FindContact(key);
+      return true;
     }
+
+    return this->relaxed && this->GetCloserContactCount(key) < SizeK;
   }
 
 
-  void KBuckets::FindClosestContacts(KeyPtr key, std::vector<std::pair<KeyPtr, ContactPtr>> & result, bool restrictBucket)
+  void KBuckets::Split(size_t idx)
   {
-    int idx = FindBucket(* key);
+    size_t bit = Key::KEY_LEN_BITS - 1 - this->leaves[idx].depth;
+
+    Leaf upper;
+
+    upper.prefix = this->leaves[idx].prefix;
+    upper.prefix.SetBit(bit, true);
+    upper.depth = ++ this->leaves[idx].depth;
+
+    this->leaves[idx].bucket.Split(bit, upper.bucket);
+
+    this->leaves.insert(this->leaves.begin() + idx + 1, std::move(upper));
+  }
+
 
-    if (idx < 0)
+  void KBuckets::Changed()
+  {
+    this->modified = true;
+
+    if (!this->dirty)
     {
-      // Do not include self in the result;
-      if (!restrictBucket)
-      {
-        idx = 0;
-      }
-      else
+      this->dirty = true;
+
+      if (this->onChange)
       {
-        return;
+        this->onChange();
       }
     }
+  }
 
-    auto collect = [this, & result](int i)
+
+  void KBuckets::Publish()
+  {
+    if (!this->dirty)
     {
-      for (size_t j = 0; j < this->buckets[i].Size() && result.size() < SizeK; ++j)
-      {
-        auto id = this->buckets[i].GetKeyFromIndx(j);
+      return;
+    }
 
-        if (id == nullptr)
-        {
-          break;
-        }
+    auto snapshot = std::make_shared<RoutingSnapshot>();
 
-        result.emplace_back(std::make_pair(id, this->buckets[i].FindContact(id)));
-      }
-    };
+    snapshot->buckets.reserve(this->leaves.size());
+    snapshot->keys.reserve(this->size);
+    snapshot->contacts.reserve(this->size);
 
-    if (!restrictBucket)
+    for (const auto & leaf : this->leaves)
     {
-      for (int i = idx; i >= 0 && result.size() < SizeK; --i)
-      {
-        collect(i);
-      }
+      const Bucket & bucket = leaf.bucket;
 
-      if (result.size() < SizeK)
-      {
-        for (size_t i = idx + 1; i < Key::KEY_LEN_BITS && result.size() < SizeK; ++i)
-        {
-          collect(i);
-        }
-      }
-    }
-    else
-    {
-      collect(idx);
+      snapshot->buckets.push_back({ leaf.prefix, leaf.depth, snapshot->keys.size(), snapshot->keys.size() + bucket.Size() });
+      snapshot->keys.insert(snapshot->keys.end(), bucket.Keys(), bucket.Keys() + bucket.Size());
+      bucket.GetAllContacts(snapshot->contacts);
     }
+
+    std::atomic_store(& this->snapshot, RoutingSnapshotPtr(std::move(snapshot)));
+
+    this->dirty = false;
+  }
+
+
+  ContactPtr KBuckets::FindContact(KeyPtr key)
+  {
+    return this->leaves[FindBucket(* key)].bucket.FindContact(key);
+  }
+
+
+  void KBuckets::FindClosestContacts(KeyPtr key, std::vector<std::pair<KeyPtr, ContactPtr>> & result, bool restrictBucket)
+  {
+    // Reading through the snapshot keeps one copy of the search; publishing here only
+    // costs anything right after a change
+    this->Publish();
+
+    this->snapshot->FindClosestContacts(* key, SizeK, result, restrictBucket);
   }
 
 
   ContactPtr KBuckets::UpdateContact(KeyPtr key)
   {
-    int idx = FindBucket(* key);
+    return this->leaves[FindBucket(* key)].bucket.UpdateContact(key);
+  }
+
 
-    if (idx < 0)
+  bool KBuckets::SetContact(KeyPtr key, ContactPtr contact)
+  {
+    if (!this->leaves[FindBucket(* key)].bucket.SetContact(key, contact))
     {
-      return nullptr;
+      return false;
     }
 
-    return this->buckets[idx].UpdateContact(key);
+    this->Changed();
+
+    return true;
   }
 
 
   void KBuckets::GetOldContacts(KeyPtr key, size_t count, std::vector<std::pair<KeyPtr, ContactPtr>> & result)
   {
-    int idx = FindBucket(* key);
+    const Bucket & bucket = this->leaves[FindBucket(* key)].bucket;
 
-    if (idx < 0)
+    for (size_t i = 0; i < bucket.Size() && i < count; ++i)
     {
-      return;
+      result.emplace_back(std::make_pair(bucket.GetKeyFromIndx(i), bucket.GetContactFromIndx(i)));
     }
+  }
 
-    size_t added = 0;
 
-    for (size_t i = 0; i < this->buckets[idx].Size() && added < count; ++i)
-    {
-      auto id = this->buckets[idx].GetKeyFromIndx(i);
+  ContactPtr KBuckets::EraseContact(KeyPtr key)
+  {
+    ContactPtr contact = this->leaves[FindBucket(* key)].bucket.EraseContact(key);
 
-      result.emplace_back(std::make_pair(id, this->buckets[idx].FindContact(id)));
+    if (contact)
+    {
+      -- this->size;
+      this->Changed();
     }
+
+    return contact;
   }
 
-  ContactPtr KBuckets::EraseContact(KeyPtr key)
+
+  bool KBuckets::AddContact(KeyPtr key, ContactPtr contact)
   {
-    int idx = FindBucket(* key);
+    return this->Insert(key, contact, false);
+  }
+
 
-    if (idx >= 0)
+  bool KBuckets::Insert(KeyPtr key, ContactPtr contact, bool force)
+  {
+    if (* key == * this->selfKey)
     {
-      ContactPtr contact = this->buckets[idx].EraseContact(key);
-      if (contact)
+      return false;
+    }
+
+    size_t idx = FindBucket(* key);
+
+    if (this->leaves[idx].bucket.FindContact(key))
+    {
+      return false;
+    }
+
+    while (!this->leaves[idx].bucket.AddContact(key, contact))
+    {
+      if (force ? this->leaves[idx].depth >= Key::KEY_LEN_BITS : !this->CanSplit(idx, * key))
       {
-        -- this->size;
-        return contact;
+        return false;
       }
+
+      this->Split(idx);
+
+      idx = FindBucket(* key);
     }
 
-    return nullptr;
+    ++ this->size;
+
+    this->Changed();
+
+    return true;
   }
 
 
-  bool KBuckets::AddContact(KeyPtr key, ContactPtr contact)
+  bool KBuckets::AddReplacement(KeyPtr key, ContactPtr contact)
   {
-    int idx = FindBucket(* key);
+    if (* key == * this->selfKey)
+    {
+      return false;
+    }
+
+    this->leaves[FindBucket(* key)].bucket.AddReplacement(key, contact);
+
+    return true;
+  }
+
 
-    if (idx >= 0 && this->buckets[idx].AddContact(key, contact))
+  bool KBuckets::ReplaceContact(KeyPtr key)
+  {
+    if (!this->leaves[FindBucket(* key)].bucket.ReplaceContact(key))
     {
-      ++ this->size;
-      return true;
+      return false;
     }
 
-    return false;
+    this->Changed();
+
+    return true;
   }
 
 
-  void KBuckets::GetAllContacts(std::vector<std::pair<KeyPtr, ContactPtr>> & result) const
+  bool KBuckets::BeginProbe(KeyPtr key, std::pair<KeyPtr, ContactPtr> & oldest)
   {
-    for (size_t i = 0; i < Key::KEY_LEN_BITS; ++i)
+    Bucket & bucket = this->leaves[FindBucket(* key)].bucket;
+
+    if (bucket.IsProbing() || bucket.Size() == 0)
     {
-      this->buckets[i].GetAllContacts(result);
+      return false;
     }
+
+    oldest = std::make_pair(bucket.GetKeyFromIndx(0), bucket.GetContactFromIndx(0));
+
+    bucket.SetProbe(* oldest.first);
+
+    return true;
   }
 
 
-  size_t KBuckets::GetBucketSize(KeyPtr key) const
+  void KBuckets::EndProbe(KeyPtr key, bool alive)
   {
-    int idx = FindBucket(* key);
+    Bucket & bucket = this->leaves[FindBucket(* key)].bucket;
 
-    if (idx >= 0)
+    if (bucket.IsProbing() && bucket.ProbeKey() == * key)
     {
-      return this->buckets[idx].Size();
+      bucket.ClearProbe();
     }
 
-    return 0;
+    // A contact that ignored a ping goes even without a candidate to take its place
+    if (!alive && !this->ReplaceContact(key))
+    {
+      this->EraseContact(key);
+    }
   }
 
 
-  void KBuckets::UpdateLookupTime(KeyPtr key)
+  void KBuckets::UpdateRtt(KeyPtr key, std::chrono::steady_clock::duration rtt)
   {
-    int idx = FindBucket(*key);
+    Bucket & bucket = this->leaves[FindBucket(* key)].bucket;
+
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(rtt).count();
+    uint32_t sample = micros <= 0 ? 1 : micros >= UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(micros);
 
-    if (idx < 0)
+    if (!bucket.UpdateRtt(* key, sample))
     {
       return;
     }
 
-    this->buckets[idx].UpdateLookupTime();
+    if (this->proximity && bucket.PromoteFaster(* key))
+    {
+      this->Changed();
+    }
   }
 
 
-  void KBuckets::GetRefreshTargets(const Key & base, std::chrono::steady_clock::duration expiration, std::vector<KeyPtr> & result) const
+  uint32_t KBuckets::GetRtt(const Key & key) const
+  {
+    return this->leaves[FindBucket(key)].bucket.GetRtt(key);
+  }
+
+
+  void KBuckets::GetAllContacts(std::vector<std::pair<KeyPtr, ContactPtr>> & result) const
+  {
+    for (const auto & leaf : this->leaves)
+    {
+      leaf.bucket.GetAllContacts(result);
+    }
+  }
+
+
+  void KBuckets::GetRecords(std::vector<RoutingTableFile::Record> & result) const
   {
     auto now = std::chrono::steady_clock::now();
+    auto wallNow = std::chrono::system_clock::now();
 
-    for (size_t i = 0; i < Key::KEY_LEN_BITS; ++i)
+    result.reserve(result.size() + this->size);
+
+    for (const auto & leaf : this->leaves)
     {
-      if (now - this->buckets[i].LastLookupTime() > expiration)
+      const Bucket & bucket = leaf.bucket;
+
+      for (size_t i = 0; i < bucket.Size(); ++i)
       {
-        Key mask = {};
+        RoutingTableFile::Record record;
 
-        mask.SetBit(i, true);
+        record.key = bucket.Keys()[i];
+        record.contact = * bucket.GetContactFromIndx(i);
+        record.rtt = bucket.GetRttFromIndx(i);
 
-        // a ^ b = c => a ^ c = b
+        auto seen = wallNow - std::chrono::duration_cast<std::chrono::system_clock::duration>(now - bucket.GetLastSeenFromIndx(i));
+        record.lastSeen = std::chrono::duration_cast<std::chrono::seconds>(seen.time_since_epoch()).count();
 
-        result.emplace_back(std::make_shared<Key>(base.GetDistance(mask)));
+        result.emplace_back(record);
       }
     }
   }
 
 
-  size_t KBuckets::GetCloserContactCount(const Key & key) const
+  bool KBuckets::AddRecord(const RoutingTableFile::Record & record)
   {
-    size_t result = 0;
-
-    int idx = FindBucket(key);
+    auto key = std::make_shared<Key>(record.key);
 
-    if (idx < 0)
+    // The saved buckets all fit, so splitting wherever one overflows brings back every
+    // contact whatever order the relaxed splits happened in
+    if (!this->Insert(key, std::make_shared<Contact>(record.contact), true))
     {
-      return result;
+      return false;
     }
 
-    for (int i = 0; i < idx; ++i)
+    auto now = std::chrono::steady_clock::now();
+    auto wallNow = std::chrono::system_clock::now();
+    auto seen = std::chrono::system_clock::time_point(std::chrono::seconds(record.lastSeen));
+
+    // A record from the future, after the clock was set back, counts as seen now
+    auto age = seen < wallNow ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(wallNow - seen) : std::chrono::steady_clock::duration::zero();
+
+    this->leaves[FindBucket(record.key)].bucket.SetHistory(record.key, now - std::min(age, now.time_since_epoch()), record.rtt);
+
+    return true;
+  }
+
+
+  size_t KBuckets::GetBucketSize(KeyPtr key) const
+  {
+    return this->leaves[FindBucket(* key)].bucket.Size();
+  }
+
+
+  void KBuckets::UpdateLookupTime(KeyPtr key)
+  {
+    this->leaves[FindBucket(* key)].bucket.UpdateLookupTime();
+  }
+
+
+  std::chrono::steady_clock::time_point KBuckets::LastLookupTime(KeyPtr key) const
+  {
+    return this->leaves[FindBucket(* key)].bucket.LastLookupTime();
+  }
+
+
+  void KBuckets::GetRefreshTargets(const Key & base, std::chrono::steady_clock::duration expiration, std::vector<KeyPtr> & result) const
+  {
+    auto now = std::chrono::steady_clock::now();
+
+    for (const auto & leaf : this->leaves)
     {
-      result += this->buckets[i].Size();
+      if (now - leaf.bucket.LastLookupTime() > expiration)
+      {
+        Key target = base;
+
+        for (size_t i = 0; i < leaf.depth; ++i)
+        {
+          size_t bit = Key::KEY_LEN_BITS - 1 - i;
+          target.SetBit(bit, leaf.prefix.Bit(bit));
+        }
+
+        // Flip the first open bit so the bucket holding base is not refreshed with base
+        if (leaf.depth < Key::KEY_LEN_BITS)
+        {
+          size_t bit = Key::KEY_LEN_BITS - 1 - leaf.depth;
+          target.SetBit(bit, !target.Bit(bit));
+        }
+
+        result.emplace_back(std::make_shared<Key>(target));
+      }
     }
+  }
 
-    std::vector<std::pair<KeyPtr, ContactPtr>> contacts;
-    this->buckets[idx].GetAllContacts(contacts);
+
+  size_t KBuckets::GetCloserContactCount(const Key & key) const
+  {
+    size_t result = 0;
 
     Key distance = this->selfKey->GetDistance(key);
+    size_t idx = FindBucket(key);
 
-    for (const auto & contact : contacts)
+    for (size_t i = 0; i < this->leaves.size(); ++i)
     {
-      if (this->selfKey->GetDistance(*contact.first) < distance)
+      const Leaf & leaf = this->leaves[i];
+
+      if (i != idx)
+      {
+        // Key lies outside the bucket, so the bits the bucket fixes decide
+        if (Prefix(this->selfKey->GetDistance(leaf.prefix), leaf.depth) < distance)
+        {
+          result += leaf.bucket.Size();
+        }
+
+        continue;
+      }
+
+      for (size_t j = 0; j < leaf.bucket.Size(); ++j)
       {
-        ++ result;
+        if (this->selfKey->GetDistance(leaf.bucket.Keys()[j]) < distance)
+        {
+          ++ result;
+        }
       }
     }
 
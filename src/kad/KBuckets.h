@@ -27,58 +27,159 @@
 
 #pragma once
 
+#include <functional>
 #include <vector>
 #include <chrono>
 #include "Bucket.h"
+#include "RoutingSnapshot.h"
+#include "RoutingTableFile.h"
 
 namespace kad
 {
+  // The routing table as a binary tree of buckets, as in the Kademlia paper. It starts
+  // as one bucket covering every id; a full bucket that covers our own id splits in two
+  // on the next bit, so the table holds more contacts the closer they are to us. In
+  // relaxed mode a full bucket also splits when the new contact would be among the SizeK
+  // closest we know, which keeps the whole neighbourhood even where the tree is uneven.
+  // With proximity, a full bucket also trades its slowest contact for a candidate that
+  // answers in under half the time.
+  // The table itself belongs to one thread; other threads read its published snapshot.
   class KBuckets
   {
   public:
 
-    static const size_t SizeK = 20;
+    static const size_t SizeK = Bucket::Capacity;
 
   public:
 
-    explicit KBuckets(KeyPtr selfKey);
+    explicit KBuckets(KeyPtr selfKey, bool relaxed = false, bool proximity = false);
 
     ContactPtr FindContact(KeyPtr key);
 
+    // Appends the SizeK contacts closest to key by XOR distance, closest first. With
+    // restrictBucket only key's own bucket is searched. Publishes pending changes first.
     void FindClosestContacts(KeyPtr key, std::vector<std::pair<KeyPtr, ContactPtr>> & result, bool restrictBucket = false);
 
     ContactPtr UpdateContact(KeyPtr key);
 
+    // Gives a known contact a new address. The old Contact is left as it is, since the
+    // snapshot may share it.
+    bool SetContact(KeyPtr key, ContactPtr contact);
+
     void GetOldContacts(KeyPtr key, size_t count, std::vector<std::pair<KeyPtr, ContactPtr>> & result);
 
     ContactPtr EraseContact(KeyPtr key);
 
+    // Splits key's bucket as needed. Fails for our own id, a known key, or a full bucket
+    // that may not split; the caller then checks on the oldest contact there.
     bool AddContact(KeyPtr key, ContactPtr contact);
 
+    // Keeps a sender AddContact turned away as a candidate for its bucket
+    bool AddReplacement(KeyPtr key, ContactPtr contact);
+
+    // Swaps a contact that failed an RPC for the freshest candidate of its bucket. Without
+    // a candidate the contact stays, as one failure may be a lost packet.
+    bool ReplaceContact(KeyPtr key);
+
+    // Hands out the least recently seen contact of key's bucket to be pinged. Fails while
+    // a ping of that bucket is in flight, so a busy full bucket sees one at a time.
+    bool BeginProbe(KeyPtr key, std::pair<KeyPtr, ContactPtr> & oldest);
+
+    // Ends the ping of a contact from BeginProbe; one that did not answer is replaced
+    void EndProbe(KeyPtr key, bool alive);
+
+    // Records a round trip measured to a contact or candidate
+    void UpdateRtt(KeyPtr key, std::chrono::steady_clock::duration rtt);
+
+    // The smoothed round trip to a contact in microseconds, 0 when unknown
+    uint32_t GetRtt(const Key & key) const;
+
     void GetAllContacts(std::vector<std::pair<KeyPtr, ContactPtr>> & result) const;
 
+    // Every contact with its round trip and when it was last seen, bucket by bucket in
+    // LRU order, so adding them back in order rebuilds the same buckets
+    void GetRecords(std::vector<RoutingTableFile::Record> & result) const;
+
+    // AddContact for a saved record, keeping its round trip and last seen time
+    bool AddRecord(const RoutingTableFile::Record & record);
+
+    // Whether the contacts changed since MarkSaved
+    bool IsModified() const     { return this->modified; }
+
+    void MarkSaved()            { this->modified = false; }
+
     void UpdateLookupTime(KeyPtr key);
 
+    std::chrono::steady_clock::time_point LastLookupTime(KeyPtr key) const;
+
+    // One target inside each bucket not looked up within expiration, taking the bits the
+    // bucket leaves open from base
     void GetRefreshTargets(const Key & base, std::chrono::steady_clock::duration expiration, std::vector<KeyPtr> & result) const;
 
     size_t GetCloserContactCount(const Key & key) const;
 
     size_t GetBucketSize(KeyPtr key) const;
 
-    size_t Size() const       { return this->size; }
+    // Called when the contacts first differ from the published snapshot, so the owner can
+    // arrange for a Publish that covers every change made until then
+    void SetOnChangeHandler(std::function<void()> onChange)    { this->onChange = onChange; }
+
+    // Replaces the snapshot if the contacts changed since the last one
+    void Publish();
+
+    // Safe to call from any thread
+    RoutingSnapshotPtr Snapshot() const     { return std::atomic_load(& this->snapshot); }
 
-    KeyPtr SelfKey() const    { return this->selfKey; }
+    size_t Size() const         { return this->size; }
+
+    size_t BucketCount() const  { return this->leaves.size(); }
+
+    KeyPtr SelfKey() const      { return this->selfKey; }
 
   private:
 
-    int FindBucket(const Key & key) const;
+    // A bucket holding the ids whose first depth bits are those of prefix; the bits of
+    // prefix below that are clear
+    struct Leaf
+    {
+      Key prefix;
+      size_t depth = 0;
+      Bucket bucket;
+    };
+
+    // key with every bit below the first depth cleared
+    static Key Prefix(const Key & key, size_t depth);
+
+    size_t FindBucket(const Key & key) const;
+
+    bool CanSplit(size_t idx, const Key & key) const;
+
+    void Split(size_t idx);
+
+    // AddContact; with force a full bucket splits whenever it has a bit left to split on
+    bool Insert(KeyPtr key, ContactPtr contact, bool force);
+
+    void Changed();
 
   private:
 
-    Bucket buckets[Key::KEY_LEN_BITS] = {};
+    // Ordered by prefix, so together they cover the id space in order
+    std::vector<Leaf> leaves;
 
     size_t size = 0;
 
     KeyPtr selfKey;
+
+    bool relaxed;
+
+    bool proximity;
+
+    RoutingSnapshotPtr snapshot = std::make_shared<RoutingSnapshot>();
+
+    bool dirty = false;
+
+    bool modified = false;
+
+    std::function<void()> onChange;
   };
 }
@@ -26,10 +26,15 @@
  */
 
 #include <assert.h>
+#include <algorithm>
+#include <map>
+#include <random>
 #include "protocol/Protocol.h"
 #include "EventLoop.h"
 #include "KBuckets.h"
+#include "RoutingTableFile.h"
 #include "Thread.h"
+#include "ThreadPool.h"
 #include "PackageDispatcher.h"
 #include "FindNodeAction.h"
 #include "FindValueAction.h"
@@ -53,10 +58,18 @@ namespace kad
   Kademlia::Kademlia()
     : kBuckets(nullptr)
   {
-    this->kBuckets = std::unique_ptr<KBuckets>(new KBuckets(Config::NodeId()));
+    this->kBuckets = std::unique_ptr<KBuckets>(new KBuckets(Config::NodeId(), Config::RelaxedRouting(), Config::ProximityRouting()));
 
     this->thread = std::unique_ptr<Thread>(new Thread("Main"));
 
+    // The changes made before Main gets to this go out in one snapshot
+    this->kBuckets->SetOnChangeHandler([this]()
+    {
+      this->thread->BeginInvoke([this](void *, void *) { this->kBuckets->Publish(); }, nullptr, nullptr, "Kademlia::PublishBuckets");
+    });
+
+    this->pool = std::unique_ptr<ThreadPool>(new ThreadPool(Config::ComputeThreads(), "Compute"));
+
     this->dispatcher = std::unique_ptr<PackageDispatcher>(new PackageDispatcher(this->thread.get()));
 
     using namespace std::placeholders;
@@ -65,7 +78,12 @@ namespace kad
 
     this->dispatcher->SetContactHandler(std::bind(&Kademlia::OnMessage, this, _1, _2));
 
-    this->refreshTimer = std::unique_ptr<Timer>(new Timer());
+    if (Config::ProximityRouting())
+    {
+      this->dispatcher->SetRoundTripHandler(std::bind(&Kademlia::OnRoundTrip, this, _1, _2));
+    }
+
+    this->refreshTimer = std::unique_ptr<Timer>(new Timer("RefreshTimer"));
   }
 
   Kademlia::~Kademlia()
@@ -100,91 +118,66 @@ namespace kad
       return;
     }
 
-    auto result = AsyncResultPtr(new AsyncResult<std::vector<std::pair<KeyPtr, ContactPtr>>>());
+    // Look ourselves up, then ping what we learnt about, a few at a time, and drop
+    // whoever does not answer.
+    this->FindNodeAsync(Config::NodeId()).Then(
+      [this](const std::vector<std::pair<KeyPtr, ContactPtr>> & nodes)
+      {
+        return WhenAllLimited<bool>(nodes.size(), Config::Parallelism(),
+          [this, nodes](size_t i)
+          {
+            auto key = nodes[i].first;
 
-    this->FindNode(Config::NodeId(), result,
-      [this](AsyncResultPtr result)
+            return this->PingAsync(nodes[i].second).Then(
+              [this, key](bool alive)
+              {
+                if (!alive)
+                {
+                  // Mark the node as unreachable
+                  this->kBuckets->EraseContact(key);
+                }
+
+                return alive;
+              }
+            );
+          },
+          this->thread.get()
+        );
+      }
+    ).Then(
+      [this](const std::vector<bool> &)
       {
-        auto rtn = dynamic_cast<AsyncResult<std::vector<std::pair<KeyPtr, ContactPtr>>> *>(result.get());
-        if (rtn && rtn->GetResult().size() > 0)
-        {
-          this->OnInitPing(
-            new std::vector<std::pair<KeyPtr, ContactPtr>>(std::move(rtn->GetResult())),
-            new std::set<KeyPtr, KeyCompare>(),
-            new std::set<KeyPtr, KeyCompare>()
-          );
-        }
-        else
-        {
-          this->OnInitialized();
-        }
+        this->OnInitialized();
       }
     );
   }
 
 
-  void Kademlia::OnInitPing(const std::vector<std::pair<KeyPtr, ContactPtr>> * targets, std::set<KeyPtr, KeyCompare> * validating, std::set<KeyPtr, KeyCompare> * validated)
+  void Kademlia::OnInitialized()
   {
-    THREAD_ENSURE(this->thread.get(), OnInitPing, targets, validating, validated);
-
-    for (const auto & node : (*targets))
-    {
-      if (validating->size() >= Config::Parallelism())
-      {
-        break;
-      }
-
-      if (validated->find(node.first) == validated->end() && validating->find(node.first) == validating->end())
-      {
-        auto result = AsyncResultPtr(new AsyncResult<bool>());
-
-        auto key = node.first;
-
-        validating->emplace(key);
-
-        this->Ping(node.second, result,
-          [this, key, targets, validating, validated](AsyncResultPtr result)
-          {
-            validating->erase(key);
+    this->ready = true;
 
-            validated->emplace(key);
+    this->ScheduleRefresh();
+  }
 
-            auto rtn = dynamic_cast<AsyncResult<bool> *>(result.get());
 
-            if (!rtn || !rtn->GetResult())
-            {
-              // Mark the node as unreachable
-              this->kBuckets->EraseContact(key);
-            }
+  void Kademlia::ScheduleRefresh()
+  {
+    static thread_local std::mt19937 rng(std::random_device{}());
 
-            if (validated->size() < targets->size())
-            {
-              this->OnInitPing(targets, validating, validated);
-            }
-            else
-            {
-              delete targets;
-              delete validating;
-              delete validated;
+    int interval = Config::RefreshTimerInterval();
+    int jitter = std::min(Config::RefreshJitter(), interval / 2);
 
-              this->OnInitialized();
-            }
-          }
-        );
-      }
+    if (jitter > 0)
+    {
+      interval += std::uniform_int_distribution<int>(-jitter, jitter)(rng);
     }
-  }
-
-
-  void Kademlia::OnInitialized()
-  {
-    this->ready = true;
 
     using namespace std::placeholders;
 
     this->refreshTimer->Reset(
-      Config::RefreshTimerInterval(),
-      true,
+      interval,
+      false,
       std::bind(&Kademlia::OnRefreshTimer, this, _1, _2),
       this,
       nullptr,
@@ -197,105 +190,184 @@ namespace kad
   {
     THREAD_ENSURE(this->thread.get(), OnRefreshTimer, sender, args);
 
-    auto targets = std::make_shared<std::vector<KeyPtr>>();
+    this->ScheduleRefresh();
+
+    if (this->refreshing)
+    {
+      return;
+    }
+
+    auto cycle = std::make_shared<RefreshCycle>();
 
-    this->kBuckets->GetRefreshTargets(*(Config::NodeId()), std::chrono::milliseconds(Config::RefreshInterval()), *targets);
+    cycle->start = std::chrono::steady_clock::now();
 
-    this->OnRefresh(targets, 0);
+    this->kBuckets->GetRefreshTargets(*(Config::NodeId()), std::chrono::milliseconds(Config::RefreshInterval()), cycle->targets);
+
+    // The others were looked up within the refresh interval
+    cycle->skipped = this->kBuckets->BucketCount() - cycle->targets.size();
+
+    this->refreshing = true;
+
+    this->OnRefresh(cycle);
   }
 
 
-  void Kademlia::OnRefresh(std::shared_ptr<std::vector<KeyPtr>> targets, size_t idx)
+  void Kademlia::OnRefresh(std::shared_ptr<RefreshCycle> cycle)
   {
-    if (idx < targets->size())
-    {
-      this->FindNode((*targets)[idx], nullptr,
-        [this, targets, idx](AsyncResultPtr)
+    using Nodes = std::vector<std::pair<KeyPtr, ContactPtr>>;
+
+    // Look up a few stale buckets at a time, then replicate the data nobody asked for
+    WhenAllLimited<bool>(cycle->targets.size(), Config::RefreshParallelism(),
+      [this, cycle](size_t i)
+      {
+        KeyPtr target = cycle->targets[i];
+
+        // Lookup traffic may have covered the bucket while it waited for a slot
+        if (this->kBuckets->LastLookupTime(target) >= cycle->start)
         {
-          this->OnRefresh(targets, idx + 1);
-        },
-        true
-      );
-    }
-    else
+          ++ cycle->skipped;
+          return Task<bool>::FromResult(true, this->thread.get());
+        }
+
+        ++ cycle->lookups;
+
+        return this->FindNodeAsync(target, true).Then([](const Nodes &) {});
+      },
+      this->thread.get()
+    ).Then(
+      [this, cycle](const std::vector<bool> &)
+      {
+        this->OnRefreshCompleted(cycle);
+
+        // Refresh bucket completes. Now start to replicate old data
+        auto targets = std::make_shared<std::vector<KeyPtr>>();
+
+        // Remove expired persistent data since we do not need to replicate those
+        Storage::Persist()->Invalidate();
+
+        Storage::Persist()->GetIdleKeys(*targets, Config::ReplicateTTL());
+
+        return this->Replicate(targets, 0);
+      }
+    ).Then(
+      [](bool)
+      {
+        // Replicate completes. Clean up expired cache
+        Storage::Cache()->Invalidate();
+      }
+    );
+  }
+
+
+  void Kademlia::OnRefreshCompleted(std::shared_ptr<RefreshCycle> cycle)
+  {
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - cycle->start);
+
+    ++ this->refreshStats.cycles;
+    this->refreshStats.lastLookups = cycle->lookups;
+    this->refreshStats.lastSkipped = cycle->skipped;
+    this->refreshStats.lastDuration = duration;
+    this->refreshStats.maxDuration = std::max(this->refreshStats.maxDuration, duration);
+
+    if (Config::Verbose())
     {
-      // Refresh bucket completes. Now start to replicate old data
-      targets->clear();
+      printf("[REFRESH] lookups=%zu skipped=%zu duration=%lldms\n", cycle->lookups, cycle->skipped, static_cast<long long>(duration.count()));
+    }
 
-      // Remove expired persistent data since we do not need to replicate those
-      Storage::Persist()->Invalidate();
+    this->refreshing = false;
 
-      Storage::Persist()->GetIdleKeys(*targets, Config::ReplicateTTL());
+    SaveBuckets();
+  }
 
-      this->OnReplicate(targets, 0);
 
-      SaveBuckets();
+  Kademlia::RefreshStats Kademlia::GetRefreshStats() const
+  {
+    if (this->thread.get() != Thread::Current())
+    {
+      RefreshStats result;
+      this->thread->Invoke([this, &result](void *, void *) { result = this->refreshStats; });
+      return result;
     }
+
+    return this->refreshStats;
   }
 
 
-  void Kademlia::OnReplicate(std::shared_ptr<std::vector<KeyPtr>> targets, size_t idx)
+  Task<bool> Kademlia::Replicate(std::shared_ptr<std::vector<KeyPtr>> targets, size_t idx)
   {
-    if (idx < targets->size())
+    if (idx >= targets->size())
     {
-      bool async = false;
+      return Task<bool>::FromResult(true, this->thread.get());
+    }
+
+    // Replicate a window of keys at a time. Each contact gets one batch with the
+    // STOREs of every key in the window it is among the closest nodes for.
+    size_t end = std::min(targets->size(), idx + protocol::Batch::MAX_ITEMS);
 
-      auto key = (*targets)[idx];
+    std::vector<Task<PackagePtr>> responses;
+
+    std::map<std::pair<unsigned long, unsigned short>, std::vector<std::pair<PackagePtr, PackageDispatcher::PackageHandler>>> batches;
+
+    for (size_t i = idx; i < end; ++i)
+    {
+      auto key = (*targets)[i];
 
       auto buffer = Storage::Persist()->Load(key);
 
       Storage::Persist()->UpdateTimestamp(key);
 
-      if (buffer)
+      uint64_t version;
+      int64_t ttl;
+
+      if (!buffer || !Storage::Persist()->GetVersion(key, &version) || !Storage::Persist()->GetTTL(key, &ttl))
       {
-        std::vector<std::pair<KeyPtr, ContactPtr>> nodes;
+        continue;
+      }
 
-        this->kBuckets->FindClosestContacts(key, nodes, true);
+      std::vector<std::pair<KeyPtr, ContactPtr>> nodes;
 
-        if (nodes.size() > 0)
-        {
-          auto store = std::unique_ptr<StoreAction>(new StoreAction(this->thread.get(), this->dispatcher.get()));
+      this->kBuckets->FindClosestContacts(key, nodes, true);
 
-          uint64_t version;
-          int64_t ttl;
-          if (Storage::Persist()->GetVersion(key, &version) && Storage::Persist()->GetTTL(key, &ttl))
-          {
-            store->Initialize(nodes, key, version, buffer, ttl, false);
+      for (const auto & node : nodes)
+      {
+        protocol::Store * instr = new protocol::Store();
 
-            store->SetOnCompleteHandler(
-              [this, targets, idx](void * sender, void * args)
-              {
-                this->OnReplicate(targets, idx + 1);
-              },
-              this
-            );
+        instr->SetKey(key);
+        instr->SetVersion(version);
+        instr->SetData(buffer);
+        instr->SetTTL(ttl);
+        instr->SetOriginal(false);
 
-            if (store->Start())
-            {
-              store.release();
-            }
+        auto package = std::make_shared<Package>(Package::PackageType::Request, Config::NodeId(), node.second, InstructionPtr(instr));
 
-            async = true;
-          }
-        }
-      }
+        Task<PackagePtr> response(this->thread.get());
 
-      if (!async)
-      {
-        this->OnReplicate(targets, idx + 1);
+        batches[std::make_pair(node.second->addr, node.second->port)].emplace_back(package,
+          [response](PackagePtr, PackagePtr reply) { response.Complete(reply); });
+
+        responses.emplace_back(response);
       }
     }
-    else
+
+    for (auto & batch : batches)
     {
-      // Replicate completes. Clean up expired cache
-      Storage::Cache()->Invalidate();
+      this->dispatcher->SendBatch(std::move(batch.second));
     }
+
+    // The next window goes out once every STORE of this one was answered or timed out
+    return WhenAll(responses, this->thread.get()).Then(
+      [this, targets, end](const std::vector<PackagePtr> &)
+      {
+        return this->Replicate(targets, end);
+      }
+    );
   }
 
 
+
   void Kademlia::FindNode(KeyPtr target, AsyncResultPtr result, CompleteHandler handler, bool restrictBucket)
   {
-    THREAD_ENSURE(this->thread.get(), FindNode, target, result, handler);
+    THREAD_ENSURE(this->thread.get(), FindNode, target, result, handler, restrictBucket);
 
     std::vector<std::pair<KeyPtr, ContactPtr>> nodes;
 
@@ -320,6 +392,8 @@ namespace kad
 
     auto action = std::unique_ptr<FindNodeAction>(new FindNodeAction(this->thread.get(), this->dispatcher.get()));
 
+    this->ConfigureAction(action.get());
+
     action->Initialize(target, nodes);
 
     action->SetOnCompleteHandler(
@@ -401,6 +475,8 @@ namespace kad
 
     auto action = std::unique_ptr<FindValueAction>(new FindValueAction(this->thread.get(), this->dispatcher.get()));
 
+    this->ConfigureAction(action.get());
+
     action->Initialize(target, nodes);
 
     action->SetOnCompleteHandler(
@@ -457,6 +533,120 @@ namespace kad
   }
 
 
+  void Kademlia::FindValues(std::vector<KeyPtr> targets, AsyncResultPtr result, CompleteHandler handler)
+  {
+    THREAD_ENSURE(this->thread.get(), FindValues, targets, result, handler);
+
+    if (!this->ready)
+    {
+      return;
+    }
+
+    struct Context
+    {
+      std::vector<BufferPtr> values;
+      size_t pending;
+    };
+
+    auto context = std::make_shared<Context>();
+    context->values.resize(targets.size());
+    context->pending = targets.size() + 1;
+
+    auto complete = [context, result, handler](size_t idx, BufferPtr value)
+    {
+      if (idx < context->values.size())
+      {
+        context->values[idx] = value;
+      }
+
+      if (--context->pending > 0)
+      {
+        return;
+      }
+
+      auto rtn = dynamic_cast<AsyncResult<std::vector<BufferPtr>> *>(result.get());
+      if (rtn)
+      {
+        rtn->Complete(std::move(context->values));
+      }
+      else if (result)
+      {
+        result->Complete();
+      }
+
+      if (handler)
+      {
+        handler(result);
+      }
+    };
+
+    // Ask the closest known contact of each key first, one batch per contact. Keys
+    // it does not hold go through the regular lookup.
+    std::map<std::pair<unsigned long, unsigned short>, std::vector<std::pair<PackagePtr, PackageDispatcher::PackageHandler>>> batches;
+
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+      auto target = targets[i];
+
+      auto buffer = Storage::Persist()->Load(target);
+      if (!buffer)
+      {
+        buffer = Storage::Cache()->Load(target);
+      }
+
+      std::vector<std::pair<KeyPtr, ContactPtr>> nodes;
+
+      if (!buffer)
+      {
+        this->kBuckets->FindClosestContacts(target, nodes);
+      }
+
+      if (nodes.empty())
+      {
+        complete(i, buffer);
+        continue;
+      }
+
+      this->kBuckets->UpdateLookupTime(target);
+
+      auto closest = std::min_element(nodes.begin(), nodes.end(),
+        [& target](const std::pair<KeyPtr, ContactPtr> & lhs, const std::pair<KeyPtr, ContactPtr> & rhs)
+        {
+          return lhs.first->GetDistance(* target) < rhs.first->GetDistance(* target);
+        });
+
+      protocol::FindValue * instr = new protocol::FindValue();
+
+      instr->SetKey(target);
+
+      auto package = std::make_shared<Package>(Package::PackageType::Request, Config::NodeId(), closest->second, InstructionPtr(instr));
+
+      auto onResponse = [this, complete, i, target](PackagePtr, PackagePtr response)
+      {
+        if (response && response->GetInstruction()->Code() == OpCode::FIND_VALUE_RESPONSE)
+        {
+          complete(i, static_cast<protocol::FindValueResponse *>(response->GetInstruction())->Data());
+          return;
+        }
+
+        auto rtn = std::make_shared<AsyncResult<BufferPtr>>();
+
+        this->FindValue(target, rtn, [complete, i, rtn](AsyncResultPtr) { complete(i, rtn->GetResult()); });
+      };
+
+      batches[std::make_pair(closest->second->addr, closest->second->port)].emplace_back(package, onResponse);
+    }
+
+    for (auto & batch : batches)
+    {
+      this->dispatcher->SendBatch(std::move(batch.second));
+    }
+
+    // Drops the reference that kept the result from completing while batches were built
+    complete(targets.size(), nullptr);
+  }
+
+
   void Kademlia::Query(KeyPtr target, std::string query, uint32_t limit, AsyncResultPtr result, CompleteHandler handler)
   {
     THREAD_ENSURE(this->thread.get(), Query, target, query, limit, result, handler);
@@ -477,7 +667,7 @@ namespace kad
       char* data = (char*)buffer->Data();
 
       Json::Reader reader;
-      if (reader.parse(data, buffer->Size(), root, false) && root.isArray())
+      if (reader.parse(data, data + buffer->Size(), root, false) && root.isArray())
       {
         completed = root.size() >= limit;
       }
@@ -511,6 +701,8 @@ namespace kad
 
     auto action = std::unique_ptr<QueryAction>(new QueryAction(this->thread.get(), this->dispatcher.get()));
 
+    this->ConfigureAction(action.get());
+
     action->Initialize(target, query, nodes);
 
     action->root = root;
@@ -606,6 +798,8 @@ namespace kad
 
     auto action = std::unique_ptr<QueryLogAction>(new QueryLogAction(this->thread.get(), this->dispatcher.get()));
 
+    this->ConfigureAction(action.get());
+
     action->Initialize(target, query, nodes);
 
     action->SetOnCompleteHandler(
@@ -925,6 +1119,89 @@ namespace kad
   }
 
 
+  template<typename T>
+  static Task<T> MakeTask(Thread * owner, std::function<void(AsyncResultPtr, Kademlia::CompleteHandler)> start)
+  {
+    Task<T> task(owner);
+
+    auto result = std::make_shared<AsyncResult<T>>();
+
+    start(result, [task, result](AsyncResultPtr) { task.Complete(result->GetResult()); });
+
+    return task;
+  }
+
+
+  Task<bool> Kademlia::StoreAsync(KeyPtr hash, BufferPtr data, uint32_t ttl, uint64_t version)
+  {
+    return MakeTask<bool>(this->thread.get(),
+      [=](AsyncResultPtr result, CompleteHandler handler) { this->Store(hash, data, ttl, version, result, handler); });
+  }
+
+
+  Task<bool> Kademlia::PublishAsync(KeyPtr hash, BufferPtr data, uint32_t ttl, uint64_t version)
+  {
+    return MakeTask<bool>(this->thread.get(),
+      [=](AsyncResultPtr result, CompleteHandler handler) { this->Publish(hash, data, ttl, version, result, handler); });
+  }
+
+
+  Task<bool> Kademlia::StoreLogAsync(KeyPtr hash, BufferPtr data, uint32_t ttl, uint64_t version)
+  {
+    return MakeTask<bool>(this->thread.get(),
+      [=](AsyncResultPtr result, CompleteHandler handler) { this->StoreLog(hash, data, ttl, version, result, handler); });
+  }
+
+
+  Task<std::vector<std::pair<KeyPtr, ContactPtr>>> Kademlia::FindNodeAsync(KeyPtr target, bool restrictBucket)
+  {
+    return MakeTask<std::vector<std::pair<KeyPtr, ContactPtr>>>(this->thread.get(),
+      [=](AsyncResultPtr result, CompleteHandler handler) { this->FindNode(target, result, handler, restrictBucket); });
+  }
+
+
+  Task<BufferPtr> Kademlia::FindValueAsync(KeyPtr target)
+  {
+    return MakeTask<BufferPtr>(this->thread.get(),
+      [=](AsyncResultPtr result, CompleteHandler handler) { this->FindValue(target, result, handler); });
+  }
+
+
+  Task<std::vector<BufferPtr>> Kademlia::FindValuesAsync(std::vector<KeyPtr> targets)
+  {
+    return MakeTask<std::vector<BufferPtr>>(this->thread.get(),
+      [=](AsyncResultPtr result, CompleteHandler handler) { this->FindValues(targets, result, handler); });
+  }
+
+
+  Task<BufferPtr> Kademlia::QueryAsync(KeyPtr target, std::string query, uint32_t limit)
+  {
+    return MakeTask<BufferPtr>(this->thread.get(),
+      [=](AsyncResultPtr result, CompleteHandler handler) { this->Query(target, query, limit, result, handler); });
+  }
+
+
+  Task<BufferPtr> Kademlia::QueryLogsAsync(KeyPtr target, std::string query, uint32_t limit)
+  {
+    return MakeTask<BufferPtr>(this->thread.get(),
+      [=](AsyncResultPtr result, CompleteHandler handler) { this->QueryLogs(target, query, limit, result, handler); });
+  }
+
+
+  Task<bool> Kademlia::PingAsync(ContactPtr target)
+  {
+    return MakeTask<bool>(this->thread.get(),
+      [=](AsyncResultPtr result, CompleteHandler handler) { this->Ping(target, result, handler); });
+  }
+
+
+  Task<bool> Kademlia::PingAsync(KeyPtr target)
+  {
+    return MakeTask<bool>(this->thread.get(),
+      [=](AsyncResultPtr result, CompleteHandler handler) { this->Ping(target, result, handler); });
+  }
+
+
   void Kademlia::OnMessage(KeyPtr fromKey, ContactPtr fromContact)
   {
     THREAD_ENSURE(this->thread.get(), OnMessage, fromKey, fromContact);
@@ -933,30 +1210,32 @@ namespace kad
 
     if (origin)
     {
-      *origin = *fromContact;
+      if (origin->addr != fromContact->addr || origin->port != fromContact->port)
+      {
+        this->kBuckets->SetContact(fromKey, fromContact);
+      }
     }
     else
     {
-      if (this->kBuckets->GetBucketSize(fromKey) < KBuckets::SizeK)
-      {
-        this->kBuckets->AddContact(fromKey, fromContact);
-      }
-      else
+      // Fails when the bucket is full and may not split. The sender then waits in the
+      // replacement cache while the oldest contact is checked on, unless that is already
+      // under way.
+      if (!this->kBuckets->AddContact(fromKey, fromContact) && this->kBuckets->AddReplacement(fromKey, fromContact))
       {
-        std::vector<std::pair<KeyPtr, ContactPtr>> nodes;
-        this->kBuckets->GetOldContacts(fromKey, 1, nodes);
+        std::pair<KeyPtr, ContactPtr> oldest;
+
+        if (!this->kBuckets->BeginProbe(fromKey, oldest))
+        {
+          return;
+        }
 
-        auto oldKey = nodes[0].first;
+        auto oldKey = oldest.first;
         auto result = AsyncResultPtr(new AsyncResult<bool>());
 
-        this->Ping(nodes[0].second, result,
-          [this, oldKey, fromKey, fromContact, result](AsyncResultPtr)
+        this->Ping(oldest.second, result,
+          [this, oldKey, result](AsyncResultPtr)
           {
-            if (!AsyncResultHelper::GetResult<bool>(result.get()))
-            {
-              this->kBuckets->EraseContact(oldKey);
-              this->kBuckets->AddContact(fromKey, fromContact);
-            }
+            this->kBuckets->EndProbe(oldKey, AsyncResultHelper::GetResult<bool>(result.get()));
           }
         );
       }
@@ -964,10 +1243,44 @@ namespace kad
   }
 
 
+  void Kademlia::ConfigureAction(Action * action)
+  {
+    action->SetOnFailureHandler([this](KeyPtr key) { this->OnContactFailed(key); });
+
+    if (Config::ProximityRouting())
+    {
+      action->SetRttEstimator([this](const Key & key) { return this->kBuckets->GetRtt(key); });
+    }
+  }
+
+
+  void Kademlia::OnContactFailed(KeyPtr key)
+  {
+    THREAD_ENSURE(this->thread.get(), OnContactFailed, key);
+
+    this->kBuckets->ReplaceContact(key);
+  }
+
+
+  void Kademlia::OnRoundTrip(KeyPtr key, std::chrono::steady_clock::duration rtt)
+  {
+    THREAD_ENSURE(this->thread.get(), OnRoundTrip, key, rtt);
+
+    this->kBuckets->UpdateRtt(key, rtt);
+  }
+
+
   void Kademlia::OnRequest(ContactPtr from, PackagePtr request)
   {
-    THREAD_ENSURE(this->thread.get(), OnRequest, from, request);
+    // FIND_NODE only reads the routing table, so it is answered from the snapshot on the
+    // thread that received it instead of waiting its turn on Main
+    if (request->GetInstruction()->Code() == OpCode::FIND_NODE)
+    {
+      this->OnRequestFindNode(from, request);
+      return;
+    }
 
+    THREAD_ENSURE(this->thread.get(), OnRequest, from, request);
 
     Instruction * instr = request->GetInstruction();
 
@@ -1015,6 +1328,12 @@ namespace kad
         break;
       }
 
+      case OpCode::BATCH:
+      {
+        this->OnRequestBatch(from, request);
+        break;
+      }
+
       default:
         printf("Unknown instruction received: code=%u\n", static_cast<unsigned>(instr->Code()));
         break;
@@ -1024,203 +1343,341 @@ namespace kad
 
   void Kademlia::OnRequestPing(ContactPtr from, PackagePtr request)
   {
-    this->dispatcher->Send(std::make_shared<Package>(
-      Package::PackageType::Response,
-      Config::NodeId(),
-      request->Id(),
-      from,
-      std::unique_ptr<Instruction>(new protocol::Pong())
-    ));
+    PROFILE_SCOPE();
+
+    this->Reply(from, request, new protocol::Pong());
   }
 
 
   void Kademlia::OnRequestFindNode(ContactPtr from, PackagePtr request)
   {
-    protocol::FindNode * reqInstr = static_cast<protocol::FindNode *>(request->GetInstruction());
+    PROFILE_SCOPE();
 
-    auto target = reqInstr->Key();
+    this->Reply(from, request, this->AnswerFindNode(static_cast<protocol::FindNode *>(request->GetInstruction())));
+  }
 
-    std::vector<std::pair<KeyPtr, ContactPtr>> result;
 
-    if (target)
-    {
-      this->kBuckets->FindClosestContacts(target, result);
-    }
-    else
+  void Kademlia::OnRequestFindValue(ContactPtr from, PackagePtr request)
+  {
+    PROFILE_SCOPE();
+
+    this->Reply(from, request, this->AnswerFindValue(static_cast<protocol::FindValue *>(request->GetInstruction())));
+  }
+
+
+  void Kademlia::OnRequestBatch(ContactPtr from, PackagePtr request)
+  {
+    PROFILE_SCOPE();
+
+    protocol::Batch * reqInstr = static_cast<protocol::Batch *>(request->GetInstruction());
+
+    // Only requests answered right here on Main can be batched. The sender never
+    // batches anything else, so a batch that has other items is dropped whole.
+    for (const auto & item : reqInstr->Items())
     {
-      this->kBuckets->GetAllContacts(result);
+      switch (item->Code())
+      {
+        case OpCode::PING:
+        case OpCode::FIND_NODE:
+        case OpCode::FIND_VALUE:
+        case OpCode::STORE:
+          break;
+
+        default:
+          printf("Unsupported batch item received: code=%u\n", static_cast<unsigned>(item->Code()));
+          return;
+      }
     }
 
-    protocol::FindNodeResponse * resInstr = new protocol::FindNodeResponse();
+    protocol::Batch * resInstr = new protocol::Batch();
 
-    for (const auto & node : result)
+    for (const auto & item : reqInstr->Items())
     {
-      resInstr->AddNode(node.first, node.second);
+      Instruction * answer = nullptr;
+
+      switch (item->Code())
+      {
+        case OpCode::PING:        answer = new protocol::Pong(); break;
+        case OpCode::FIND_NODE:   answer = this->AnswerFindNode(static_cast<protocol::FindNode *>(item.get())); break;
+        case OpCode::FIND_VALUE:  answer = this->AnswerFindValue(static_cast<protocol::FindValue *>(item.get())); break;
+        case OpCode::STORE:       answer = this->AnswerStore(static_cast<protocol::Store *>(item.get())); break;
+        default:                  break;
+      }
+
+      resInstr->AddItem(InstructionPtr(answer));
     }
 
-    this->dispatcher->Send(std::make_shared<Package>(Package::PackageType::Response, Config::NodeId(), request->Id(), from, std::unique_ptr<Instruction>(resInstr)));
+    this->Reply(from, request, resInstr);
   }
 
 
-  void Kademlia::OnRequestFindValue(ContactPtr from, PackagePtr request)
+  void Kademlia::OnRequestQuery(ContactPtr from, PackagePtr request)
   {
-    protocol::FindValue * reqInstr = static_cast<protocol::FindValue *>(request->GetInstruction());
+    PROFILE_SCOPE();
+
+    struct QueryContext
+    {
+      BufferPtr buffer;
+      bool completed = false;
+    };
 
     auto storage = Storage::Persist();
-    auto buffer = storage->Load(reqInstr->Key());
+    auto context = std::make_shared<QueryContext>();
 
-    if (!buffer)
-    {
-      storage = Storage::Cache();
-      buffer = storage->Load(reqInstr->Key());
-    }
+    // Scanning and parsing the stored documents is CPU-bound, so do it on the
+    // compute pool and come back to Main to touch the index and routing table.
+    this->pool->BeginInvoke(
+      [storage, request, context](void *, void *)
+      {
+        protocol::Query * reqInstr = static_cast<protocol::Query *>(request->GetInstruction());
 
-    uint64_t version;
-    int64_t ttl;
+        context->buffer = storage->MatchQuery(reqInstr->query);
 
-    if (buffer && storage->GetVersion(reqInstr->Key(), &version) && storage->GetTTL(reqInstr->Key(), &ttl))
-    {
-      protocol::FindValueResponse * resInstr = new protocol::FindValueResponse();
+        if (context->buffer)
+        {
+          char* data = (char*)context->buffer->Data();
 
-      resInstr->SetData(buffer);
-      resInstr->SetVersion(version);
-      resInstr->SetTTL(ttl);
+          Json::Reader reader;
+          Json::Value root;
 
-      this->dispatcher->Send(std::make_shared<Package>(Package::PackageType::Response, Config::NodeId(), request->Id(), from, std::unique_ptr<Instruction>(resInstr)));
-    }
-    else
-    {
-      this->OnRequestFindNode(from, request);
-    }
+          if (reader.parse(data, data + context->buffer->Size(), root, false) && root.isArray())
+          {
+            context->completed = root.size() >= reqInstr->limit;
+          }
+        }
+      },
+      [this, storage, from, request, context](void *, void *)
+      {
+        protocol::Query * reqInstr = static_cast<protocol::Query *>(request->GetInstruction());
+
+        uint64_t version;
+        int64_t ttl;
+
+        storage->GetVersion(reqInstr->Key(), &version);
+        storage->GetTTL(reqInstr->Key(), &ttl);
+
+        if (context->buffer)
+        {
+          protocol::QueryResponse * resInstr = new protocol::QueryResponse();
+
+          resInstr->SetData(context->buffer);
+          resInstr->SetVersion(version);
+          resInstr->SetTTL(ttl);
+
+          this->dispatcher->Send(std::make_shared<Package>(Package::PackageType::Response, Config::NodeId(), request->Id(), from, std::unique_ptr<Instruction>(resInstr)));
+        }
+
+        if (!context->completed)
+        {
+          this->OnRequestFindNode(from, request);
+        }
+      },
+      this->thread.get(),
+      nullptr,
+      nullptr,
+      __PRETTY_FUNCTION__
+    );
   }
 
 
-  void Kademlia::OnRequestQuery(ContactPtr from, PackagePtr request)
+  void Kademlia::OnRequestQueryLog(ContactPtr from, PackagePtr request)
   {
-    protocol::Query * reqInstr = static_cast<protocol::Query *>(request->GetInstruction());
+    PROFILE_SCOPE();
 
-    auto storage = Storage::Persist();
-    auto buffer = storage->MatchQuery(reqInstr->query);
+    auto storage = Storage::Log();
+    auto buffer = std::make_shared<BufferPtr>();
 
+    this->pool->BeginInvoke(
+      [storage, request, buffer](void *, void *)
+      {
+        protocol::Query * reqInstr = static_cast<protocol::Query *>(request->GetInstruction());
 
-    bool completed = false;
-    Json::Value root;
+        *buffer = storage->MatchQuery(reqInstr->query);
+      },
+      [this, storage, from, request, buffer](void *, void *)
+      {
+        protocol::Query * reqInstr = static_cast<protocol::Query *>(request->GetInstruction());
 
-    if (buffer)
-    {
-      char* data = (char*)buffer->Data();
+        uint64_t version;
+        int64_t ttl;
 
-      Json::Reader reader;
+        storage->GetVersion(reqInstr->Key(), &version);
+        storage->GetTTL(reqInstr->Key(), &ttl);
+
+        if (*buffer)
+        {
+          protocol::QueryLogResponse * resInstr = new protocol::QueryLogResponse();
+
+          resInstr->SetData(*buffer);
+          resInstr->SetVersion(version);
+          resInstr->SetTTL(ttl);
+
+          this->dispatcher->Send(std::make_shared<Package>(Package::PackageType::Response, Config::NodeId(), request->Id(), from, std::unique_ptr<Instruction>(resInstr)));
+        }
+        else
+        {
+          this->OnRequestFindNode(from, request);
+        }
+      },
+      this->thread.get(),
+      nullptr,
+      nullptr,
+      __PRETTY_FUNCTION__
+    );
+  }
+
+
+  void Kademlia::OnRequestStore(ContactPtr from, PackagePtr request)
+  {
+    PROFILE_SCOPE();
+
+    this->Reply(from, request, this->AnswerStore(static_cast<protocol::Store *>(request->GetInstruction())));
+  }
+
+
+  void Kademlia::OnRequestStoreLog(ContactPtr from, PackagePtr request)
+  {
+    PROFILE_SCOPE();
+
+    auto storage = Storage::Log();
+    auto dispatcher = this->dispatcher.get();
 
-      if (reader.parse(data, buffer->Size(), root, false) && root.isArray())
+    // SaveLog parses the payload and hashes each entry. It does not touch the
+    // routing table and Storage locks its own index, so the whole request can
+    // be handled on the compute pool.
+    this->pool->BeginInvoke(
+      [storage, dispatcher, from, request](void *, void *)
       {
-        completed = root.size() >= reqInstr->limit;
+        protocol::StoreLog * reqInstr = static_cast<protocol::StoreLog *>(request->GetInstruction());
+
+        auto code = protocol::StoreLogResponse::ErrorCode::SUCCESS;
+
+        if (!storage->SaveLog(reqInstr->GetKey(), reqInstr->Version(), reqInstr->Data(), reqInstr->TTL()))
+        {
+          code = protocol::StoreLogResponse::ErrorCode::FAILED;
+        }
+
+        protocol::StoreLogResponse * resInstr = new protocol::StoreLogResponse();
+
+        resInstr->SetResult(code);
+
+        dispatcher->Send(std::make_shared<Package>(Package::PackageType::Response, Config::NodeId(), request->Id(), from, std::unique_ptr<Instruction>(resInstr)));
       }
-    }
+    );
+  }
 
-    uint64_t version;
-    int64_t ttl;
 
-    storage->GetVersion(reqInstr->Key(), &version);
-    storage->GetTTL(reqInstr->Key(), &ttl);
+  void Kademlia::Reply(ContactPtr to, PackagePtr request, Instruction * response)
+  {
+    this->dispatcher->Send(std::make_shared<Package>(Package::PackageType::Response, Config::NodeId(), request->Id(), to, InstructionPtr(response)));
+  }
 
-    if (buffer)
-    {
-      protocol::QueryResponse * resInstr = new protocol::QueryResponse();
 
-      resInstr->SetData(buffer);
-      resInstr->SetVersion(version);
-      resInstr->SetTTL(ttl);
+  Instruction * Kademlia::AnswerFindNode(protocol::FindNode * request)
+  {
+    auto target = request->Key();
+
+    std::vector<std::pair<KeyPtr, ContactPtr>> result;
+
+    // May run off Main, see OnRequest
+    auto snapshot = this->kBuckets->Snapshot();
 
-      this->dispatcher->Send(std::make_shared<Package>(Package::PackageType::Response, Config::NodeId(), request->Id(), from, std::unique_ptr<Instruction>(resInstr)));
+    if (target)
+    {
+      snapshot->FindClosestContacts(* target, KBuckets::SizeK, result);
+    }
+    else
+    {
+      snapshot->GetAllContacts(result);
     }
 
-    if (!completed)
+    protocol::FindNodeResponse * response = new protocol::FindNodeResponse();
+
+    for (const auto & node : result)
     {
-      this->OnRequestFindNode(from, request);
+      response->AddNode(node.first, node.second);
     }
+
+    return response;
   }
 
 
-  void Kademlia::OnRequestQueryLog(ContactPtr from, PackagePtr request)
+  Instruction * Kademlia::AnswerFindValue(protocol::FindValue * request)
   {
-    protocol::Query * reqInstr = static_cast<protocol::Query *>(request->GetInstruction());
+    auto storage = Storage::Persist();
+    auto buffer = storage->Load(request->Key());
 
-    auto storage = Storage::Log();
-    auto buffer = storage->MatchQuery(reqInstr->query);
+    if (!buffer)
+    {
+      storage = Storage::Cache();
+      buffer = storage->Load(request->Key());
+    }
 
     uint64_t version;
     int64_t ttl;
 
-    storage->GetVersion(reqInstr->Key(), &version);
-    storage->GetTTL(reqInstr->Key(), &ttl);
-
-    if (buffer)
+    if (buffer && storage->GetVersion(request->Key(), &version) && storage->GetTTL(request->Key(), &ttl))
     {
-      protocol::QueryLogResponse * resInstr = new protocol::QueryLogResponse();
+      protocol::FindValueResponse * response = new protocol::FindValueResponse();
 
-      resInstr->SetData(buffer);
-      resInstr->SetVersion(version);
-      resInstr->SetTTL(ttl);
+      response->SetData(buffer);
+      response->SetVersion(version);
+      response->SetTTL(ttl);
 
-      this->dispatcher->Send(std::make_shared<Package>(Package::PackageType::Response, Config::NodeId(), request->Id(), from, std::unique_ptr<Instruction>(resInstr)));
-    }
-    else
-    {
-      this->OnRequestFindNode(from, request);
+      return response;
     }
+
+    return this->AnswerFindNode(request);
   }
 
 
-  void Kademlia::OnRequestStore(ContactPtr from, PackagePtr request)
+  Instruction * Kademlia::AnswerStore(protocol::Store * request)
   {
-    protocol::Store * reqInstr = static_cast<protocol::Store *>(request->GetInstruction());
-
-    auto storage = reqInstr->IsOriginal() ? Storage::Persist() : Storage::Cache();
+    auto storage = request->IsOriginal() ? Storage::Persist() : Storage::Cache();
 
     auto code = protocol::StoreResponse::ErrorCode::SUCCESS;
 
     uint64_t version;
-    if (storage->GetVersion(reqInstr->GetKey(), &version) && version > reqInstr->Version())
+    if (storage->GetVersion(request->GetKey(), &version) && version > request->Version())
     {
       code = protocol::StoreResponse::ErrorCode::OUT_OF_DATE;
     }
-    else if (!storage->Save(reqInstr->GetKey(), reqInstr->Version(), reqInstr->Data(), reqInstr->TTL()))
+    else if (!storage->Save(request->GetKey(), request->Version(), request->Data(), request->TTL()))
     {
       code = protocol::StoreResponse::ErrorCode::FAILED;
     }
 
-    protocol::StoreResponse * resInstr = new protocol::StoreResponse();
+    protocol::StoreResponse * response = new protocol::StoreResponse();
 
-    resInstr->SetResult(code);
+    response->SetResult(code);
 
-    this->dispatcher->Send(std::make_shared<Package>(Package::PackageType::Response, Config::NodeId(), request->Id(), from, std::unique_ptr<Instruction>(resInstr)));
+    return response;
   }
 
 
-  void Kademlia::OnRequestStoreLog(ContactPtr from, PackagePtr request)
+  bool Kademlia::InitBuckets()
   {
-    protocol::StoreLog * reqInstr = static_cast<protocol::StoreLog *>(request->GetInstruction());
-
-    auto storage = Storage::Log();
+    std::vector<RoutingTableFile::Record> records;
 
-    auto code = protocol::StoreLogResponse::ErrorCode::SUCCESS;
+    TSTRING tableFilePath = Config::RootPath() + _T(PATH_SEPERATOR_STR) + _T("contacts.bin");
 
-    if (!storage->SaveLog(reqInstr->GetKey(), reqInstr->Version(), reqInstr->Data(), reqInstr->TTL()))
+    if (RoutingTableFile::Load(tableFilePath, records))
     {
-      code = protocol::StoreLogResponse::ErrorCode::FAILED;
-    }
-
-    protocol::StoreLogResponse * resInstr = new protocol::StoreLogResponse();
-
-    resInstr->SetResult(code);
+      for (const auto & record : records)
+      {
+        this->kBuckets->AddRecord(record);
+      }
 
-    this->dispatcher->Send(std::make_shared<Package>(Package::PackageType::Response, Config::NodeId(), request->Id(), from, std::unique_ptr<Instruction>(resInstr)));
-  }
+      // What was just read is what is on disk
+      this->kBuckets->MarkSaved();
 
+      if (this->kBuckets->Size() > 0)
+      {
+        return true;
+      }
+    }
 
-  bool Kademlia::InitBuckets()
-  {
+    // Tables saved before contacts.bin existed, then the bootstrap contacts
     TSTRING bucketsFilePath = Config::RootPath() + _T(PATH_SEPERATOR_STR) + _T("contacts.json");
 
     FILE * file = _tfopen(bucketsFilePath.c_str(), _T("r"));
@@ -1302,33 +1759,25 @@ namespace kad
 
   void Kademlia::SaveBuckets()
   {
-    TSTRING bucketsFilePath = Config::RootPath() + _T(PATH_SEPERATOR_STR) + _T("contacts.json");
-
-    FILE * file = _tfopen(bucketsFilePath.c_str(), _T("w"));
-
-    if (file)
+    // Refresh cycles that changed nothing leave the file alone
+    if (!this->kBuckets->IsModified())
     {
-      std::vector<std::pair<KeyPtr, ContactPtr>> entries;
-
-      this->kBuckets->GetAllContacts(entries);
-
-      Json::Value root;
-
-      for (const auto & entry : entries)
-      {
-        Json::Value node;
-        node["node"] = entry.first->ToString();
-        node["endpoints"].append(entry.second->ToString());
+      return;
+    }
 
-        root.append(node);
-      }
+    std::vector<RoutingTableFile::Record> records;
 
-      Json::FastWriter jw;
+    this->kBuckets->GetRecords(records);
 
-      std::string json = jw.write(root);
-      fwrite(json.c_str(), 1, json.size(), file);
+    TSTRING tableFilePath = Config::RootPath() + _T(PATH_SEPERATOR_STR) + _T("contacts.bin");
 
-      fclose(file);
+    if (RoutingTableFile::Save(tableFilePath, records))
+    {
+      this->kBuckets->MarkSaved();
+    }
+    else
+    {
+      printf("WARNING: failed to save the routing table to %s\n", tableFilePath.c_str());
     }
   }
 
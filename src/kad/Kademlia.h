@@ -29,6 +29,7 @@
 
 
 #include <memory>
+#include <chrono>
 #include <set>
 #include <vector>
 #include <functional>
@@ -37,22 +38,47 @@
 #include "Package.h"
 #include "Buffer.h"
 #include "AsyncResult.h"
+#include "Task.h"
 #include "Instruction.h"
 
 namespace kad
 {
+  class Action;
   class EventLoop;
   class KBuckets;
   class Thread;
+  class ThreadPool;
   class PackageDispatcher;
   class Timer;
 
+  namespace protocol
+  {
+    class FindNode;
+    class FindValue;
+    class Store;
+  }
+
   class Kademlia
   {
   public:
 
     using CompleteHandler = std::function<void(AsyncResultPtr)>;
 
+    // Figures of the bucket refresh cycles so far; "last" ones are of the latest cycle
+    struct RefreshStats
+    {
+      uint64_t cycles = 0;
+
+      size_t lastLookups = 0;
+
+      // Buckets left alone because lookup traffic had covered them
+      size_t lastSkipped = 0;
+
+      std::chrono::milliseconds lastDuration{0};
+
+      std::chrono::milliseconds maxDuration{0};
+    };
+
   public:
 
     Kademlia();
@@ -71,6 +97,10 @@ namespace kad
 
     void FindValue(KeyPtr target, AsyncResultPtr result = nullptr, CompleteHandler handler = nullptr);
 
+    // Completes with one value per target (nullptr where none was found). Targets whose
+    // closest known contact is the same are asked for in one BATCH round trip.
+    void FindValues(std::vector<KeyPtr> targets, AsyncResultPtr result = nullptr, CompleteHandler handler = nullptr);
+
     void Query(KeyPtr target, std::string query, uint32_t limit, AsyncResultPtr result = nullptr, CompleteHandler handler = nullptr);
 
     void QueryLogs(KeyPtr target, std::string query, uint32_t limit, AsyncResultPtr result = nullptr, CompleteHandler handler = nullptr);
@@ -79,16 +109,60 @@ namespace kad
 
     void Ping(KeyPtr target, AsyncResultPtr result = nullptr, CompleteHandler handler = nullptr);
 
+    // Task based variants of the calls above. Continuations run on the Main thread.
+
+    Task<bool> StoreAsync(KeyPtr hash, BufferPtr data, uint32_t ttl, uint64_t version = 0);
+
+    Task<bool> PublishAsync(KeyPtr hash, BufferPtr data, uint32_t ttl, uint64_t version = 0);
+
+    Task<bool> StoreLogAsync(KeyPtr hash, BufferPtr data, uint32_t ttl, uint64_t version = 0);
+
+    Task<std::vector<std::pair<KeyPtr, ContactPtr>>> FindNodeAsync(KeyPtr target, bool restrictBucket = false);
+
+    Task<BufferPtr> FindValueAsync(KeyPtr target);
+
+    Task<std::vector<BufferPtr>> FindValuesAsync(std::vector<KeyPtr> targets);
+
+    Task<BufferPtr> QueryAsync(KeyPtr target, std::string query, uint32_t limit);
+
+    Task<BufferPtr> QueryLogsAsync(KeyPtr target, std::string query, uint32_t limit);
+
+    Task<bool> PingAsync(ContactPtr target);
+
+    Task<bool> PingAsync(KeyPtr target);
+
     bool IsReady() const        { return this->ready; }
 
     void PrintNodes() const;
 
     void SaveBuckets();
 
+    RefreshStats GetRefreshStats() const;
+
   private:
 
+    // One refresh pass, begun at start. targets are the stale buckets; lookups counts
+    // those looked up, skipped the buckets left alone because a lookup had touched them
+    // within the refresh interval or since start.
+    struct RefreshCycle
+    {
+      std::vector<KeyPtr> targets;
+      size_t lookups = 0;
+      size_t skipped = 0;
+      std::chrono::steady_clock::time_point start;
+    };
+
     void OnMessage(KeyPtr fromKey, ContactPtr fromContact);
 
+    // Wire a lookup to the routing table: failed contacts are replaced and, with
+    // proximity routing, candidates are ranked by their known round trip
+    void ConfigureAction(Action * action);
+
+    // A contact that did not answer during a lookup gives way to a replacement candidate
+    void OnContactFailed(KeyPtr key);
+
+    void OnRoundTrip(KeyPtr key, std::chrono::steady_clock::duration rtt);
+
     void OnRequest(ContactPtr from, PackagePtr request);
 
     void OnRequestPing(ContactPtr from, PackagePtr request);
@@ -105,9 +179,20 @@ namespace kad
 
     void OnRequestStoreLog(ContactPtr from, PackagePtr request);
 
-  private:
+    void OnRequestBatch(ContactPtr from, PackagePtr request);
+
+    void Reply(ContactPtr to, PackagePtr request, Instruction * response);
+
+    // Answers for the requests that are handled right away, alone or in a batch. All but
+    // AnswerFindNode run on Main.
 
-    void OnInitPing(const std::vector<std::pair<KeyPtr, ContactPtr>> * targets, std::set<KeyPtr, KeyCompare> * validating, std::set<KeyPtr, KeyCompare> * validated);
+    Instruction * AnswerFindNode(protocol::FindNode * request);
+
+    Instruction * AnswerFindValue(protocol::FindValue * request);
+
+    Instruction * AnswerStore(protocol::Store * request);
+
+  private:
 
     bool InitBuckets();
 
@@ -115,9 +200,14 @@ namespace kad
 
     void OnRefreshTimer(void * sender, void * args);
 
-    void OnRefresh(std::shared_ptr<std::vector<KeyPtr>> targets, size_t idx);
+    void ScheduleRefresh();
+
+    void OnRefresh(std::shared_ptr<RefreshCycle> cycle);
 
-    void OnReplicate(std::shared_ptr<std::vector<KeyPtr>> targets, size_t idx);
+    void OnRefreshCompleted(std::shared_ptr<RefreshCycle> cycle);
+
+    // Sends the keys from idx on to the nodes closest to them, one window at a time
+    Task<bool> Replicate(std::shared_ptr<std::vector<KeyPtr>> targets, size_t idx);
 
     void OnInitialized();
 
@@ -132,5 +222,13 @@ namespace kad
     std::unique_ptr<PackageDispatcher> dispatcher;
 
     std::unique_ptr<Timer> refreshTimer;
+
+    // Set while a refresh cycle runs, so a timer firing meanwhile does not start another
+    bool refreshing = false;
+
+    RefreshStats refreshStats;
+
+    // Declared last so the compute workers stop before the rest is torn down
+    std::unique_ptr<ThreadPool> pool;
   };
 }
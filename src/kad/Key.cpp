@@ -31,6 +31,7 @@
 
 #include <assert.h>
 #include <string.h>
+#include <random>
 #include "Key.h"
 
 namespace kad
@@ -39,6 +40,9 @@ namespace kad
 
   const size_t Key::KEY_LEN;
 
+  const size_t Key::HEX_LEN;
+
+
 
   Key::Key(const void * buf)
   {
@@ -48,12 +52,6 @@ namespace kad
   }
 
 
-  Key::Key(const Key & val)
-  {
-    memcpy(this->key, val.key, KEY_LEN);
-  }
-
-
   Key Key::GetDistance(const Key & target) const
   {
     static_assert(KEY_LEN % sizeof(uint32_t) == 0, "KEY_LEN should be a multiply of 4");
@@ -76,36 +74,6 @@ namespace kad
   }
 
 
-  bool Key::operator<(const Key & target) const
-  {
-    return memcmp(this->key, target.key, KEY_LEN) < 0;
-  }
-
-
-  bool Key::operator>(const Key & target) const
-  {
-    return target < (* this);
-  }
-
-
-  bool Key::operator<=(const Key & target) const
-  {
-    return !(target < (* this));
-  }
-
-
-  bool Key::operator>=(const Key & target) const
-  {
-    return !((* this) < target);
-  }
-
-
-  bool Key::operator==(const Key & target) const
-  {
-    return memcmp(this->key, target.key, KEY_LEN) == 0;
-  }
-
-
   bool Key::Bit(size_t idx) const
   {
     assert(idx < KEY_LEN_BITS);
@@ -158,39 +126,90 @@ namespace kad
   }
 
 
+  static const char HexDigits[] = "0123456789ABCDEF";
+
+  // Value of each hex digit, -1 for every other character
+  static const int8_t HexValues[256] =
+  {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+  };
+
+
   std::string Key::ToString() const
   {
-    char buffer[KEY_LEN * 2 + 1];
+    char buffer[HEX_LEN + 1];
 
-    buffer[KEY_LEN * 2] = '\0';
+    this->ToString(buffer);
+
+    return std::string(buffer, HEX_LEN);
+  }
+
+
+  void Key::ToString(char * buffer) const
+  {
+    assert(buffer);
 
     for (size_t i = 0; i < KEY_LEN; ++i)
     {
-      sprintf(buffer + i * 2, "%02X", this->key[i]);
+      buffer[i * 2] = HexDigits[this->key[i] >> 4];
+      buffer[i * 2 + 1] = HexDigits[this->key[i] & 0x0F];
     }
 
-    return buffer;
+    buffer[HEX_LEN] = '\0';
   }
 
 
   bool Key::FromString(const char * str)
   {
-    if (!str || strlen(str) != KEY_LEN * 2)
+    if (!str)
     {
       return false;
     }
 
+    uint8_t result[KEY_LEN];
+
     for (size_t i = 0; i < KEY_LEN; ++i)
     {
-      unsigned value = 0;
-      if (sscanf(str + i * 2, "%02X", &value) <= 0)
+      // A terminator maps to -1 as well, so a short string stops here
+      int high = HexValues[static_cast<uint8_t>(str[i * 2])];
+
+      if (high < 0)
+      {
+        return false;
+      }
+
+      int low = HexValues[static_cast<uint8_t>(str[i * 2 + 1])];
+
+      if (low < 0)
       {
         return false;
       }
 
-      this->key[i] = static_cast<uint8_t>(value);
+      result[i] = static_cast<uint8_t>((high << 4) | low);
     }
 
+    if (str[HEX_LEN] != '\0')
+    {
+      return false;
+    }
+
+    memcpy(this->key, result, KEY_LEN);
+
     return true;
   }
 
@@ -210,4 +229,16 @@ namespace kad
 
     return input.Read(this->key, KEY_LEN) == KEY_LEN;
   }
-}
\ No newline at end of file
+
+
+  uint64_t KeyHash::Seed()
+  {
+    static const uint64_t seed = []()
+    {
+      std::random_device random;
+      return (static_cast<uint64_t>(random()) << 32) | random();
+    }();
+
+    return seed;
+  }
+}
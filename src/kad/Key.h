@@ -28,13 +28,17 @@
 #pragma once
 
 #include <stdlib.h>
+#include <string.h>
 #include <memory>
 #include <string>
+#include "EndianUtil.h"
 #include "IOutputStream.h"
 #include "IInputStream.h"
+#include "SpanReader.h"
 
 namespace kad
 {
+  // A 160 bit id, held by value in containers and shared through KeyPtr across APIs
   class Key
   {
   public:
@@ -43,25 +47,57 @@ namespace kad
 
     static const size_t KEY_LEN = KEY_LEN_BITS / 8;
 
+    // Characters in the hex form of a key, without the terminator
+    static const size_t HEX_LEN = KEY_LEN * 2;
+
   public:
 
     Key() = default;
 
     explicit Key(const void * buf);
 
-    Key(const Key & val);
+    Key(const Key & val) = default;
+
+    Key & operator=(const Key & val) = default;
 
     Key GetDistance(const Key & target) const;
 
-    bool operator<(const Key & target) const;
+    // Compares the id as two 64 bit and one 32 bit big-endian words, which orders
+    // the same as comparing the bytes
+    bool operator<(const Key & target) const
+    {
+      uint64_t x = Word64(this->key);
+      uint64_t y = Word64(target.key);
+
+      if (x != y)
+      {
+        return x < y;
+      }
+
+      x = Word64(this->key + 8);
+      y = Word64(target.key + 8);
 
-    bool operator>(const Key & target) const;
+      if (x != y)
+      {
+        return x < y;
+      }
 
-    bool operator<=(const Key & target) const;
+      return Word32(this->key + 16) < Word32(target.key + 16);
+    }
 
-    bool operator>=(const Key & target) const;
+    bool operator>(const Key & target) const      { return target < (* this); }
 
-    bool operator==(const Key & target) const;
+    bool operator<=(const Key & target) const     { return !(target < (* this)); }
+
+    bool operator>=(const Key & target) const     { return !((* this) < target); }
+
+    bool operator==(const Key & target) const
+    {
+      return ((Word64(this->key) ^ Word64(target.key)) | (Word64(this->key + 8) ^ Word64(target.key + 8))
+        | (Word32(this->key + 16) ^ Word32(target.key + 16))) == 0;
+    }
+
+    bool operator!=(const Key & target) const     { return !((* this) == target); }
 
     bool Bit(size_t idx) const;
 
@@ -73,19 +109,76 @@ namespace kad
 
     std::string ToString() const;
 
+    // Writes the upper case hex form and a terminator; buffer must hold HEX_LEN + 1 chars
+    void ToString(char * buffer) const;
+
+    // Accepts exactly HEX_LEN hex digits of either case
     bool FromString(const char * str);
 
     bool Serialize(IOutputStream & output) const;
 
     bool Deserialize(IInputStream & input);
 
+    bool Deserialize(SpanReader & input)    { return input.Read(this->key, KEY_LEN); }
+
   private:
 
+    static uint64_t Word64(const uint8_t * ptr)
+    {
+      uint64_t value;
+      memcpy(& value, ptr, sizeof(value));
+      return be64toh(value);
+    }
+
+    static uint32_t Word32(const uint8_t * ptr)
+    {
+      uint32_t value;
+      memcpy(& value, ptr, sizeof(value));
+      return be32toh(value);
+    }
+
+  private:
+
+    static_assert(KEY_LEN == sizeof(uint64_t) * 2 + sizeof(uint32_t), "Key compares as two 64 bit and one 32 bit word");
+
     uint8_t key[KEY_LEN] = {};
   };
 
   using KeyPtr = std::shared_ptr<Key>;
 
+  // Peers choose the keys they STORE, so the hash cannot trust them to be SHA-1 values.
+  // The words are folded in with a per-process seed and the result goes through the
+  // murmur3 finalizer, which lets every input bit reach the low bits a table indexes
+  // by. Without it keys differing only in high bits would share a home slot.
+  struct KeyHash
+  {
+    static uint64_t Seed();
+
+    uint64_t seed = Seed();
+
+    size_t operator()(const Key & key) const
+    {
+      const uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+      uint64_t high, middle;
+      uint32_t low;
+
+      memcpy(& high, key.Buffer(), sizeof(high));
+      memcpy(& middle, key.Buffer() + 8, sizeof(middle));
+      memcpy(& low, key.Buffer() + 16, sizeof(low));
+
+      uint64_t value = (high ^ this->seed) * multiplier;
+      value = (value ^ middle ^ (static_cast<uint64_t>(low) << 32)) * multiplier;
+
+      value ^= value >> 33;
+      value *= 0xFF51AFD7ED558CCDULL;
+      value ^= value >> 33;
+      value *= 0xC4CEB9FE1A85EC53ULL;
+      value ^= value >> 33;
+
+      return static_cast<size_t>(value);
+    }
+  };
+
   struct KeyCompare
   {
     bool operator()(const KeyPtr & lhs, const KeyPtr & rhs) const
@@ -45,6 +45,7 @@ namespace kad
     STORE_LOG_RESPONSE = 12,
     QUERY_LOG = 13,
     QUERY_LOG_RESPONSE = 14,
+    BATCH = 15,
     __MAX__
   };
 }
@@ -25,6 +25,7 @@
  * =============================================================================
  */
 
+#include "Arena.h"
 #include "InstructionSerializer.h"
 #include "Package.h"
 
@@ -32,8 +33,10 @@ namespace kad
 {
   std::atomic<uint16_t> Package::gid{0};
 
+  const uint8_t Package::VERSION_TRAILER;
 
-  Package::Package(Package::PackageType type, KeyPtr from, ContactPtr tgt, std::unique_ptr<Instruction> && instr)
+
+  Package::Package(Package::PackageType type, KeyPtr from, ContactPtr tgt, InstructionPtr instr)
     : from(from)
     , target(tgt)
     , instruction(std::move(instr))
@@ -43,7 +46,7 @@ namespace kad
   }
 
 
-  Package::Package(Package::PackageType type, KeyPtr from, uint16_t id, ContactPtr tgt, std::unique_ptr<Instruction> && instr)
+  Package::Package(Package::PackageType type, KeyPtr from, uint16_t id, ContactPtr tgt, InstructionPtr instr)
     : from(from)
     , target(tgt)
     , instruction(std::move(instr))
@@ -53,6 +56,13 @@ namespace kad
   }
 
 
+  void Package::SetVersion(uint8_t version, uint8_t supported)
+  {
+    this->version = version;
+    this->supportedVersion = supported > version ? supported : version;
+  }
+
+
   bool Package::Serialize(IOutputStream & output) const
   {
     if (!this->instruction)
@@ -60,7 +70,7 @@ namespace kad
       return false;
     }
 
-    output.WriteUInt8(0); // version, always 0
+    output.WriteUInt8(this->version);
 
     output.WriteUInt8(static_cast<uint8_t>(this->type));
 
@@ -68,18 +78,45 @@ namespace kad
 
     this->from->Serialize(output);
 
-    return InstructionSerializer::Serialize(output, this->instruction.get());
+    if (!InstructionSerializer::Serialize(output, this->instruction.get(), this->version))
+    {
+      return false;
+    }
+
+    if (this->supportedVersion > this->version)
+    {
+      output.WriteUInt8(VERSION_TRAILER);
+      output.WriteUInt8(this->supportedVersion);
+    }
+
+    return true;
   }
 
 
-  std::unique_ptr<Package> Package::Deserialize(ContactPtr sender, IInputStream & input)
+  size_t Package::SerializedSize() const
   {
-    if (!sender || input.Remainder() < sizeof(uint8_t) * 2 + sizeof(uint16_t) || input.ReadUInt8() != 0)
+    if (!this->instruction)
+    {
+      return 0;
+    }
+
+    size_t trailer = this->supportedVersion > this->version ? sizeof(uint8_t) * 2 : 0;
+
+    return sizeof(uint8_t) * 2 + sizeof(uint16_t) + Key::KEY_LEN + this->instruction->SerializedSize(this->version) + trailer;
+  }
+
+
+  std::shared_ptr<Package> Package::Deserialize(ContactPtr sender, SpanReader & input)
+  {
+    uint8_t version = 0;
+    uint8_t typeVal = 0;
+    uint16_t id = 0;
+
+    if (!sender || !input.Read(version) || !input.Read(typeVal) || !input.Read(id) || version > Instruction::LATEST_WIRE_VERSION)
     {
       return nullptr;
     }
 
-    uint8_t typeVal = input.ReadUInt8();
     if (typeVal >= static_cast<uint8_t>(PackageType::__MAX__))
     {
       return nullptr;
@@ -87,22 +124,49 @@ namespace kad
 
     PackageType type = static_cast<PackageType>(typeVal);
 
-    uint16_t id = input.ReadUInt16();
+    ArenaScope scope;
 
-    auto from = std::make_shared<Key>();
+    auto from = Arena::MakeShared<Key>();
 
     if (!from->Deserialize(input))
     {
       return nullptr;
     }
 
-    Instruction * instr = InstructionSerializer::Deserialize(input);
+    Instruction * instr = InstructionSerializer::Deserialize(input, version);
 
     if (!instr)
     {
       return nullptr;
     }
 
-    return std::unique_ptr<Package>(new Package(type, from, id, sender, std::unique_ptr<Instruction>(instr)));
+    uint8_t supported = version;
+
+    if (input.Remainder() >= sizeof(uint8_t) * 2 && input.Data()[0] == VERSION_TRAILER)
+    {
+      input.Skip(sizeof(uint8_t));
+      input.Read(supported);
+    }
+
+    auto package = Arena::MakeShared<Package>(type, from, id, sender, Arena::Adopt(instr));
+
+    package->SetVersion(version, supported);
+
+    return package;
+  }
+
+  std::shared_ptr<Package> Package::Deserialize(ContactPtr sender, IInputStream & input)
+  {
+    BufferPtr backing = input.Backing();
+
+    SpanReader reader = backing
+      ? SpanReader(backing, input.Offset(), input.Remainder())
+      : SpanReader(input.BufferAt(input.Offset()), input.Remainder());
+
+    auto result = Deserialize(sender, reader);
+
+    input.Skip(reader.Offset());
+
+    return result;
   }
 }
\ No newline at end of file
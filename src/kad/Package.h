@@ -49,9 +49,9 @@ namespace kad
 
   public:
 
-    explicit Package(PackageType type, KeyPtr from, ContactPtr tgt, std::unique_ptr<Instruction> && instr);
+    explicit Package(PackageType type, KeyPtr from, ContactPtr tgt, InstructionPtr instr);
 
-    explicit Package(PackageType type, KeyPtr from, uint16_t id, ContactPtr tgt, std::unique_ptr<Instruction> && instr);
+    explicit Package(PackageType type, KeyPtr from, uint16_t id, ContactPtr tgt, InstructionPtr instr);
 
     KeyPtr From() const                   { return this->from; }
 
@@ -59,29 +59,55 @@ namespace kad
 
     Instruction * GetInstruction() const  { return this->instruction.get(); }
 
+    // Lets a BATCH carry the instruction without copying it
+    InstructionPtr GetInstructionPtr() const  { return this->instruction; }
+
     uint16_t Id() const                   { return this->id; }
 
     PackageType Type() const              { return this->type; }
 
+    // Wire version the package is encoded in (or arrived in)
+    uint8_t Version() const               { return this->version; }
+
+    // Highest wire version the sender speaks. Outgoing packages advertise it in a
+    // trailer when it is above Version(); peers that predate the trailer ignore it.
+    uint8_t SupportedVersion() const      { return this->supportedVersion; }
+
+    void SetVersion(uint8_t version, uint8_t supported);
+
     bool Serialize(IOutputStream & output) const;
 
-    static std::unique_ptr<Package> Deserialize(ContactPtr sender, IInputStream & input);
+    size_t SerializedSize() const;
+
+    // Everything decoded from input lives in one arena that is released when the
+    // package and every handle taken from it are gone
+    static std::shared_ptr<Package> Deserialize(ContactPtr sender, SpanReader & input);
+
+    // Decodes through a SpanReader over the unread part of input, then skips what it consumed
+    static std::shared_ptr<Package> Deserialize(ContactPtr sender, IInputStream & input);
 
   private:
 
     static std::atomic<uint16_t> gid;
 
+    // Marks the trailer: the marker byte followed by the supported version
+    static const uint8_t VERSION_TRAILER = 0x56;
+
   private:
 
     KeyPtr from;
 
     ContactPtr target;
 
-    std::unique_ptr<Instruction> instruction;
+    InstructionPtr instruction;
 
     uint16_t id;
 
     PackageType type;
+
+    uint8_t version = Instruction::WIRE_VERSION_0;
+
+    uint8_t supportedVersion = Instruction::WIRE_VERSION_0;
   };
 
   using PackagePtr = std::shared_ptr<Package>;
@@ -25,21 +25,30 @@
  * =============================================================================
  */
 
+#include <assert.h>
+#include <algorithm>
 #include <tuple>
 #include <vector>
 #include "BufferedOutputStream.h"
-#include "BufferedInputStream.h"
+#include "SpanReader.h"
 #include "TransportFactory.h"
 #include "Timer.h"
+#include "ThreadConfig.h"
 #include "Config.h"
+#include "protocol/Batch.h"
 #include "PackageDispatcher.h"
 
 namespace kad
 {
+  const size_t PackageDispatcher::PeerVersionBits;
+
+  const size_t PackageDispatcher::PeerVersionSlots;
+
+
   PackageDispatcher::PackageDispatcher(Thread * owner)
     : owner(owner)
   {
-    this->timer = std::unique_ptr<Timer>(new Timer());
+    this->timer = std::unique_ptr<Timer>(new Timer("DispatchTimer"));
 
     this->transport = TransportFactory::Instance()->Create();
 
@@ -64,7 +73,35 @@ namespace kad
     subscription->handler = onResponse;
     subscription->timeout = timeout;
 
-    this->dispatcherThread->BeginInvoke(&PackageDispatcher::OnSend, this, subscription);
+    this->dispatcherThread->BeginInvoke(&PackageDispatcher::OnSend, this, subscription, "PackageDispatcher::OnSend");
+  }
+
+
+  Task<PackagePtr> PackageDispatcher::SendAsync(PackagePtr package, int timeout)
+  {
+    Task<PackagePtr> task(this->owner);
+
+    this->Send(package, [task](PackagePtr, PackagePtr response) { task.Complete(response); }, timeout);
+
+    return task;
+  }
+
+
+  void PackageDispatcher::SendBatch(std::vector<std::pair<PackagePtr, PackageHandler>> requests, int timeout)
+  {
+    if (requests.empty())
+    {
+      return;
+    }
+
+    auto items = std::make_shared<std::vector<std::pair<PackagePtr, PackageHandler>>>(std::move(requests));
+
+    this->dispatcherThread->BeginInvoke(
+      [this, items, timeout](void *, void *) { this->OnSendBatch(items, timeout); },
+      nullptr,
+      nullptr,
+      "PackageDispatcher::OnSendBatch"
+    );
   }
 
 
@@ -80,8 +117,16 @@ namespace kad
   }
 
 
+  void PackageDispatcher::SetRoundTripHandler(RoundTripHandler handler)
+  {
+    this->roundTripHandler = handler;
+  }
+
+
   void PackageDispatcher::RecvThreadProc()
   {
+    ThreadConfig::Apply("Recv");
+
     while (true)
     {
       uint8_t * buffer = nullptr;
@@ -96,7 +141,7 @@ namespace kad
 
       auto args = new std::tuple<ContactPtr, uint8_t *, size_t>(contact, buffer, size);
 
-      this->dispatcherThread->BeginInvoke(&PackageDispatcher::OnReceive, this, args);
+      this->dispatcherThread->BeginInvoke(&PackageDispatcher::OnReceive, this, args, "PackageDispatcher::OnReceive");
     }
   }
 
@@ -117,9 +162,11 @@ namespace kad
       _this->subscriptions[id] = subscription;
       managed = true;
 
+      subscription->sent = std::chrono::steady_clock::now();
+
       if (subscription->timeout > 0)
       {
-        _this->expires[std::chrono::steady_clock::now() + std::chrono::milliseconds(subscription->timeout)] = id;
+        _this->expires[subscription->sent + std::chrono::milliseconds(subscription->timeout)] = id;
 
         auto first = _this->expires.begin();
 
@@ -138,9 +185,19 @@ namespace kad
     }
 #endif
 
-    BufferedOutputStream buffer;
+    // Peers we have not heard from yet get version 0, along with what we support
+    uint8_t version = _this->GetPeerVersion(* subscription->request->Target());
+
+    subscription->request->SetVersion(version, Config::WireVersion());
+
+    BufferedOutputStream & buffer = _this->sendBuffer;
+    buffer.Reset();
+    buffer.Reserve(subscription->request->SerializedSize());
+
     if (subscription->request->Serialize(buffer))
     {
+      assert(buffer.Offset() == subscription->request->SerializedSize());
+
       _this->transport->Send(subscription->request->Target(), buffer.Buffer(), buffer.Offset());
     }
 
@@ -151,6 +208,74 @@ namespace kad
   }
 
 
+  void PackageDispatcher::OnSendBatch(std::shared_ptr<std::vector<std::pair<PackagePtr, PackageHandler>>> requests, int timeout)
+  {
+    ContactPtr target = requests->front().first->Target();
+
+    uint8_t version = this->GetPeerVersion(* target);
+
+    if (version < Instruction::WIRE_VERSION_1 || requests->size() == 1)
+    {
+      for (const auto & request : *requests)
+      {
+        OnSend(this, new Subscription{request.first, request.second, timeout});
+      }
+
+      return;
+    }
+
+    for (size_t begin = 0; begin < requests->size(); begin += protocol::Batch::MAX_ITEMS)
+    {
+      size_t end = std::min(requests->size(), begin + protocol::Batch::MAX_ITEMS);
+
+      auto batch = std::unique_ptr<protocol::Batch>(new protocol::Batch());
+
+      for (size_t i = begin; i < end; ++i)
+      {
+        assert((*requests)[i].first->Target()->addr == target->addr && (*requests)[i].first->Target()->port == target->port);
+
+        batch->AddItem((*requests)[i].first->GetInstructionPtr());
+      }
+
+      // Split the response into one package per item, with the id of the item's request
+      auto handler = [requests, begin, end](PackagePtr, PackagePtr response)
+      {
+        protocol::Batch * results = nullptr;
+
+        if (response && response->GetInstruction()->Code() == OpCode::BATCH)
+        {
+          results = static_cast<protocol::Batch *>(response->GetInstruction());
+
+          if (results->Items().size() != end - begin)
+          {
+            results = nullptr;
+          }
+        }
+
+        for (size_t i = begin; i < end; ++i)
+        {
+          const auto & item = (*requests)[i];
+
+          if (!item.second)
+          {
+            continue;
+          }
+
+          PackagePtr itemResponse = results
+            ? std::make_shared<Package>(Package::PackageType::Response, response->From(), item.first->Id(), response->Target(), results->Items()[i - begin])
+            : nullptr;
+
+          item.second(item.first, itemResponse);
+        }
+      };
+
+      auto package = std::make_shared<Package>(Package::PackageType::Request, requests->front().first->From(), target, std::move(batch));
+
+      OnSend(this, new Subscription{package, handler, timeout});
+    }
+  }
+
+
   void PackageDispatcher::OnReceive(void * sender, void * args)
   {
     auto _this = reinterpret_cast<PackageDispatcher *>(sender);
@@ -162,15 +287,17 @@ namespace kad
 
     delete info;
 
-    BufferedInputStream input(buffer, size);
+    // Payloads of the decoded package are slices of this buffer, not copies of it
+    SpanReader input(std::make_shared<Buffer>(buffer, size, false, true));
     PackagePtr package = Package::Deserialize(contact, input);
-    delete[] buffer;
 
     if (!package)
     {
       return;
     }
 
+    _this->SetPeerVersion(* contact, package->SupportedVersion());
+
 #ifdef DEBUG
     if (Config::Verbose())
     {
@@ -186,7 +313,7 @@ namespace kad
       if (_this->owner)
       {
         auto handler = _this->contactHandler;
-        _this->owner->BeginInvoke([handler, from, contact](void *, void *) { handler(from, contact); });
+        _this->owner->BeginInvoke([handler, from, contact](void *, void *) { handler(from, contact); }, nullptr, nullptr, "PackageDispatcher::OnContact");
       }
       else
       {
@@ -211,11 +338,27 @@ namespace kad
 
       _this->subscriptions.erase(iter);
 
+      if (_this->roundTripHandler)
+      {
+        auto from = package->From();
+        auto elapsed = std::chrono::steady_clock::now() - subscription->sent;
+
+        if (_this->owner)
+        {
+          auto handler = _this->roundTripHandler;
+          _this->owner->BeginInvoke([handler, from, elapsed](void *, void *) { handler(from, elapsed); }, nullptr, nullptr, "PackageDispatcher::OnRoundTrip");
+        }
+        else
+        {
+          _this->roundTripHandler(from, elapsed);
+        }
+      }
+
       if (subscription->handler)
       {
         if (_this->owner)
         {
-          _this->owner->BeginInvoke([subscription, package](void *, void *) { subscription->handler(subscription->request, package); });
+          _this->owner->BeginInvoke([subscription, package](void *, void *) { subscription->handler(subscription->request, package); }, nullptr, nullptr, "PackageDispatcher::OnResponse");
         }
         else
         {
@@ -267,7 +410,7 @@ namespace kad
         {
           if (_this->owner)
           {
-            _this->owner->BeginInvoke([subscription](void *, void *) { subscription->handler(subscription->request, nullptr); });
+            _this->owner->BeginInvoke([subscription](void *, void *) { subscription->handler(subscription->request, nullptr); }, nullptr, nullptr, "PackageDispatcher::OnTimeout");
           }
           else
           {
@@ -293,4 +436,37 @@ namespace kad
       );
     }
   }
+
+
+  PackageDispatcher::PeerVersion & PackageDispatcher::PeerVersionSlot(const Contact & contact) const
+  {
+    // Take the top bits of the product, which depend on every bit of the endpoint
+    uint64_t endpoint = (static_cast<uint64_t>(contact.addr) << 16) | contact.port;
+
+    return this->peerVersions[(endpoint * 0x9E3779B97F4A7C15ULL) >> (64 - PeerVersionBits)];
+  }
+
+
+  uint8_t PackageDispatcher::GetPeerVersion(const Contact & contact) const
+  {
+    const PeerVersion & peer = this->PeerVersionSlot(contact);
+
+    // Not heard from yet, or evicted by another source since
+    if (peer.addr != contact.addr || peer.port != contact.port)
+    {
+      return Instruction::WIRE_VERSION_0;
+    }
+
+    return std::min(peer.version, Config::WireVersion());
+  }
+
+
+  void PackageDispatcher::SetPeerVersion(const Contact & contact, uint8_t version)
+  {
+    PeerVersion & peer = this->PeerVersionSlot(contact);
+
+    peer.addr = contact.addr;
+    peer.port = contact.port;
+    peer.version = version;
+  }
 }
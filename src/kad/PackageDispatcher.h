@@ -30,10 +30,13 @@
 #include <functional>
 #include <thread>
 #include <map>
+#include <vector>
 #include <chrono>
+#include "BufferedOutputStream.h"
 #include "Contact.h"
 #include "Thread.h"
 #include "Package.h"
+#include "Task.h"
 #include "ITransport.h"
 
 namespace kad
@@ -50,6 +53,8 @@ namespace kad
 
     using ContactHandler = std::function<void(KeyPtr, ContactPtr)>;
 
+    using RoundTripHandler = std::function<void(KeyPtr, std::chrono::steady_clock::duration)>;
+
   private:
 
     struct Subscription
@@ -57,8 +62,23 @@ namespace kad
       PackagePtr request;
       PackageHandler handler;
       int timeout;
+      std::chrono::steady_clock::time_point sent = {};
+    };
+
+    // The wire version a peer advertised, in a direct-mapped cache of PeerVersionSlots
+    // entries. A new source takes over the slot, so churn and spoofed addresses cannot
+    // grow it; the evicted peer is sent version 0 until it is heard from again.
+    struct PeerVersion
+    {
+      unsigned long addr = 0;
+      unsigned short port = 0;
+      uint8_t version = 0;
     };
 
+    static const size_t PeerVersionBits = 12;
+
+    static const size_t PeerVersionSlots = size_t(1) << PeerVersionBits;
+
     struct SubscriptionId
     {
       Contact contact;
@@ -101,22 +121,47 @@ namespace kad
 
     void Send(PackagePtr package, PackageHandler onResponse = nullptr, int timeout = 5000);
 
+    // Requests only. Completes on the owner thread with the response, or with nullptr on timeout
+    Task<PackagePtr> SendAsync(PackagePtr package, int timeout = 5000);
+
+    // Sends requests that share one target as BATCH packages of up to Batch::MAX_ITEMS
+    // and hands every handler its own request and response, as Send would. Peers that
+    // have not advertised wire version 1 get the requests one by one instead.
+    void SendBatch(std::vector<std::pair<PackagePtr, PackageHandler>> requests, int timeout = 5000);
+
     void SetRequestHandler(RequestHandler handler);
 
     void SetContactHandler(ContactHandler handler);
 
+    // Called on the owner thread with the sender and the time it took for each response
+    // that answered a request of ours
+    void SetRoundTripHandler(RoundTripHandler handler);
+
   private:
 
     void RecvThreadProc();
 
     static void OnSend(void * sender, void * args);
 
+    void OnSendBatch(std::shared_ptr<std::vector<std::pair<PackagePtr, PackageHandler>>> requests, int timeout);
+
     static void OnReceive(void * sender, void * args);
 
     static void OnCheckTimeout(void * sender, void * args);
 
+    PeerVersion & PeerVersionSlot(const Contact & contact) const;
+
+    // The version to encode packages to contact with (dispatcher thread only)
+    uint8_t GetPeerVersion(const Contact & contact) const;
+
+    void SetPeerVersion(const Contact & contact, uint8_t version);
+
   private:
 
+    // Reused by every OnSend (always on the dispatcher thread), so steady-state sends
+    // do not allocate. Declared before the thread so it outlives pending sends.
+    BufferedOutputStream sendBuffer;
+
     std::unique_ptr<Thread> dispatcherThread = std::unique_ptr<Thread>(new Thread("Dispatcher"));
 
     std::thread recvThread;
@@ -134,5 +179,10 @@ namespace kad
     Thread * owner;
 
     ContactHandler contactHandler = nullptr;
+
+    RoundTripHandler roundTripHandler = nullptr;
+
+    // Highest wire version each peer advertised in its last package (dispatcher thread only)
+    std::unique_ptr<PeerVersion[]> peerVersions = std::unique_ptr<PeerVersion[]>(new PeerVersion[PeerVersionSlots]);
   };
 }
\ No newline at end of file
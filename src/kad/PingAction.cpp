@@ -79,6 +79,8 @@ namespace kad
 
   void PingAction::OnResponse(PackagePtr request, PackagePtr response)
   {
+    PROFILE_SCOPE();
+
     if (response)
     {
       Instruction * instr = response->GetInstruction();
@@ -31,6 +31,7 @@
 #include "Package.h"
 #include "Config.h"
 #include "KBuckets.h"
+#include "Distance.h"
 #include "PackageDispatcher.h"
 #include "QueryLogAction.h"
 
@@ -47,12 +48,7 @@ namespace kad
     this->target = target;
     this->query = query;
 
-    for (const auto & node : nodes)
-    {
-      KeyPtr distance = std::make_shared<Key>(target->GetDistance(*node.first));
-
-      this->candidates[distance] = node;
-    }
+    Distance::Merge(* target, nodes, this->candidates);
   }
 
 
@@ -116,7 +112,7 @@ namespace kad
 
     using namespace std::placeholders;
 
-    this->validating.emplace(candidate.first);
+    this->validating.emplace(* candidate.first);
 
     protocol::QueryLog * findValue = new protocol::QueryLog();
 
@@ -136,17 +132,20 @@ namespace kad
   {
     THREAD_ENSURE(this->owner, OnResponse, key, request, response);
 
-    this->validating.erase(key);
+    PROFILE_SCOPE();
+
+    this->validating.erase(* key);
 
     if (!this->IsCompleted())
     {
       if (!response)
       {
-        this->offline.emplace(key);
+        this->offline.emplace(* key);
+        this->Fail(key);
       }
       else
       {
-        this->validated[key] = request->Target();
+        this->validated[* key] = request->Target();
 
         Instruction * instr = response->GetInstruction();
 
@@ -167,42 +166,22 @@ namespace kad
         }
         else if (instr->Code() == OpCode::FIND_NODE_RESPONSE)
         {
-          this->missed[std::make_shared<Key>(this->target->GetDistance(*key))] = std::make_pair(key, request->Target());
+          this->missed[this->target->GetDistance(*key)] = std::make_pair(key, request->Target());
 
           protocol::FindNodeResponse * findNodeResponse = static_cast<protocol::FindNodeResponse *>(instr);
 
-          for (const auto & node : findNodeResponse->Nodes())
-          {
-            KeyPtr distance = std::make_shared<Key>(this->target->GetDistance(*node.first));
-
-            this->candidates[distance] = node;
-          }
+          Distance::Merge(* this->target, findNodeResponse->Nodes(), this->candidates);
         }
       }
     }
 
     if (!this->IsCompleted())
     {
-      size_t idx = 0;
+      auto next = this->NextCandidate(this->candidates, this->offline, this->validating, this->validated);
 
-      for (const auto & candidate : this->candidates)
+      if (next)
       {
-        if (this->offline.find(candidate.second.first) != this->offline.end())
-        {
-          continue;
-        }
-
-        if ((idx++) >= KBuckets::SizeK)
-        {
-          break;
-        }
-
-        if (this->validated.find(candidate.second.first) == this->validated.end() &&
-            this->validating.find(candidate.second.first) == this->validating.end())
-        {
-          this->SendCandidate(candidate.second);
-          break;
-        }
+        this->SendCandidate(* next);
       }
 
       if (this->validating.empty())
@@ -0,0 +1,319 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace kad
+{
+  enum class QueueFullPolicy
+  {
+    Block,      // wait on a condition variable until the consumer frees a slot
+    Spin,       // yield until the consumer frees a slot
+    Reject      // fail immediately
+  };
+
+
+  // Bounded multi-producer single-consumer queue over a power-of-two ring of cells.
+  // Each cell carries a sequence number that tells producers whether it is free and
+  // the consumer whether it has been published, so neither side allocates or locks.
+  template<typename T>
+  class RingQueue
+  {
+  private:
+
+    struct Cell
+    {
+      std::atomic<size_t> sequence;
+      T value;
+    };
+
+    static const size_t CacheLine = 64;
+
+  public:
+
+    explicit RingQueue(size_t capacity = 4096, QueueFullPolicy policy = QueueFullPolicy::Block)
+      : policy(policy)
+    {
+      size_t size = 2;
+
+      while (size < capacity)
+      {
+        size <<= 1;
+      }
+
+      this->mask = size - 1;
+      this->cells = std::unique_ptr<Cell[]>(new Cell[size]);
+
+      for (size_t i = 0; i < size; ++i)
+      {
+        this->cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    RingQueue(const RingQueue &) = delete;
+
+    RingQueue & operator=(const RingQueue &) = delete;
+
+    size_t Capacity() const           { return this->mask + 1; }
+
+    QueueFullPolicy Policy() const    { return this->policy; }
+
+    size_t Size() const
+    {
+      size_t tail = this->tail.load();
+      size_t head = this->head.load();
+      return tail > head ? tail - head : 0;
+    }
+
+    bool Empty() const                { return this->Size() == 0; }
+
+    // Apply the queue's full policy. Returns false only when the value was rejected,
+    // in which case it is left untouched in value.
+    bool Produce(T & value)
+    {
+      return this->ProduceBatch(&value, 1, this->policy) == 1;
+    }
+
+    // Never waits, regardless of the queue's policy. value is only moved from on success.
+    bool TryProduce(T & value)
+    {
+      return this->ProduceBatch(&value, 1, QueueFullPolicy::Reject) == 1;
+    }
+
+    // Move count values in, claiming as many slots as are free with a single CAS
+    // each round. Returns the number produced, which is less than count only under
+    // the Reject policy; values from that index on are left untouched.
+    size_t ProduceBatch(T * values, size_t count)
+    {
+      return this->ProduceBatch(values, count, this->policy);
+    }
+
+    bool Consume(T & result)
+    {
+      size_t head = this->head.load(std::memory_order_relaxed);
+      Cell & cell = this->cells[head & this->mask];
+
+      if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+      {
+        return false;
+      }
+
+      result = std::move(cell.value);
+      cell.sequence.store(head + this->Capacity(), std::memory_order_release);
+
+      this->Publish(head + 1);
+
+      return true;
+    }
+
+    // Drain everything published before the call, invoking func(T &&) on each item
+    // in order. Each cell is handed back to producers before func runs, but head and
+    // the wakeup of blocked producers are published once for the whole batch.
+    template<typename F>
+    size_t ConsumeAll(F && func)
+    {
+      size_t start = this->head.load(std::memory_order_relaxed);
+      size_t end = this->tail.load(std::memory_order_acquire);
+      size_t head = start;
+
+      for (; head != end; ++head)
+      {
+        Cell & cell = this->cells[head & this->mask];
+
+        // Claimed by a producer but not yet written
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+        {
+          break;
+        }
+
+        T value = std::move(cell.value);
+        cell.sequence.store(head + this->Capacity(), std::memory_order_release);
+
+        func(std::move(value));
+      }
+
+      if (head != start)
+      {
+        this->Publish(head);
+      }
+
+      return head - start;
+    }
+
+  private:
+
+    size_t ProduceBatch(T * values, size_t count, QueueFullPolicy policy)
+    {
+      size_t produced = 0;
+
+      while (produced < count)
+      {
+        size_t claimed = 0;
+        size_t pos = this->Claim(count - produced, claimed);
+
+        if (claimed == 0)
+        {
+          if (!this->WaitForSpace(policy))
+          {
+            break;
+          }
+
+          continue;
+        }
+
+        for (size_t i = 0; i < claimed; ++i)
+        {
+          Cell & cell = this->cells[(pos + i) & this->mask];
+          cell.value = std::move(values[produced + i]);
+          cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+
+        produced += claimed;
+      }
+
+      return produced;
+    }
+
+    // Claim up to count consecutive slots starting at tail. The consumer frees cells
+    // in order, so if the last cell of the range is free, so is every cell before it;
+    // producers never need to read head.
+    size_t Claim(size_t count, size_t & claimed)
+    {
+      size_t pos = this->tail.load(std::memory_order_relaxed);
+      size_t n = std::min(count, this->Capacity());
+
+      while (true)
+      {
+        Cell & last = this->cells[(pos + n - 1) & this->mask];
+        size_t sequence = last.sequence.load(std::memory_order_acquire);
+
+        if (sequence == pos + n - 1)
+        {
+          // Sequentially consistent, so a producer that then checks whether the
+          // consumer is asleep cannot miss it (see EventLoop::Post)
+          if (this->tail.compare_exchange_weak(pos, pos + n))
+          {
+            claimed = n;
+            return pos;
+          }
+        }
+        else if (sequence > pos + n - 1)
+        {
+          // Another producer got here first
+          pos = this->tail.load(std::memory_order_relaxed);
+        }
+        else if (n > 1)
+        {
+          // The consumer has not freed that much room yet; ask for less
+          n = std::max<size_t>(1, n / 2);
+        }
+        else
+        {
+          // Not even the next cell is free: the ring is full
+          claimed = 0;
+          return pos;
+        }
+      }
+    }
+
+    void Publish(size_t head)
+    {
+      this->head.store(head, std::memory_order_release);
+
+      if (this->waiting.load() > 0)
+      {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->cond.notify_all();
+      }
+    }
+
+    bool WaitForSpace(QueueFullPolicy policy)
+    {
+      switch (policy)
+      {
+        case QueueFullPolicy::Reject:
+          return false;
+
+        case QueueFullPolicy::Spin:
+          std::this_thread::yield();
+          return true;
+
+        case QueueFullPolicy::Block:
+        default:
+        {
+          ++ this->waiting;
+
+          {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->cond.wait_for(lock, std::chrono::milliseconds(1), [this]() { return this->Size() < this->Capacity(); });
+          }
+
+          -- this->waiting;
+
+          return true;
+        }
+      }
+    }
+
+  private:
+
+    std::unique_ptr<Cell[]> cells;
+
+    size_t mask = 0;
+
+    QueueFullPolicy policy;
+
+    // Producers hammer tail, the consumer owns head; keep them on separate cache lines.
+    // head only advances once per drained batch and is read by Size() alone.
+
+    char padding0[CacheLine];
+
+    std::atomic<size_t> tail{0};
+
+    char padding1[CacheLine - sizeof(std::atomic<size_t>)];
+
+    std::atomic<size_t> head{0};
+
+    char padding2[CacheLine - sizeof(std::atomic<size_t>)];
+
+    std::atomic<size_t> waiting{0};
+
+    std::mutex mutex;
+
+    std::condition_variable cond;
+  };
+}
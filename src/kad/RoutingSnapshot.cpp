@@ -0,0 +1,138 @@
+/**
+ *
+ * MIT License
+ *
+ * Copyright (c) 2018 drvcoin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * =============================================================================
+ */
+
+#include <algorithm>
+#include "Bucket.h"
+#include "Distance.h"
+#include "RoutingSnapshot.h"
+
+namespace kad
+{
+  // Bit level of key counting from the most significant one, the order the tree splits in
+  static inline bool Branch(const Key & key, size_t level)
+  {
+    return (key.Buffer()[level / 8] & (0x80 >> (level % 8))) != 0;
+  }
+
+
+  size_t RoutingSnapshot::FindBucket(const Key & key) const
+  {
+    // The first bucket starts at the zero id, so there always is one at or before key
+    auto it = std::upper_bound(this->buckets.begin(), this->buckets.end(), key,
+      [](const Key & key, const Range & bucket) { return key < bucket.prefix; });
+
+    return static_cast<size_t>(it - this->buckets.begin()) - 1;
+  }
+
+
+  void RoutingSnapshot::FindClosestContacts(const Key & key, size_t count, std::vector<std::pair<KeyPtr, ContactPtr>> & result, bool restrictBucket) const
+  {
+    if (this->keys.empty())
+    {
+      return;
+    }
+
+    if (restrictBucket)
+    {
+      this->AppendClosest(key, this->FindBucket(key), count, result);
+      return;
+    }
+
+    // Contacts in the buckets not visited yet, to stop early on a sparse table
+    size_t left = this->keys.size();
+
+    this->Collect(key, 0, this->buckets.size(), 0, count, result.size(), left, result);
+  }
+
+
+  // Two buckets never overlap, so they first differ at a bit both fix, and the one that
+  // agrees with key there is closer as a whole. Walking the tree towards the side that
+  // matches key first thus visits the buckets closest first, and only the last one taken
+  // needs a partial sort.
+  bool RoutingSnapshot::Collect(const Key & key, size_t begin, size_t end, size_t level, size_t count, size_t offset, size_t & left, std::vector<std::pair<KeyPtr, ContactPtr>> & result) const
+  {
+    if (end - begin == 1)
+    {
+      const Range & bucket = this->buckets[begin];
+
+      if (bucket.begin == bucket.end)
+      {
+        return true;
+      }
+
+      this->AppendClosest(key, begin, count - (result.size() - offset), result);
+
+      left -= bucket.end - bucket.begin;
+
+      return left > 0 && result.size() - offset < count;
+    }
+
+    // With more than one bucket in the range, each fixes this bit, so both halves are
+    // non-empty
+    auto it = std::partition_point(this->buckets.begin() + begin, this->buckets.begin() + end,
+      [level](const Range & bucket) { return !Branch(bucket.prefix, level); });
+
+    size_t middle = static_cast<size_t>(it - this->buckets.begin());
+
+    if (Branch(key, level))
+    {
+      return this->Collect(key, middle, end, level + 1, count, offset, left, result)
+        && this->Collect(key, begin, middle, level + 1, count, offset, left, result);
+    }
+    else
+    {
+      return this->Collect(key, begin, middle, level + 1, count, offset, left, result)
+        && this->Collect(key, middle, end, level + 1, count, offset, left, result);
+    }
+  }
+
+
+  void RoutingSnapshot::AppendClosest(const Key & target, size_t idx, size_t limit, std::vector<std::pair<KeyPtr, ContactPtr>> & result) const
+  {
+    const Range & bucket = this->buckets[idx];
+
+    if (bucket.begin == bucket.end)
+    {
+      return;
+    }
+
+    Distance::Entry entries[Bucket::Capacity];
+
+    size_t selected = Distance::SelectClosest(target, this->keys.data() + bucket.begin, bucket.end - bucket.begin, limit, entries);
+
+    for (size_t i = 0; i < selected; ++i)
+    {
+      result.emplace_back(this->contacts[bucket.begin + entries[i].index]);
+    }
+  }
+
+
+  void RoutingSnapshot::GetAllContacts(std::vector<std::pair<KeyPtr, ContactPtr>> & result) const
+  {
+    result.insert(result.end(), this->contacts.begin(), this->contacts.end());
+  }
+}
@@ -0,0 +1,87 @@
+/**
+ *
+ * MIT License
+ *
+ * Copyright (c) 2018 drvcoin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * =============================================================================
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Key.h"
+#include "Contact.h"
+
+namespace kad
+{
+  // An immutable copy of the routing table, published by KBuckets whenever its contacts
+  // change. Any thread may read one while Main goes on changing the table: a reader holds
+  // on to the copy it got and the next copy replaces it for later readers.
+  class RoutingSnapshot
+  {
+  public:
+
+    // Appends the count contacts closest to key by XOR distance, closest first. With
+    // restrictBucket only key's own bucket is searched.
+    void FindClosestContacts(const Key & key, size_t count, std::vector<std::pair<KeyPtr, ContactPtr>> & result, bool restrictBucket = false) const;
+
+    void GetAllContacts(std::vector<std::pair<KeyPtr, ContactPtr>> & result) const;
+
+    size_t Size() const       { return this->keys.size(); }
+
+  private:
+
+    friend class KBuckets;
+
+    // A bucket of the tree: the ids whose first depth bits are those of prefix, found at
+    // [begin, end) of keys and contacts
+    struct Range
+    {
+      Key prefix;
+      size_t depth;
+      size_t begin;
+      size_t end;
+    };
+
+    size_t FindBucket(const Key & key) const;
+
+    // Visits the buckets [begin, end), which share their first level bits, closest to
+    // key first. Returns false once no more contacts are wanted.
+    bool Collect(const Key & key, size_t begin, size_t end, size_t level, size_t count, size_t offset, size_t & left, std::vector<std::pair<KeyPtr, ContactPtr>> & result) const;
+
+    // Appends the limit contacts of bucket idx closest to target, closest first
+    void AppendClosest(const Key & target, size_t idx, size_t limit, std::vector<std::pair<KeyPtr, ContactPtr>> & result) const;
+
+  private:
+
+    // Every bucket, empty ones too, ordered by prefix
+    std::vector<Range> buckets;
+
+    // The ids of all contacts, bucket after bucket
+    std::vector<Key> keys;
+
+    std::vector<std::pair<KeyPtr, ContactPtr>> contacts;
+  };
+
+  using RoutingSnapshotPtr = std::shared_ptr<const RoutingSnapshot>;
+}
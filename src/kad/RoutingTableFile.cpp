@@ -0,0 +1,215 @@
+/**
+ *
+ * MIT License
+ *
+ * Copyright (c) 2018 drvcoin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * =============================================================================
+ */
+
+
+#if !defined(WIN32) && !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "EndianUtil.h"
+#include "RoutingTableFile.h"
+
+namespace kad
+{
+  const uint32_t RoutingTableFile::MAGIC;
+
+  const uint16_t RoutingTableFile::VERSION;
+
+  const size_t RoutingTableFile::HEADER_SIZE;
+
+  const size_t RoutingTableFile::RECORD_SIZE;
+
+
+  static void put16(uint8_t * ptr, uint16_t value)
+  {
+    value = htobe16(value);
+    memcpy(ptr, & value, sizeof(value));
+  }
+
+
+  static void put32(uint8_t * ptr, uint32_t value)
+  {
+    value = htobe32(value);
+    memcpy(ptr, & value, sizeof(value));
+  }
+
+
+  static void put64(uint8_t * ptr, uint64_t value)
+  {
+    value = htobe64(value);
+    memcpy(ptr, & value, sizeof(value));
+  }
+
+
+  static uint16_t get16(const uint8_t * ptr)
+  {
+    uint16_t value;
+    memcpy(& value, ptr, sizeof(value));
+    return be16toh(value);
+  }
+
+
+  static uint32_t get32(const uint8_t * ptr)
+  {
+    uint32_t value;
+    memcpy(& value, ptr, sizeof(value));
+    return be32toh(value);
+  }
+
+
+  static uint64_t get64(const uint8_t * ptr)
+  {
+    uint64_t value;
+    memcpy(& value, ptr, sizeof(value));
+    return be64toh(value);
+  }
+
+
+  bool RoutingTableFile::Save(const TSTRING & path, const std::vector<Record> & records)
+  {
+    std::vector<uint8_t> buffer(HEADER_SIZE + RECORD_SIZE * records.size(), 0);
+    uint8_t * ptr = buffer.data();
+
+    put32(ptr, MAGIC);
+    put16(ptr + 4, VERSION);
+    put16(ptr + 6, static_cast<uint16_t>(RECORD_SIZE));
+    put32(ptr + 8, static_cast<uint32_t>(records.size()));
+
+    ptr += HEADER_SIZE;
+
+    // key 20, address 4, port 2, reserved 2, rtt 4, last seen 8
+    for (const auto & record : records)
+    {
+      memcpy(ptr, record.key.Buffer(), Key::KEY_LEN);
+      put32(ptr + 20, static_cast<uint32_t>(record.contact.addr));
+      put16(ptr + 24, static_cast<uint16_t>(record.contact.port));
+      put32(ptr + 28, record.rtt);
+      put64(ptr + 32, static_cast<uint64_t>(record.lastSeen));
+
+      ptr += RECORD_SIZE;
+    }
+
+    TSTRING temp = path + _T(".tmp");
+
+    FILE * file = _tfopen(temp.c_str(), _T("wb"));
+
+    if (!file)
+    {
+      return false;
+    }
+
+    bool result = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size() && fflush(file) == 0;
+
+#if !defined(WIN32) && !defined(_WIN32)
+    // The data must be on disk before the rename makes it the table
+    result = result && fsync(fileno(file)) == 0;
+#endif
+
+    result = fclose(file) == 0 && result;
+
+#if defined(WIN32) || defined(_WIN32)
+    // rename does not replace an existing file here
+    if (result)
+    {
+      _tunlink(path.c_str());
+    }
+#endif
+
+    if (!result || _trename(temp.c_str(), path.c_str()) != 0)
+    {
+      _tunlink(temp.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+
+  bool RoutingTableFile::Load(const TSTRING & path, std::vector<Record> & records)
+  {
+    FILE * file = _tfopen(path.c_str(), _T("rb"));
+
+    if (!file)
+    {
+      return false;
+    }
+
+    uint8_t header[HEADER_SIZE];
+
+    if (fread(header, 1, HEADER_SIZE, file) != HEADER_SIZE ||
+        get32(header) != MAGIC || get16(header + 4) != VERSION || get16(header + 6) != RECORD_SIZE)
+    {
+      fclose(file);
+      return false;
+    }
+
+    size_t count = get32(header + 8);
+
+    // A file cut short or grown past its header is not trusted, and a damaged count is
+    // caught before it sizes the buffer
+    if (fseek(file, 0, SEEK_END) != 0 || ftell(file) != static_cast<long>(HEADER_SIZE + RECORD_SIZE * count) ||
+        fseek(file, HEADER_SIZE, SEEK_SET) != 0)
+    {
+      fclose(file);
+      return false;
+    }
+
+    std::vector<uint8_t> buffer(RECORD_SIZE * count);
+
+    size_t read = fread(buffer.data(), 1, buffer.size(), file);
+
+    fclose(file);
+
+    if (read != buffer.size())
+    {
+      return false;
+    }
+
+    const uint8_t * ptr = buffer.data();
+
+    records.reserve(records.size() + count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      Record record;
+
+      record.key = Key(ptr);
+      record.contact.addr = get32(ptr + 20);
+      record.contact.port = get16(ptr + 24);
+      record.rtt = get32(ptr + 28);
+      record.lastSeen = static_cast<int64_t>(get64(ptr + 32));
+
+      records.emplace_back(record);
+
+      ptr += RECORD_SIZE;
+    }
+
+    return true;
+  }
+}
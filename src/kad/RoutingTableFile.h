@@ -0,0 +1,73 @@
+/**
+ *
+ * MIT License
+ *
+ * Copyright (c) 2018 drvcoin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * =============================================================================
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "Key.h"
+#include "Contact.h"
+#include "PlatformUtils.h"
+
+namespace kad
+{
+  // The routing table on disk: a 16 byte header and then one 40 byte record per contact,
+  // all big-endian. Loading is a single read and a check of the length; saving writes a
+  // temporary file and renames it over the old one, so a crash leaves either table whole.
+  class RoutingTableFile
+  {
+  public:
+
+    static const uint32_t MAGIC = 0x4B414452;     // "KADR"
+
+    static const uint16_t VERSION = 1;
+
+    static const size_t HEADER_SIZE = 16;
+
+    static const size_t RECORD_SIZE = 40;
+
+    struct Record
+    {
+      Key key;
+      Contact contact;
+
+      // Smoothed round trip in microseconds, 0 when unknown
+      uint32_t rtt = 0;
+
+      // Seconds since the Unix epoch
+      int64_t lastSeen = 0;
+    };
+
+  public:
+
+    static bool Save(const TSTRING & path, const std::vector<Record> & records);
+
+    // Fails on a missing, short or foreign file, leaving records as they were
+    static bool Load(const TSTRING & path, std::vector<Record> & records);
+  };
+}
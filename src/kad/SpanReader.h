@@ -0,0 +1,251 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include "Arena.h"
+#include "Buffer.h"
+#include "EndianUtil.h"
+
+namespace kad
+{
+  // Non-virtual, bounds-checked big-endian reader over a contiguous byte range. This is
+  // what the protocol decoders use; every read either succeeds completely or leaves
+  // the reader where it was and returns false.
+  //
+  // When constructed over a Buffer, ReadBuffer returns slices of it instead of copies.
+  class SpanReader
+  {
+  public:
+
+    SpanReader(const void * data, size_t length)
+      : begin(static_cast<const uint8_t *>(data))
+      , cursor(begin)
+      , end(begin + length)
+    {
+    }
+
+    explicit SpanReader(BufferPtr buffer)
+      : SpanReader(buffer ? buffer->Data() : nullptr, buffer ? buffer->Size() : 0)
+    {
+      this->backing = std::move(buffer);
+    }
+
+    // A reader over data that lies at offset within backing
+    SpanReader(BufferPtr backing, size_t offset, size_t length)
+      : SpanReader(static_cast<const uint8_t *>(backing->Data()) + offset, length)
+    {
+      this->backing = std::move(backing);
+    }
+
+    size_t Length() const       { return this->end - this->begin; }
+
+    size_t Offset() const       { return this->cursor - this->begin; }
+
+    size_t Remainder() const    { return this->end - this->cursor; }
+
+    const uint8_t * Data() const    { return this->cursor; }
+
+    template<typename T>
+    bool Peek(T & value) const
+    {
+      static_assert(std::is_integral<T>::value, "SpanReader reads integral types only");
+
+      if (this->Remainder() < sizeof(T))
+      {
+        return false;
+      }
+
+      value = Load<T>(this->cursor);
+      return true;
+    }
+
+    template<typename T>
+    bool Read(T & value)
+    {
+      if (!this->Peek(value))
+      {
+        return false;
+      }
+
+      this->cursor += sizeof(T);
+      return true;
+    }
+
+    // Unsigned LEB128. Fails on truncated input and on values that do not fit in T.
+    template<typename T>
+    bool PeekVarUInt(T & value) const
+    {
+      return this->DecodeVarUInt(value) > 0;
+    }
+
+    template<typename T>
+    bool ReadVarUInt(T & value)
+    {
+      size_t length = this->DecodeVarUInt(value);
+      this->cursor += length;
+      return length > 0;
+    }
+
+    bool Read(void * buffer, size_t length)
+    {
+      if (this->Remainder() < length)
+      {
+        return false;
+      }
+
+      memcpy(buffer, this->cursor, length);
+      this->cursor += length;
+      return true;
+    }
+
+    bool Skip(size_t length)
+    {
+      if (this->Remainder() < length)
+      {
+        return false;
+      }
+
+      this->cursor += length;
+      return true;
+    }
+
+    // Step back over bytes already read
+    void Rewind(size_t length)
+    {
+      this->cursor -= length < this->Offset() ? length : this->Offset();
+    }
+
+    // A uint32 length followed by that many bytes
+    bool ReadString(std::string & str)
+    {
+      uint32_t length = 0;
+
+      if (!this->Peek(length) || this->Remainder() - sizeof(length) < length)
+      {
+        return false;
+      }
+
+      this->cursor += sizeof(length);
+      str.assign(reinterpret_cast<const char *>(this->cursor), length);
+      this->cursor += length;
+      return true;
+    }
+
+    // Returns nullptr if fewer than length bytes remain
+    BufferPtr ReadBuffer(size_t length)
+    {
+      if (this->Remainder() < length)
+      {
+        return nullptr;
+      }
+
+      BufferPtr result;
+
+      if (this->backing)
+      {
+        size_t offset = this->cursor - static_cast<const uint8_t *>(this->backing->Data());
+        result = Arena::MakeShared<Buffer>(this->backing, offset, length);
+      }
+      else
+      {
+        result = Arena::MakeShared<Buffer>(this->cursor, length, true, true);
+      }
+
+      this->cursor += length;
+      return result;
+    }
+
+  private:
+
+    // Returns the number of bytes the varint occupies, or 0 if it is malformed
+    template<typename T>
+    size_t DecodeVarUInt(T & value) const
+    {
+      static_assert(std::is_unsigned<T>::value, "varints decode to unsigned types");
+
+      const size_t bits = sizeof(T) * 8;
+
+      uint64_t result = 0;
+      size_t remainder = this->Remainder();
+
+      for (size_t i = 0, shift = 0; i < remainder && shift < bits; ++i, shift += 7)
+      {
+        uint64_t group = this->cursor[i] & 0x7F;
+
+        // The last group may only fill the bits left in T
+        if (bits - shift < 7 && (group >> (bits - shift)) != 0)
+        {
+          return 0;
+        }
+
+        result |= group << shift;
+
+        if ((this->cursor[i] & 0x80) == 0)
+        {
+          value = static_cast<T>(result);
+          return i + 1;
+        }
+      }
+
+      return 0;
+    }
+
+    template<typename T>
+    static T Load(const uint8_t * ptr)
+    {
+      using U = typename std::make_unsigned<T>::type;
+
+      U value;
+      memcpy(& value, ptr, sizeof(value));
+
+      return static_cast<T>(Swap(value));
+    }
+
+    static uint8_t Swap(uint8_t value)      { return value; }
+
+    static uint16_t Swap(uint16_t value)    { return be16toh(value); }
+
+    static uint32_t Swap(uint32_t value)    { return be32toh(value); }
+
+    static uint64_t Swap(uint64_t value)    { return be64toh(value); }
+
+  private:
+
+    const uint8_t * begin;
+
+    const uint8_t * cursor;
+
+    const uint8_t * end;
+
+    BufferPtr backing;
+  };
+}
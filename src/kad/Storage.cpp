@@ -28,10 +28,13 @@
 #include <stdio.h>
 #include <io.h>
 #else
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <dirent.h>
 #endif
 
+#include <stdlib.h>
 #include <string>
 #include <vector>
 #include <chrono>
@@ -122,8 +125,92 @@ namespace kad
   }
 
 
+  // Write size bytes straight from data to a new file, without stdio's intermediate
+  // buffer: the payload is copied once, into the page cache.
+  static bool write_file(const TSTRING & path, const void * data, size_t size)
+  {
+#if defined(WIN32) || defined(_WIN32)
+    FILE * file = _tfopen(path.c_str(), _T("wb"));
+
+    if (!file)
+    {
+      return false;
+    }
+
+    bool result = fwrite(data, 1, size, file) == size;
+
+    fclose(file);
+
+    return result;
+#else
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    const uint8_t * ptr = static_cast<const uint8_t *>(data);
+
+    while (size > 0)
+    {
+      ssize_t written = write(fd, ptr, size);
+
+      if (written < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (written <= 0)
+      {
+        close(fd);
+        return false;
+      }
+
+      ptr += written;
+      size -= written;
+    }
+
+    return close(fd) == 0;
+#endif
+  }
+
+
+  // Splits a "<expiration>-<version>-<key>" file name; key points into name
+  static bool parse_file_name(const char * name, long long & expiration, unsigned long long & version, const char * & key)
+  {
+    char * end = nullptr;
+
+    expiration = strtoll(name, &end, 10);
+
+    if (end == name || * end != '-')
+    {
+      return false;
+    }
+
+    name = end + 1;
+    version = strtoull(name, &end, 10);
+
+    if (end == name || * end != '-' || end[1] == '\0')
+    {
+      return false;
+    }
+
+    key = end + 1;
+
+    return true;
+  }
+
+
   void Storage::Initialize(bool load)
   {
+    std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
+    // Whatever is on disk is the truth, also when initialized again
+    this->index.clear();
+    this->timestamps.clear();
+    this->expirations.clear();
+
     std::vector<std::string> names;
 
 #if defined(WIN32) || defined(_WIN32)
@@ -153,11 +240,11 @@ namespace kad
 
       for (const auto & name : names)
       {
-        char keyname[PATH_MAX];
+        const char * keyname = nullptr;
         long long expiration;
         unsigned long long version;
 
-        if (sscanf(name.c_str(), "%lld-%llu-%s", &expiration, &version, keyname) == 3)
+        if (parse_file_name(name.c_str(), expiration, version, keyname))
         {
           if (expiration < now)
           {
@@ -167,9 +254,9 @@ namespace kad
           }
           else
           {
-            KeyPtr key = std::make_shared<Key>();
+            Key key;
 
-            if (key->FromString(keyname))
+            if (key.FromString(keyname))
             {
               this->index[key] = {
                 .version = version,
@@ -195,7 +282,7 @@ namespace kad
   }
 
 
-  TSTRING Storage::GetFileName(KeyPtr key, uint64_t version, int64_t expiration) const
+  TSTRING Storage::GetFileName(const Key & key, uint64_t version, int64_t expiration) const
   {
     TCHAR path[PATH_MAX];
     _stprintf(path, _T("%s%s%lld-%llu-%s"),
@@ -203,7 +290,7 @@ namespace kad
       PATH_SEPERATOR_STR,
       static_cast<long long>(expiration),
       static_cast<unsigned long long>(version),
-      _TS(key->ToString()).c_str()
+      _TS(key.ToString()).c_str()
     );
 
     return path;
@@ -212,12 +299,14 @@ namespace kad
 
   bool Storage::GetVersion(KeyPtr key, uint64_t * result) const
   {
+    std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
     if (!key)
     {
       return false;
     }
 
-    auto itr = this->index.find(key);
+    auto itr = this->index.find(* key);
     if (itr == this->index.end())
     {
       return false;
@@ -250,12 +339,14 @@ namespace kad
 
   bool Storage::GetExpiration(KeyPtr key, int64_t * result) const
   {
+    std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
     if (!key)
     {
       return false;
     }
 
-    auto itr = this->index.find(key);
+    auto itr = this->index.find(* key);
     if (itr == this->index.end())
     {
       return false;
@@ -272,6 +363,8 @@ namespace kad
 
   bool Storage::Save(KeyPtr key, uint64_t version, BufferPtr content, int64_t ttl)
   {
+    std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
     if (!key || !content || !content->Data() || content->Size() == 0)
     {
       return false;
@@ -293,23 +386,7 @@ namespace kad
       return false;
     }
 
-    FILE * file = _tfopen(this->GetFileName(key, version, expiration).c_str(), _T("wb"));
-
-    if (!file)
-    {
-      return false;
-    }
-
-    bool result = false;
-
-    if (content->Size() > 0)
-    {
-      result = fwrite(content->Data(), 1, content->Size(), file) == content->Size();
-    }
-
-    fclose(file);
-
-    return result;
+    return write_file(this->GetFileName(* key, version, expiration), content->Data(), content->Size());
   }
 
   bool Storage::SaveLog(KeyPtr key, uint64_t version, BufferPtr content, int64_t ttl)
@@ -321,20 +398,25 @@ namespace kad
 
     Json::Value json;
     Json::Reader reader;
-    if (!reader.parse((char*)content->Data(), content->Size(), json, false))
+    if (!reader.parse((char*)content->Data(), (char*)content->Data() + content->Size(), json, false))
     {
       return false;
     }
 
     if (json.isObject())
     {
-      this->UpdateTTL(key, ttl);
-      this->UpdateTimestamp(key, get_now());
-
       int64_t expiration;
-      if (!this->GetExpiration(key, &expiration))
+
       {
-        return false;
+        std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
+        this->UpdateTTL(key, ttl);
+        this->UpdateTimestamp(key, get_now());
+
+        if (!this->GetExpiration(key, &expiration))
+        {
+          return false;
+        }
       }
 
       std::string keyStr;
@@ -345,23 +427,7 @@ namespace kad
       Digest::Compute(keyStr.c_str(), keyStr.size(), digest);
       KeyPtr fileKey = std::make_shared<Key>(digest);
 
-      FILE * file = _tfopen(this->GetFileName(fileKey, 0, expiration).c_str(), _T("wb"));
-
-      if (!file)
-      {
-        return false;
-      }
-
-      bool result = false;
-
-      if (content->Size() > 0)
-      {
-        result = fwrite(content->Data(), 1, content->Size(), file) == content->Size();
-      }
-
-      fclose(file);
-
-      return result;
+      return write_file(this->GetFileName(* fileKey, 0, expiration), content->Data(), content->Size());
     }
     else if (json.isArray())
     {
@@ -376,7 +442,7 @@ namespace kad
           int64_t expiration = json[i]["_expiration"].asInt();
           int64_t fileNameExpiration = expiration - std::chrono::time_point_cast<std::chrono::seconds>(std::chrono::system_clock::now()).time_since_epoch().count() + get_now();
 
-          std::string fileName = this->GetFileName(fileKey, 0, fileNameExpiration);
+          std::string fileName = this->GetFileName(* fileKey, 0, fileNameExpiration);
 
           struct stat stat_buf;
           if (_tstat(fileName.c_str(), &stat_buf) == 0)
@@ -384,12 +450,6 @@ namespace kad
             continue;
           }
 
-          FILE * file = _tfopen(fileName.c_str(), _T("wb"));
-          if (!file)
-          {
-            return false;
-          }
-
           json[i].removeMember("_key");
           json[i].removeMember("_version");
           json[i].removeMember("_expiration");
@@ -397,12 +457,7 @@ namespace kad
           Json::FastWriter writer;
           auto jsonStr = writer.write(json[i]);
 
-          bool ok;
-          ok = fwrite((uint8_t*)jsonStr.c_str(), 1, jsonStr.size(), file) == jsonStr.size();
-
-          fclose(file);
-
-          if (!ok)
+          if (!write_file(fileName, jsonStr.c_str(), jsonStr.size()))
           {
             return false;
           }
@@ -460,7 +515,7 @@ namespace kad
             {
               Json::Value target;
               Json::Reader reader;
-              if (reader.parse(buf, len, target) && query.Match(target))
+              if (reader.parse(buf, buf + len, target) && query.Match(target))
               {
                 int64_t ttl = expiration - get_now();
                 auto timestamp = ttl + std::chrono::time_point_cast<std::chrono::seconds>(std::chrono::system_clock::now()).time_since_epoch().count();
@@ -494,18 +549,20 @@ namespace kad
 
   BufferPtr Storage::Load(KeyPtr key) const
   {
+    std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
     if (!key)
     {
       return nullptr;
     }
 
-    auto itr = this->index.find(key);
+    auto itr = this->index.find(* key);
     if (itr == this->index.end())
     {
       return nullptr;
     }
 
-    auto path = this->GetFileName(key, itr->second.version, itr->second.expiration);
+    auto path = this->GetFileName(* key, itr->second.version, itr->second.expiration);
 
     struct stat stat_buf;
 
@@ -543,6 +600,8 @@ namespace kad
 
   void Storage::Invalidate()
   {
+    std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
     int64_t now = get_now();
 
     auto start = this->expirations.begin();
@@ -559,7 +618,7 @@ namespace kad
         auto range = this->timestamps.equal_range(itr->second.timestamp);
         for (auto ts = range.first; ts != range.second; ++ts)
         {
-          if ((*ts->second) == (*itr->first))
+          if (ts->second == itr->first)
           {
             this->timestamps.erase(ts);
             break;
@@ -579,14 +638,16 @@ namespace kad
 
   void Storage::UpdateVersion(KeyPtr key, uint64_t version)
   {
-    auto idx = this->index.find(key);
+    std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
+    auto idx = this->index.find(* key);
     if (idx != this->index.end())
     {
       if (idx->second.version != version)
       {
         _trename(
-          this->GetFileName(key, idx->second.version, idx->second.expiration).c_str(),
-          this->GetFileName(key, version, idx->second.expiration).c_str()
+          this->GetFileName(* key, idx->second.version, idx->second.expiration).c_str(),
+          this->GetFileName(* key, version, idx->second.expiration).c_str()
         );
 
         idx->second.version = version;
@@ -594,26 +655,28 @@ namespace kad
     }
     else
     {
-      this->index[key] = {
+      this->index[* key] = {
         .version = version,
         .timestamp = 0,
         .expiration = 0
       };
-      this->timestamps.emplace(0, key);
-      this->expirations.emplace(0, key);
+      this->timestamps.emplace(0, * key);
+      this->expirations.emplace(0, * key);
     }
   }
 
 
   void Storage::UpdateTTL(KeyPtr key, int64_t ttl)
   {
+    std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
     int64_t now = get_now();
 
     ttl = std::min<int64_t>(ttl, std::numeric_limits<int64_t>::max() - now);
 
     int64_t expiration = now + ttl;
 
-    auto idx = this->index.find(key);
+    auto idx = this->index.find(* key);
 
     if (idx != this->index.end())
     {
@@ -622,7 +685,7 @@ namespace kad
         auto range = this->expirations.equal_range(idx->second.expiration);
         for (auto itr = range.first; itr != range.second; ++itr)
         {
-          if ((*key) == (*itr->second))
+          if (itr->second == (* key))
           {
             this->expirations.erase(itr);
             break;
@@ -630,35 +693,37 @@ namespace kad
         }
 
         _trename(
-          this->GetFileName(key, idx->second.version, idx->second.expiration).c_str(),
-          this->GetFileName(key, idx->second.version, expiration).c_str()
+          this->GetFileName(* key, idx->second.version, idx->second.expiration).c_str(),
+          this->GetFileName(* key, idx->second.version, expiration).c_str()
         );
 
         idx->second.expiration = expiration;
-        this->expirations.emplace(expiration, key);
+        this->expirations.emplace(expiration, * key);
       }
     }
     else
     {
-      this->index[key] = {
+      this->index[* key] = {
         .version = 0,
         .timestamp = 0,
         .expiration = expiration
       };
-      this->timestamps.emplace(0, key);
-      this->expirations.emplace(expiration, key);
+      this->timestamps.emplace(0, * key);
+      this->expirations.emplace(expiration, * key);
     }
   }
 
 
   void Storage::UpdateTimestamp(KeyPtr key, int64_t timestamp)
   {
+    std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
     if (timestamp < 0)
     {
       timestamp = get_now();
     }
 
-    auto idx = this->index.find(key);
+    auto idx = this->index.find(* key);
     if (idx != this->index.end())
     {
       if (idx->second.timestamp != timestamp)
@@ -666,32 +731,34 @@ namespace kad
         auto range = this->timestamps.equal_range(idx->second.timestamp);
         for (auto itr = range.first; itr != range.second; ++itr)
         {
-          if ((*key) == (*itr->second))
+          if (itr->second == (* key))
           {
             this->timestamps.erase(itr);
             break;
           }
         }
-      }
 
-      idx->second.timestamp = timestamp;
-      this->timestamps.emplace(timestamp, key);
+        idx->second.timestamp = timestamp;
+        this->timestamps.emplace(timestamp, * key);
+      }
     }
     else
     {
-      this->index[key] = {
+      this->index[* key] = {
         .version = 0,
         .timestamp = timestamp,
         .expiration = 0
       };
-      this->timestamps.emplace(timestamp, key);
-      this->expirations.emplace(0, key);
+      this->timestamps.emplace(timestamp, * key);
+      this->expirations.emplace(0, * key);
     }
   }
 
 
   void Storage::GetIdleKeys(std::vector<KeyPtr> & result, uint32_t period)
   {
+    std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
     int64_t criteria = std::max<int64_t>(0, get_now() - period);
 
     for (const auto & pair : this->timestamps)
@@ -701,7 +768,7 @@ namespace kad
         break;
       }
 
-      result.emplace_back(pair.second);
+      result.emplace_back(std::make_shared<Key>(pair.second));
     }
   }
 }
@@ -29,7 +29,9 @@
 
 #include <map>
 #include <vector>
+#include <mutex>
 #include "Key.h"
+#include "FlatMap.h"
 #include "Buffer.h"
 #include "PlatformUtils.h"
 
@@ -90,7 +92,7 @@ namespace kad
 
   private:
 
-    TSTRING GetFileName(KeyPtr key, uint64_t version, int64_t expiration) const;
+    TSTRING GetFileName(const Key & key, uint64_t version, int64_t expiration) const;
 
     static TSTRING Mkdir(const TCHAR * name);
 
@@ -106,10 +108,16 @@ namespace kad
 
     TSTRING folder;
 
-    std::map<KeyPtr, Entry, KeyCompare> index;
+    // Guards the maps below. Storage is mostly used on the Main thread, but SaveLog
+    // and MatchQuery also run on the compute pool.
+    mutable std::recursive_mutex mutex;
 
-    std::multimap<int64_t, KeyPtr> timestamps;
+    // Keys are held by value in an open-addressing table: a lookup is one hash and
+    // usually a single slot, with no pointer to follow
+    FlatMap<Key, Entry, KeyHash> index;
 
-    std::multimap<int64_t, KeyPtr> expirations;
+    std::multimap<int64_t, Key> timestamps;
+
+    std::multimap<int64_t, Key> expirations;
   };
 }
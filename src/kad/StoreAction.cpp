@@ -46,7 +46,7 @@ namespace kad
   {
     for (const auto & node : nodes)
     {
-      this->targets[node.first] = node.second;
+      this->targets[* node.first] = node;
     }
 
     this->key = key;
@@ -68,7 +68,7 @@ namespace kad
         break;
       }
 
-      this->Send(target);
+      this->Send(target.second);
     }
 
     return idx > 0;
@@ -107,7 +107,7 @@ namespace kad
 
     PackagePtr package = std::make_shared<Package>(Package::PackageType::Request, Config::NodeId(), node.second, std::unique_ptr<Instruction>(instr));
 
-    this->processing.emplace(node.first);
+    this->processing.emplace(* node.first);
 
     this->dispatcher->Send(package, std::bind(&StoreAction::OnResponse, this, node.first, _1, _2));
   }
@@ -117,9 +117,11 @@ namespace kad
   {
     THREAD_ENSURE(this->owner, OnResponse, key, request, response);
 
-    this->processing.erase(key);
+    PROFILE_SCOPE();
 
-    this->targets.erase(key);
+    this->processing.erase(* key);
+
+    this->targets.erase(* key);
 
     if (response)
     {
@@ -151,7 +153,7 @@ namespace kad
         {
           if (this->processing.find(node.first) == this->processing.end())
           {
-            this->Send(node);
+            this->Send(node.second);
             break;
           }
         }
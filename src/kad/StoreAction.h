@@ -68,9 +68,9 @@ namespace kad
 
     bool original = false;
 
-    std::map<KeyPtr, ContactPtr, KeyCompare> targets;
+    std::map<Key, std::pair<KeyPtr, ContactPtr>> targets;
 
-    std::set<KeyPtr, KeyCompare> processing;
+    std::set<Key> processing;
 
     bool result = false;
 
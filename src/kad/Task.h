@@ -0,0 +1,324 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Thread.h"
+
+namespace kad
+{
+  template<typename T>
+  class Task;
+
+
+  namespace TaskHelper
+  {
+    template<typename R>
+    struct Traits
+    {
+      using Type = R;
+
+      template<typename F, typename V, typename N>
+      static void Run(F & func, const V & value, N & next)
+      {
+        next.Complete(func(value));
+      }
+    };
+
+    // A continuation returning a task is flattened into that task
+    template<typename U>
+    struct Traits<Task<U>>
+    {
+      using Type = U;
+
+      template<typename F, typename V, typename N>
+      static void Run(F & func, const V & value, N & next)
+      {
+        func(value).OnComplete([next](const U & result) mutable { next.Complete(result); });
+      }
+    };
+
+    // A continuation returning nothing completes with true
+    template<>
+    struct Traits<void>
+    {
+      using Type = bool;
+
+      template<typename F, typename V, typename N>
+      static void Run(F & func, const V & value, N & next)
+      {
+        func(value);
+        next.Complete(true);
+      }
+    };
+
+
+    template<typename T>
+    struct Window
+    {
+      std::mutex mutex;
+      std::vector<T> values;
+      size_t next = 0;
+      size_t remaining = 0;
+      std::function<Task<T>(size_t)> start;
+      Task<std::vector<T>> result;
+
+      // Starts the next task, which starts the one after it when it completes
+      static void Launch(std::shared_ptr<Window> window)
+      {
+        std::unique_lock<std::mutex> lock(window->mutex);
+
+        if (window->next >= window->values.size())
+        {
+          return;
+        }
+
+        size_t i = window->next++;
+
+        lock.unlock();
+
+        window->start(i).OnComplete([window, i](const T & value)
+        {
+          std::unique_lock<std::mutex> lock(window->mutex);
+
+          window->values[i] = value;
+
+          if (-- window->remaining == 0)
+          {
+            lock.unlock();
+            window->result.Complete(std::move(window->values));
+            return;
+          }
+
+          lock.unlock();
+
+          Launch(window);
+        });
+      }
+    };
+  }
+
+
+  // The result of an asynchronous operation, bound to the thread its continuations
+  // run on. Completing a task posts every continuation to the owner's event loop, so
+  // multi-step flows read top to bottom instead of through nested callbacks, and
+  // several tasks can be in flight at once and joined with WhenAll.
+  template<typename T>
+  class Task
+  {
+  private:
+
+    struct State
+    {
+      std::mutex mutex;
+      bool completed = false;
+      T value = {};
+      std::vector<std::function<void(const T &)>> continuations;
+    };
+
+  public:
+
+    using ValueType = T;
+
+    // Continuations run on owner, or inline on the completing thread if owner is null
+    explicit Task(Thread * owner = nullptr)
+      : state(std::make_shared<State>())
+      , owner(owner)
+    {
+    }
+
+    static Task FromResult(T value, Thread * owner = nullptr)
+    {
+      Task task(owner);
+      task.Complete(std::move(value));
+      return task;
+    }
+
+    Thread * Owner() const        { return this->owner; }
+
+    bool IsCompleted() const
+    {
+      std::unique_lock<std::mutex> lock(this->state->mutex);
+      return this->state->completed;
+    }
+
+    // Only meaningful once IsCompleted() is true
+    const T & Result() const      { return this->state->value; }
+
+    void Complete(T value) const
+    {
+      std::vector<std::function<void(const T &)>> continuations;
+
+      {
+        std::unique_lock<std::mutex> lock(this->state->mutex);
+
+        if (this->state->completed)
+        {
+          return;
+        }
+
+        this->state->value = std::move(value);
+        this->state->completed = true;
+
+        continuations.swap(this->state->continuations);
+      }
+
+      for (auto & continuation : continuations)
+      {
+        this->Post(std::move(continuation));
+      }
+    }
+
+    void OnComplete(std::function<void(const T &)> continuation) const
+    {
+      {
+        std::unique_lock<std::mutex> lock(this->state->mutex);
+
+        if (!this->state->completed)
+        {
+          this->state->continuations.emplace_back(std::move(continuation));
+          return;
+        }
+      }
+
+      this->Post(std::move(continuation));
+    }
+
+    template<typename F, typename R = typename std::result_of<F(const T &)>::type>
+    Task<typename TaskHelper::Traits<R>::Type> Then(F func) const
+    {
+      Task<typename TaskHelper::Traits<R>::Type> next(this->owner);
+
+      this->OnComplete([func, next](const T & value) mutable
+      {
+        TaskHelper::Traits<R>::Run(func, value, next);
+      });
+
+      return next;
+    }
+
+  private:
+
+    void Post(std::function<void(const T &)> continuation) const
+    {
+      auto state = this->state;
+
+      if (this->owner)
+      {
+        this->owner->BeginInvoke([state, continuation](void *, void *) { continuation(state->value); }, nullptr, nullptr, "Task::Then");
+      }
+      else
+      {
+        continuation(state->value);
+      }
+    }
+
+  private:
+
+    std::shared_ptr<State> state;
+
+    Thread * owner;
+  };
+
+
+  // Completes on owner with every result, in the order of the input tasks
+  template<typename T>
+  inline Task<std::vector<T>> WhenAll(const std::vector<Task<T>> & tasks, Thread * owner)
+  {
+    Task<std::vector<T>> result(owner);
+
+    if (tasks.empty())
+    {
+      result.Complete({});
+      return result;
+    }
+
+    struct Join
+    {
+      std::mutex mutex;
+      std::vector<T> values;
+      size_t remaining;
+    };
+
+    auto join = std::make_shared<Join>();
+    join->values.resize(tasks.size());
+    join->remaining = tasks.size();
+
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+      tasks[i].OnComplete([join, result, i](const T & value)
+      {
+        std::unique_lock<std::mutex> lock(join->mutex);
+
+        join->values[i] = value;
+
+        if (-- join->remaining == 0)
+        {
+          lock.unlock();
+          result.Complete(std::move(join->values));
+        }
+      });
+    }
+
+    return result;
+  }
+
+
+  // Runs start(0) to start(count - 1) with at most limit of the tasks in flight, starting
+  // the next one as each completes. Completes on owner with every result, in index order.
+  template<typename T>
+  inline Task<std::vector<T>> WhenAllLimited(size_t count, size_t limit, std::function<Task<T>(size_t)> start, Thread * owner)
+  {
+    Task<std::vector<T>> result(owner);
+
+    if (count == 0)
+    {
+      result.Complete({});
+      return result;
+    }
+
+    auto window = std::make_shared<TaskHelper::Window<T>>();
+    window->values.resize(count);
+    window->remaining = count;
+    window->start = std::move(start);
+    window->result = result;
+
+    for (size_t i = 0; i < std::min(count, std::max<size_t>(limit, 1)); ++i)
+    {
+      TaskHelper::Window<T>::Launch(window);
+    }
+
+    return result;
+  }
+}
@@ -27,6 +27,7 @@
 
 #include <string.h>
 #include "Thread.h"
+#include "ThreadConfig.h"
 
 namespace kad
 {
@@ -94,15 +95,32 @@ namespace kad
   }
 
 
-  void Thread::BeginInvoke(EventHandler handler, void * sender, void * args)
+  void Thread::PrintProfiles()
   {
-    this->eventLoop->BeginInvoke(handler, sender, args);
+    std::unique_lock<std::mutex> lock(Thread::threadsMutex);
+
+    for (auto thread : Thread::threads)
+    {
+      thread->PrintProfile();
+    }
   }
 
 
-  void Thread::Invoke(EventHandler handler, void * sender, void * args)
+  void Thread::BeginInvoke(EventHandler handler, void * sender, void * args, const char * tag)
   {
-    this->eventLoop->Invoke(handler, sender, args);
+    this->eventLoop->BeginInvoke(handler, sender, args, tag);
+  }
+
+
+  void Thread::Invoke(EventHandler handler, void * sender, void * args, const char * tag)
+  {
+    this->eventLoop->Invoke(handler, sender, args, tag);
+  }
+
+
+  void Thread::PrintProfile() const
+  {
+    this->eventLoop->PrintProfile(this->name);
   }
 
 
@@ -110,6 +128,8 @@ namespace kad
   {
     Thread::current = _this;
 
+    ThreadConfig::Apply(_this->name);
+
     eventLoop->Run();
   }
 
@@ -42,6 +42,8 @@ namespace kad
 
     static Thread * Current();
 
+    static void PrintProfiles();
+
   public:
 
     explicit Thread(const char * name = nullptr);
@@ -50,9 +52,11 @@ namespace kad
 
     bool IsRunning() const;
 
-    void BeginInvoke(EventHandler handler, void * sender = nullptr, void * args = nullptr);
+    void BeginInvoke(EventHandler handler, void * sender = nullptr, void * args = nullptr, const char * tag = nullptr);
+
+    void Invoke(EventHandler handler, void * sender = nullptr, void * args = nullptr, const char * tag = nullptr);
 
-    void Invoke(EventHandler handler, void * sender = nullptr, void * args = nullptr);
+    void PrintProfile() const;
 
   private:
 
@@ -80,7 +84,7 @@ namespace kad
   { \
     if (t != kad::Thread::Current()) \
     { \
-      t->BeginInvoke([this, ##__VA_ARGS__](void *, void *) { this->func(__VA_ARGS__); }); \
+      t->BeginInvoke([this, ##__VA_ARGS__](void *, void *) { this->func(__VA_ARGS__); }, nullptr, nullptr, __PRETTY_FUNCTION__); \
       return; \
     } \
   }
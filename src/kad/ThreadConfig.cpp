@@ -0,0 +1,159 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "Config.h"
+#include "ThreadConfig.h"
+
+namespace kad
+{
+  std::map<std::string, ThreadSettings> ThreadConfig::settings;
+
+  std::mutex ThreadConfig::mutex;
+
+
+  void ThreadConfig::Set(const std::string & name, const ThreadSettings & settings)
+  {
+    std::unique_lock<std::mutex> lock(ThreadConfig::mutex);
+
+    ThreadConfig::settings[name] = settings;
+  }
+
+
+  void ThreadConfig::Remove(const std::string & name)
+  {
+    std::unique_lock<std::mutex> lock(ThreadConfig::mutex);
+
+    ThreadConfig::settings.erase(name);
+  }
+
+
+  bool ThreadConfig::Get(const std::string & name, ThreadSettings & settings)
+  {
+    std::unique_lock<std::mutex> lock(ThreadConfig::mutex);
+
+    auto itr = ThreadConfig::settings.find(name);
+
+    if (itr == ThreadConfig::settings.end())
+    {
+      return false;
+    }
+
+    settings = itr->second;
+
+    return true;
+  }
+
+
+  bool ThreadConfig::Apply(const char * name, int index)
+  {
+    if (!name)
+    {
+      return true;
+    }
+
+    bool result = true;
+
+#if defined(__linux__)
+    // The kernel keeps 15 characters plus the terminator
+    char display[16];
+
+    if (index >= 0)
+    {
+      snprintf(display, sizeof(display), "%s-%d", name, index);
+    }
+    else
+    {
+      snprintf(display, sizeof(display), "%s", name);
+    }
+
+    pthread_setname_np(pthread_self(), display);
+
+    ThreadSettings settings;
+
+    if (!ThreadConfig::Get(name, settings))
+    {
+      return true;
+    }
+
+    if (!settings.cpus.empty())
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+
+      for (int cpu : settings.cpus)
+      {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+        {
+          CPU_SET(cpu, &set);
+        }
+      }
+
+      int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+      if (err != 0)
+      {
+        if (Config::Verbose())
+        {
+          printf("Failed to set affinity for thread %s: %s\n", display, strerror(err));
+        }
+
+        result = false;
+      }
+    }
+
+    if (settings.policy >= 0)
+    {
+      sched_param param;
+      memset(&param, 0, sizeof(param));
+      param.sched_priority = settings.priority;
+
+      int err = pthread_setschedparam(pthread_self(), settings.policy, &param);
+
+      if (err != 0)
+      {
+        if (Config::Verbose())
+        {
+          printf("Failed to set scheduling for thread %s: %s\n", display, strerror(err));
+        }
+
+        result = false;
+      }
+    }
+#else
+    (void)index;
+#endif
+
+    return result;
+  }
+}
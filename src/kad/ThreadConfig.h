@@ -0,0 +1,74 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace kad
+{
+  struct ThreadSettings
+  {
+    // CPUs the thread may run on. Empty leaves placement to the scheduler.
+    std::vector<int> cpus;
+
+    // SCHED_OTHER, SCHED_FIFO, SCHED_RR, ... or -1 to keep the inherited policy
+    int policy = -1;
+
+    int priority = 0;
+  };
+
+
+  // Placement for the node's threads, keyed by thread name: "Main", "Dispatcher",
+  // "Recv", "Compute", and the timers "RefreshTimer" and "DispatchTimer". Settings
+  // must be registered before the owning objects are created; each thread applies
+  // its own entry when it starts.
+  class ThreadConfig
+  {
+  public:
+
+    static void Set(const std::string & name, const ThreadSettings & settings);
+
+    static void Remove(const std::string & name);
+
+    static bool Get(const std::string & name, ThreadSettings & settings);
+
+    // Name the calling thread and apply the settings registered under name. Threads
+    // sharing one entry pass their index so they stay distinguishable in /proc.
+    // Returns false if the OS refused any of the settings.
+    static bool Apply(const char * name, int index = -1);
+
+  private:
+
+    static std::map<std::string, ThreadSettings> settings;
+
+    static std::mutex mutex;
+  };
+}
@@ -0,0 +1,202 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#include <assert.h>
+#include <algorithm>
+#include "Thread.h"
+#include "ThreadConfig.h"
+#include "ThreadPool.h"
+
+namespace kad
+{
+  thread_local ThreadPool * ThreadPool::currentPool = nullptr;
+
+  thread_local size_t ThreadPool::currentWorker = 0;
+
+
+  ThreadPool::ThreadPool(size_t count, const char * name)
+    : name(name ? name : "")
+  {
+    if (count == 0)
+    {
+      count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      this->workers.emplace_back(std::unique_ptr<Worker>(new Worker()));
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      this->workers[i]->thread = std::thread(&ThreadPool::WorkerProc, this, i);
+    }
+  }
+
+
+  ThreadPool::~ThreadPool()
+  {
+    this->quit = true;
+
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->cond.notify_all();
+    }
+
+    for (auto & worker : this->workers)
+    {
+      if (worker->thread.joinable())
+      {
+        worker->thread.join();
+      }
+    }
+  }
+
+
+  void ThreadPool::BeginInvoke(EventHandler handler, void * sender, void * args)
+  {
+    assert(handler != nullptr);
+
+    size_t idx = currentPool == this ? currentWorker : (this->next++ % this->workers.size());
+
+    Task task;
+    task.handler = std::move(handler);
+    task.sender = sender;
+    task.args = args;
+
+    {
+      std::unique_lock<std::mutex> lock(this->workers[idx]->mutex);
+      this->workers[idx]->tasks.emplace_back(std::move(task));
+    }
+
+    ++ this->pending;
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->cond.notify_one();
+  }
+
+
+  void ThreadPool::BeginInvoke(EventHandler handler, EventHandler onComplete, Thread * owner, void * sender, void * args, const char * tag)
+  {
+    assert(handler != nullptr);
+
+    this->BeginInvoke(
+      [handler, onComplete, owner, tag](void * sender, void * args)
+      {
+        handler(sender, args);
+
+        if (!onComplete)
+        {
+          return;
+        }
+
+        if (owner)
+        {
+          owner->BeginInvoke(onComplete, sender, args, tag);
+        }
+        else
+        {
+          onComplete(sender, args);
+        }
+      },
+      sender,
+      args
+    );
+  }
+
+
+  bool ThreadPool::Pop(size_t idx, Task & task)
+  {
+    Worker * worker = this->workers[idx].get();
+
+    std::unique_lock<std::mutex> lock(worker->mutex);
+
+    if (worker->tasks.empty())
+    {
+      return false;
+    }
+
+    task = std::move(worker->tasks.back());
+    worker->tasks.pop_back();
+
+    return true;
+  }
+
+
+  bool ThreadPool::Steal(size_t idx, Task & task)
+  {
+    for (size_t i = 1; i < this->workers.size(); ++i)
+    {
+      Worker * victim = this->workers[(idx + i) % this->workers.size()].get();
+
+      std::unique_lock<std::mutex> lock(victim->mutex, std::try_to_lock);
+
+      if (!lock.owns_lock() || victim->tasks.empty())
+      {
+        continue;
+      }
+
+      task = std::move(victim->tasks.front());
+      victim->tasks.pop_front();
+
+      return true;
+    }
+
+    return false;
+  }
+
+
+  void ThreadPool::WorkerProc(size_t idx)
+  {
+    ThreadPool::currentPool = this;
+    ThreadPool::currentWorker = idx;
+
+    if (!this->name.empty())
+    {
+      ThreadConfig::Apply(this->name.c_str(), static_cast<int>(idx));
+    }
+
+    while (!this->quit)
+    {
+      Task task;
+
+      if (this->Pop(idx, task) || this->Steal(idx, task))
+      {
+        -- this->pending;
+
+        task.handler(task.sender, task.args);
+      }
+      else
+      {
+        std::unique_lock<std::mutex> lock(this->mutex);
+
+        // A try-lock steal may have skipped a busy victim; recheck with a timeout.
+        this->cond.wait_for(lock, std::chrono::milliseconds(10), [this]() { return this->quit || this->pending > 0; });
+      }
+    }
+  }
+}
\ No newline at end of file
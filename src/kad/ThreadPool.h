@@ -0,0 +1,110 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#pragma once
+
+#include <thread>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "EventLoop.h"
+
+namespace kad
+{
+  class Thread;
+
+  // A fixed set of worker threads for CPU-bound work. Each worker owns a deque:
+  // work posted from a worker goes to the back of its own deque, work posted from
+  // elsewhere is spread round-robin, and idle workers steal from the front of the
+  // others' deques.
+  class ThreadPool
+  {
+  private:
+
+    struct Task
+    {
+      EventHandler handler = nullptr;
+      void * sender = nullptr;
+      void * args = nullptr;
+    };
+
+    struct Worker
+    {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+      std::thread thread;
+    };
+
+  public:
+
+    // Workers are named after name (see ThreadConfig) and share its settings
+    explicit ThreadPool(size_t count = 0, const char * name = nullptr);
+
+    ~ThreadPool();
+
+    size_t Size() const     { return this->workers.size(); }
+
+    void BeginInvoke(EventHandler handler, void * sender = nullptr, void * args = nullptr);
+
+    // Run handler on the pool, then run onComplete on the owner thread, posted there under tag.
+    void BeginInvoke(EventHandler handler, EventHandler onComplete, Thread * owner, void * sender = nullptr, void * args = nullptr, const char * tag = nullptr);
+
+  private:
+
+    void WorkerProc(size_t idx);
+
+    bool Pop(size_t idx, Task & task);
+
+    bool Steal(size_t idx, Task & task);
+
+  private:
+
+    static thread_local ThreadPool * currentPool;
+
+    static thread_local size_t currentWorker;
+
+  private:
+
+    std::string name;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::atomic<size_t> next{0};
+
+    std::atomic<size_t> pending{0};
+
+    std::atomic<bool> quit{false};
+
+    std::mutex mutex;
+
+    std::condition_variable cond;
+  };
+}
\ No newline at end of file
@@ -26,11 +26,13 @@
  */
 
 #include "Timer.h"
+#include "ThreadConfig.h"
 
 
 namespace kad
 {
-  Timer::Timer()
+  Timer::Timer(const char * name)
+    : name(name ? name : "")
   {
     this->thread = std::thread(std::bind(&Timer::ThreadProc, this));
   }
@@ -103,6 +105,11 @@ namespace kad
 
   void Timer::ThreadProc()
   {
+    if (!this->name.empty())
+    {
+      ThreadConfig::Apply(this->name.c_str());
+    }
+
     while (!this->quit)
     {
       auto now = std::chrono::steady_clock::now();
@@ -143,7 +150,7 @@ namespace kad
   {
     if (owner)
     {
-      owner->BeginInvoke(handler, sender, args);
+      owner->BeginInvoke(handler, sender, args, "Timer::Call");
     }
     else
     {
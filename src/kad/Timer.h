@@ -32,6 +32,7 @@
 #include <atomic>
 #include <map>
 #include <chrono>
+#include <string>
 #include "Thread.h"
 
 namespace kad
@@ -52,7 +53,7 @@ namespace kad
 
   public:
 
-    Timer();
+    explicit Timer(const char * name = nullptr);
 
     ~Timer();
 
@@ -68,6 +69,8 @@ namespace kad
 
   private:
 
+    std::string name;
+
     std::atomic<bool> quit{false};
 
     std::unique_ptr<TimerEntry> entry;
@@ -0,0 +1,136 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#include <stdio.h>
+#include "Arena.h"
+#include "InstructionSerializer.h"
+#include "protocol/Batch.h"
+
+namespace kad
+{
+  namespace protocol
+  {
+    const size_t Batch::MAX_ITEMS;
+
+
+    Batch::Batch()
+      : Instruction(OpCode::BATCH)
+    {
+    }
+
+
+    bool Batch::Serialize(IOutputStream & output, uint8_t version) const
+    {
+      if (!this->SerializeOpCode(output, version) || !WriteInteger(output, version, static_cast<uint16_t>(this->items.size())))
+      {
+        return false;
+      }
+
+      for (const auto & item : this->items)
+      {
+        if (!InstructionSerializer::Serialize(output, item.get(), version))
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+
+    size_t Batch::SerializedSize(uint8_t version) const
+    {
+      size_t size = this->OpCodeSize(version) + IntegerSize(version, static_cast<uint16_t>(this->items.size()));
+
+      for (const auto & item : this->items)
+      {
+        size += item->SerializedSize(version);
+      }
+
+      return size;
+    }
+
+
+    bool Batch::Deserialize(SpanReader & input, uint8_t version)
+    {
+      uint16_t count = 0;
+
+      if (!this->DeserializeOpCode(input, version) || !ReadInteger(input, version, count) || count > MAX_ITEMS)
+      {
+        return false;
+      }
+
+      this->items.reserve(count);
+
+      for (uint16_t i = 0; i < count; ++i)
+      {
+        OpCode code;
+
+        if (!InstructionSerializer::PeekOpCode(input, version, code) || code == OpCode::BATCH)
+        {
+          return false;
+        }
+
+        Instruction * item = InstructionSerializer::Deserialize(input, version);
+
+        if (!item)
+        {
+          return false;
+        }
+
+        this->items.emplace_back(Arena::Adopt(item));
+      }
+
+      return true;
+    }
+
+
+    void Batch::Print() const
+    {
+      printf("[BATCH] items=%llu\n", (unsigned long long)this->items.size());
+
+      for (const auto & item : this->items)
+      {
+        item->Print();
+      }
+    }
+
+
+    bool Batch::AddItem(InstructionPtr item)
+    {
+      if (!item || item->Code() == OpCode::BATCH || this->items.size() >= MAX_ITEMS)
+      {
+        return false;
+      }
+
+      this->items.emplace_back(std::move(item));
+
+      return true;
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#pragma once
+
+#include <vector>
+#include "Instruction.h"
+
+namespace kad
+{
+  namespace protocol
+  {
+    // Several requests sent in one package, or their responses in the same order.
+    // Batches do not nest.
+    class Batch : public Instruction
+    {
+    public:
+
+      static const size_t MAX_ITEMS = 64;
+
+    public:
+
+      Batch();
+
+      bool Serialize(IOutputStream & output, uint8_t version) const override;
+
+      size_t SerializedSize(uint8_t version) const override;
+
+      bool Deserialize(SpanReader & input, uint8_t version) override;
+
+      void Print() const override;
+
+      bool AddItem(InstructionPtr item);
+
+      const std::vector<InstructionPtr> & Items() const
+      {
+        return this->items;
+      }
+
+    private:
+
+      std::vector<InstructionPtr> items;
+    };
+  }
+}
\ No newline at end of file
@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <memory>
+#include "Arena.h"
 #include "protocol/FindNode.h"
 
 namespace kad
@@ -39,9 +40,9 @@ namespace kad
     }
 
 
-    bool FindNode::Serialize(IOutputStream & output) const
+    bool FindNode::Serialize(IOutputStream & output, uint8_t version) const
     {
-      if (!this->key || !this->SerializeOpCode(output))
+      if (!this->key || !this->SerializeOpCode(output, version))
       {
         return false;
       }
@@ -50,14 +51,20 @@ namespace kad
     }
 
 
-    bool FindNode::Deserialize(IInputStream & input)
+    size_t FindNode::SerializedSize(uint8_t version) const
     {
-      if (!this->DeserializeOpCode(input))
+      return this->OpCodeSize(version) + Key::KEY_LEN;
+    }
+
+
+    bool FindNode::Deserialize(SpanReader & input, uint8_t version)
+    {
+      if (!this->DeserializeOpCode(input, version))
       {
         return false;
       }
 
-      this->key = std::make_shared<kad::Key>();
+      this->key = Arena::MakeShared<kad::Key>();
 
       return this->key->Deserialize(input);
     }
@@ -26,7 +26,9 @@
  */
 
 #include <assert.h>
+#include <algorithm>
 #include <stdio.h>
+#include "Arena.h"
 #include "protocol/FindNodeResponse.h"
 
 namespace kad
@@ -39,46 +41,169 @@ namespace kad
     }
 
 
-    bool FindNodeResponse::Serialize(IOutputStream & output) const
+    // In version 1 each entry starts with a byte holding the number of leading key
+    // bytes it shares with the previous entry (only the rest of the key follows) and a
+    // flag set when its port repeats the previous one. AddNode keeps the nodes sorted
+    // by key so neighbours share as much as possible; any order decodes.
+    static const uint8_t PREFIX_MASK = 0x1F;
+
+    static const uint8_t SAME_PORT = 0x80;
+
+
+    bool FindNodeResponse::Serialize(IOutputStream & output, uint8_t version) const
     {
-      if (!this->SerializeOpCode(output))
+      if (!this->SerializeOpCode(output, version))
       {
         return false;
       }
 
-      output.WriteUInt8((uint8_t)this->nodes.size());
+      if (version == WIRE_VERSION_0)
+      {
+        output.WriteUInt8((uint8_t)this->nodes.size());
+
+        for (const auto & pair : this->nodes)
+        {
+          pair.first->Serialize(output);
+
+          pair.second->Serialize(output);
+        }
+
+        return true;
+      }
+
+      output.WriteVarUInt(this->nodes.size());
 
-      for (const auto & pair : this->nodes)
+      const KeyContactPair * previous = nullptr;
+
+      for (const KeyContactPair & entry : this->nodes)
       {
-        pair.first->Serialize(output);
+        uint8_t header = EntryHeader(previous, entry);
+        size_t shared = header & PREFIX_MASK;
+
+        output.WriteUInt8(header);
+
+        output.Write(entry.first->Buffer() + shared, Key::KEY_LEN - shared);
 
-        pair.second->Serialize(output);
+        output.WriteInt32(static_cast<int32_t>(entry.second->addr));
+
+        if (!(header & SAME_PORT))
+        {
+          output.WriteInt16(static_cast<int16_t>(entry.second->port));
+        }
+
+        previous = & entry;
       }
 
       return true;
     }
 
 
-    bool FindNodeResponse::Deserialize(IInputStream & input)
+    size_t FindNodeResponse::SerializedSize(uint8_t version) const
     {
-      if (!this->DeserializeOpCode(input))
+      if (version == WIRE_VERSION_0)
+      {
+        return this->OpCodeSize(version) + sizeof(uint8_t) + this->nodes.size() * (Key::KEY_LEN + sizeof(int32_t) + sizeof(int16_t));
+      }
+
+      size_t size = this->OpCodeSize(version) + IOutputStream::VarUIntSize(this->nodes.size());
+
+      const KeyContactPair * previous = nullptr;
+
+      for (const KeyContactPair & entry : this->nodes)
+      {
+        uint8_t header = EntryHeader(previous, entry);
+
+        size += sizeof(uint8_t) + Key::KEY_LEN - (header & PREFIX_MASK) + sizeof(int32_t) + ((header & SAME_PORT) ? 0 : sizeof(int16_t));
+
+        previous = & entry;
+      }
+
+      return size;
+    }
+
+
+    bool FindNodeResponse::Deserialize(SpanReader & input, uint8_t version)
+    {
+      if (version == WIRE_VERSION_0)
+      {
+        return this->DeserializeV0(input);
+      }
+
+      uint32_t len = 0;
+
+      if (!this->DeserializeOpCode(input, version) || !input.ReadVarUInt(len))
+      {
+        return false;
+      }
+
+      // Every entry takes at least its header byte and an address
+      if (len > input.Remainder() / (sizeof(uint8_t) + sizeof(int32_t)))
       {
         return false;
       }
 
-      if (input.Remainder() < sizeof(uint8_t))
+      this->nodes.clear();
+
+      this->nodes.reserve(len);
+
+      uint8_t key[Key::KEY_LEN];
+      int16_t port = 0;
+
+      for (size_t i = 0; i < len; ++i)
+      {
+        uint8_t header = 0;
+        int32_t addr = 0;
+
+        if (!input.Read(header) || (header & ~(PREFIX_MASK | SAME_PORT)) != 0)
+        {
+          return false;
+        }
+
+        size_t shared = header & PREFIX_MASK;
+
+        if ((i == 0 && header != 0) || shared > Key::KEY_LEN)
+        {
+          return false;
+        }
+
+        if (!input.Read(key + shared, Key::KEY_LEN - shared) || !input.Read(addr))
+        {
+          return false;
+        }
+
+        if (!(header & SAME_PORT) && !input.Read(port))
+        {
+          return false;
+        }
+
+        ContactPtr contact = Arena::MakeShared<Contact>();
+        contact->addr = static_cast<unsigned long>(addr);
+        contact->port = static_cast<unsigned short>(port);
+
+        this->nodes.emplace_back(std::make_pair(Arena::MakeShared<Key>(key), contact));
+      }
+
+      return true;
+    }
+
+
+    bool FindNodeResponse::DeserializeV0(SpanReader & input)
+    {
+      uint8_t len = 0;
+
+      if (!this->DeserializeOpCode(input, WIRE_VERSION_0) || !input.Read(len))
       {
         return false;
       }
 
       this->nodes.clear();
 
-      size_t len = input.ReadUInt8();
+      this->nodes.reserve(len);
 
       for (size_t i = 0; i < len; ++i)
       {
-        KeyPtr key = std::make_shared<Key>();
-        ContactPtr contact = std::make_shared<Contact>();
+        KeyPtr key = Arena::MakeShared<Key>();
+        ContactPtr contact = Arena::MakeShared<Contact>();
 
         if (!key->Deserialize(input) || !contact->Deserialize(input))
         {
@@ -99,7 +224,10 @@ namespace kad
         return false;
       }
 
-      this->nodes.emplace_back(std::make_pair(key, contact));
+      auto pos = std::upper_bound(this->nodes.begin(), this->nodes.end(), key,
+        [](const KeyPtr & lhs, const KeyContactPair & rhs) { return * lhs < * rhs.first; });
+
+      this->nodes.emplace(pos, std::make_pair(key, contact));
 
       return true;
     }
@@ -122,5 +250,26 @@ namespace kad
 
       printf("]\n");
     }
+
+
+    uint8_t FindNodeResponse::EntryHeader(const KeyContactPair * previous, const KeyContactPair & node)
+    {
+      if (!previous)
+      {
+        return 0;
+      }
+
+      const uint8_t * lhs = previous->first->Buffer();
+      const uint8_t * rhs = node.first->Buffer();
+
+      uint8_t shared = 0;
+
+      while (shared < Key::KEY_LEN && lhs[shared] == rhs[shared])
+      {
+        ++shared;
+      }
+
+      return shared | (previous->second->port == node.second->port ? SAME_PORT : 0);
+    }
   }
 }
\ No newline at end of file
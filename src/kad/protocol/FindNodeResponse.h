@@ -49,10 +49,13 @@ namespace kad
 
       ~FindNodeResponse() override = default;
 
-      bool Serialize(IOutputStream & output) const override;
+      bool Serialize(IOutputStream & output, uint8_t version) const override;
 
-      bool Deserialize(IInputStream & input) override;
+      size_t SerializedSize(uint8_t version) const override;
 
+      bool Deserialize(SpanReader & input, uint8_t version) override;
+
+      // Nodes are kept sorted by key
       bool AddNode(KeyPtr key, ContactPtr contact);
 
       void Print() const override;
@@ -62,6 +65,12 @@ namespace kad
         return this->nodes;
       }
 
+    private:
+
+      bool DeserializeV0(SpanReader & input);
+
+      static uint8_t EntryHeader(const KeyContactPair * previous, const KeyContactPair & node);
+
     private:
 
       std::vector<KeyContactPair> nodes;
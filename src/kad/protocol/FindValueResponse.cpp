@@ -39,23 +39,23 @@ namespace kad
     }
 
 
-    bool FindValueResponse::Serialize(IOutputStream & output) const
+    bool FindValueResponse::Serialize(IOutputStream & output, uint8_t version) const
     {
       if (!this->data)
       {
         return false;
       }
 
-      if (!this->SerializeOpCode(output))
+      if (!this->SerializeOpCode(output, version))
       {
         return false;
       }
 
-      output.WriteUInt64(this->version);
+      WriteInteger(output, version, this->version);
 
-      output.WriteUInt32(this->ttl);
+      WriteInteger(output, version, this->ttl);
 
-      output.WriteUInt32((uint32_t)this->data->Size());
+      WriteInteger(output, version, static_cast<uint32_t>(this->data->Size()));
 
       if (this->data->Size() > 0 && this->data->Data())
       {
@@ -66,45 +66,27 @@ namespace kad
     }
 
 
-    bool FindValueResponse::Deserialize(IInputStream & input)
+    size_t FindValueResponse::SerializedSize(uint8_t version) const
     {
-      if (!this->DeserializeOpCode(input))
-      {
-        return false;
-      }
-
-      if (input.Remainder() < sizeof(uint64_t))
-      {
-        return false;
-      }
-
-      this->version = input.ReadUInt64();
+      size_t size = this->data ? this->data->Size() : 0;
 
-      if (input.Remainder() < sizeof(uint32_t))
-      {
-        return false;
-      }
+      return this->OpCodeSize(version) + IntegerSize(version, this->version) + IntegerSize(version, this->ttl)
+        + IntegerSize(version, static_cast<uint32_t>(size)) + size;
+    }
 
-      this->ttl = input.ReadUInt32();
 
-      if (input.Remainder() < sizeof(uint32_t))
-      {
-        return false;
-      }
+    bool FindValueResponse::Deserialize(SpanReader & input, uint8_t version)
+    {
+      uint32_t len = 0;
 
-      uint32_t len = input.ReadUInt32();
-      if (input.Remainder() < len)
+      if (!this->DeserializeOpCode(input, version) || !ReadInteger(input, version, this->version) || !ReadInteger(input, version, this->ttl) || !ReadInteger(input, version, len))
       {
         return false;
       }
 
-      uint8_t * buffer = new uint8_t[len];
-
-      input.Read(buffer, len);
+      this->data = input.ReadBuffer(len);
 
-      this->data = std::make_shared<Buffer>(buffer, len, false, true);
-
-      return true;
+      return this->data != nullptr;
     }
 
 
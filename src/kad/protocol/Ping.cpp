@@ -26,7 +26,7 @@
  */
 
 #include <stdio.h>
-#include "IInputStream.h"
+#include "SpanReader.h"
 #include "IOutputStream.h"
 #include "protocol/Ping.h"
 
@@ -40,15 +40,21 @@ namespace kad
     }
 
 
-    bool Ping::Serialize(IOutputStream & output) const
+    bool Ping::Serialize(IOutputStream & output, uint8_t version) const
     {
-      return this->SerializeOpCode(output);
+      return this->SerializeOpCode(output, version);
     }
 
 
-    bool Ping::Deserialize(IInputStream & input) 
+    size_t Ping::SerializedSize(uint8_t version) const
     {
-      return this->DeserializeOpCode(input);
+      return this->OpCodeSize(version);
+    }
+
+
+    bool Ping::Deserialize(SpanReader & input, uint8_t version)
+    {
+      return this->DeserializeOpCode(input, version);
     }
 
 
@@ -40,9 +40,11 @@ namespace kad
       Ping();
       ~Ping() override = default;
 
-      bool Serialize(IOutputStream & output) const override;
+      bool Serialize(IOutputStream & output, uint8_t version) const override;
 
-      bool Deserialize(IInputStream & input) override;
+      size_t SerializedSize(uint8_t version) const override;
+
+      bool Deserialize(SpanReader & input, uint8_t version) override;
 
       void Print() const override;
     };
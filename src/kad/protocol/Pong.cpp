@@ -26,7 +26,7 @@
  */
 
 #include <stdio.h>
-#include "IInputStream.h"
+#include "SpanReader.h"
 #include "IOutputStream.h"
 #include "protocol/Pong.h"
 
@@ -40,15 +40,21 @@ namespace kad
     }
 
 
-    bool Pong::Serialize(IOutputStream & output) const
+    bool Pong::Serialize(IOutputStream & output, uint8_t version) const
     {
-      return this->SerializeOpCode(output);
+      return this->SerializeOpCode(output, version);
     }
 
 
-    bool Pong::Deserialize(IInputStream & input) 
+    size_t Pong::SerializedSize(uint8_t version) const
     {
-      return this->DeserializeOpCode(input);
+      return this->OpCodeSize(version);
+    }
+
+
+    bool Pong::Deserialize(SpanReader & input, uint8_t version)
+    {
+      return this->DeserializeOpCode(input, version);
     }
 
 
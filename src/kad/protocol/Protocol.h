@@ -42,3 +42,4 @@
 #include "protocol/StoreLogResponse.h"
 #include "protocol/QueryLog.h"
 #include "protocol/QueryLogResponse.h"
+#include "protocol/Batch.h"
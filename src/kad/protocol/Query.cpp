@@ -37,22 +37,27 @@ namespace kad
       this->code = OpCode::QUERY;
     }
 
-    bool Query::Serialize(IOutputStream & output) const
+    bool Query::Serialize(IOutputStream & output, uint8_t version) const
     {
-      bool r = FindNode::Serialize(output);
+      bool r = FindNode::Serialize(output, version);
 
-      std::string q(this->query);
-      output.WriteString(q);
+      WriteString(output, version, this->query);
 
       return r;
     }
 
 
-    bool Query::Deserialize(IInputStream & input)
+    size_t Query::SerializedSize(uint8_t version) const
     {
-      bool r = FindNode::Deserialize(input);
+      return FindNode::SerializedSize(version) + StringSize(version, this->query);
+    }
+
+
+    bool Query::Deserialize(SpanReader & input, uint8_t version)
+    {
+      bool r = FindNode::Deserialize(input, version);
 
-      input.ReadString(this->query);
+      ReadString(input, version, this->query);
 
       return r;
     }
@@ -26,6 +26,7 @@
  */
 
 #include <string.h>
+#include "Arena.h"
 #include "protocol/Store.h"
 
 namespace kad
@@ -38,28 +39,28 @@ namespace kad
     }
 
 
-    bool Store::Serialize(IOutputStream & output) const
+    bool Store::Serialize(IOutputStream & output, uint8_t version) const
     {
       if (!this->key || !this->data)
       {
         return false;
       }
 
-      if (!this->SerializeOpCode(output))
+      if (!this->SerializeOpCode(output, version))
       {
         return false;
       }
 
-      output.WriteUInt64(this->version);
+      WriteInteger(output, version, static_cast<uint64_t>(this->version));
 
-      output.WriteUInt32(this->ttl);
+      WriteInteger(output, version, this->ttl);
 
       output.WriteUInt8(this->original ? 1 : 0);
 
       this->key->Serialize(output);
 
-      output.WriteUInt32(this->data->Size());
-      
+      WriteInteger(output, version, static_cast<uint32_t>(this->data->Size()));
+
       if (this->data->Size() > 0)
       {
         output.Write(this->data->Data(), this->data->Size());
@@ -69,59 +70,41 @@ namespace kad
     }
 
 
-    bool Store::Deserialize(IInputStream & input)
+    size_t Store::SerializedSize(uint8_t version) const
     {
-      if (!this->DeserializeOpCode(input))
-      {
-        return false;
-      }
+      size_t size = this->data ? this->data->Size() : 0;
 
-      if (input.Remainder() < sizeof(uint64_t))
-      {
-        return false;
-      }
+      return this->OpCodeSize(version) + IntegerSize(version, static_cast<uint64_t>(this->version)) + IntegerSize(version, this->ttl)
+        + sizeof(uint8_t) + Key::KEY_LEN + IntegerSize(version, static_cast<uint32_t>(size)) + size;
+    }
 
-      this->version = input.ReadUInt64();
 
-      if (input.Remainder() < sizeof(uint32_t))
-      {
-        return false;
-      }
-
-      this->ttl = input.ReadUInt32();
+    bool Store::Deserialize(SpanReader & input, uint8_t version)
+    {
+      uint64_t value = 0;
+      uint8_t original = 0;
 
-      if (input.Remainder() < sizeof(uint8_t))
+      if (!this->DeserializeOpCode(input, version) || !ReadInteger(input, version, value) || !ReadInteger(input, version, this->ttl) || !input.Read(original))
       {
         return false;
       }
 
-      this->original = (input.ReadUInt8() != 0);
+      this->version = value;
 
-      this->key = std::make_shared<Key>();
-      if (!this->key->Deserialize(input))
-      {
-        return false;
-      }
+      this->original = (original != 0);
 
-      if (input.Remainder() < sizeof(uint32_t))
-      {
-        return false;
-      }
+      this->key = Arena::MakeShared<Key>();
 
-      size_t size = input.ReadUInt32();
+      uint32_t size = 0;
 
-      if (input.Remainder() < size)
+      if (!this->key->Deserialize(input) || !ReadInteger(input, version, size))
       {
         return false;
       }
 
-      uint8_t * ptr = new uint8_t[size];
-
-      bool result = input.Read(ptr, size) == size;
-
-      this->data = std::make_shared<Buffer>(ptr, size, false, true);
+      this->data = input.ReadBuffer(size);
 
-      return result;
+      return this->data != nullptr;
     }
 
 
@@ -37,31 +37,32 @@ namespace kad
     }
 
 
-    bool StoreLogResponse::Serialize(IOutputStream & output) const
+    bool StoreLogResponse::Serialize(IOutputStream & output, uint8_t version) const
     {
-      if (!this->SerializeOpCode(output))
+      if (!this->SerializeOpCode(output, version))
       {
         return false;
       }
 
-      return output.WriteUInt16(static_cast<uint16_t>(this->result));
+      return WriteInteger(output, version, static_cast<uint16_t>(this->result));
     }
 
 
-    bool StoreLogResponse::Deserialize(IInputStream & input)
+    size_t StoreLogResponse::SerializedSize(uint8_t version) const
     {
-      if (!this->DeserializeOpCode(input))
-      {
-        return false;
-      }
+      return this->OpCodeSize(version) + IntegerSize(version, static_cast<uint16_t>(this->result));
+    }
 
-      if (input.Remainder() < sizeof(uint16_t))
+
+    bool StoreLogResponse::Deserialize(SpanReader & input, uint8_t version)
+    {
+      uint16_t value = 0;
+
+      if (!this->DeserializeOpCode(input, version) || !ReadInteger(input, version, value))
       {
         return false;
       }
 
-      uint16_t value = input.ReadUInt16();
-
       if (value < static_cast<uint16_t>(ErrorCode::__MAX__))
       {
         this->result = static_cast<ErrorCode>(value);
@@ -0,0 +1,148 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+  using BenchFunc = std::function<void()>;
+
+  // Heap allocations made through operator new since start (counted in main.cpp)
+  extern std::atomic<uint64_t> allocations;
+
+  // Set from the command line in main.cpp
+  struct Options
+  {
+    // One JSON object per result line instead of the aligned text table
+    bool json = false;
+
+    // Largest table or store the scaling suites build
+    uint64_t maxKeys = 1000000;
+  };
+
+
+  inline Options & GetOptions()
+  {
+    static Options options;
+    return options;
+  }
+
+  struct Suite
+  {
+    const char * name;
+    BenchFunc func;
+  };
+
+
+  inline std::vector<Suite> & Suites()
+  {
+    static std::vector<Suite> suites;
+    return suites;
+  }
+
+
+  struct Registrar
+  {
+    Registrar(const char * name, BenchFunc func)
+    {
+      Suites().push_back(Suite{name, std::move(func)});
+    }
+  };
+
+
+  class Stopwatch
+  {
+  public:
+
+    Stopwatch() : start(std::chrono::steady_clock::now()) {}
+
+    double Seconds() const
+    {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - this->start).count();
+    }
+
+  private:
+
+    std::chrono::steady_clock::time_point start;
+  };
+
+
+  // One result line: suite, case, parameter, operation count and elapsed time
+  inline void Report(const char * suite, const std::string & name, uint64_t param, uint64_t ops, double seconds)
+  {
+    double rate = seconds > 0 ? ops / seconds : 0.0;
+
+    if (GetOptions().json)
+    {
+      std::string escaped;
+
+      for (char c : name)
+      {
+        if (c == '"' || c == '\\')
+        {
+          escaped.push_back('\\');
+        }
+
+        escaped.push_back(c);
+      }
+
+      printf("{\"suite\":\"%s\",\"case\":\"%s\",\"param\":%llu,\"ops\":%llu,\"seconds\":%.9f,\"ops_per_sec\":%.1f}\n",
+             suite, escaped.c_str(), (unsigned long long)param, (unsigned long long)ops, seconds, rate);
+    }
+    else
+    {
+      printf("%-12s %-32s %10llu %12llu ops %10.3f ms %14.0f ops/s\n",
+             suite, name.c_str(), (unsigned long long)param, (unsigned long long)ops, seconds * 1000.0, rate);
+    }
+
+    fflush(stdout);
+  }
+
+
+  // Keeps the optimizer from dropping a computed value
+  template<typename T>
+  inline void Consume(const T & value)
+  {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+}
+
+#define BENCH_CONCAT2(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT2(a, b)
+
+#define BENCH_SUITE(name) \
+  static void BENCH_CONCAT(bench_, name)(); \
+  static bench::Registrar BENCH_CONCAT(registrar_, name)(#name, &BENCH_CONCAT(bench_, name)); \
+  static void BENCH_CONCAT(bench_, name)()
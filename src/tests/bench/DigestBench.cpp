@@ -0,0 +1,99 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#include <random>
+#include <string>
+#include <vector>
+#include "Digest.h"
+#include "Bench.h"
+
+using namespace kad;
+
+static const size_t BATCH = 64;
+
+static const size_t BYTES = 64 * 1024 * 1024;
+
+
+// Hashes 64 buffers at a time, one Compute call each and then one ComputeBatch call,
+// over buffers from key-sized strings up to small documents. Each case is reported
+// twice: in hashes per second and in bytes (MB) per second.
+BENCH_SUITE(digest)
+{
+  std::mt19937 rng(3);
+
+  for (size_t size : { 32, 256, 4096 })
+  {
+    std::vector<std::vector<uint8_t>> data(BATCH, std::vector<uint8_t>(size));
+    std::vector<const void *> buffers;
+    std::vector<size_t> sizes(BATCH, size);
+
+    for (auto & buffer : data)
+    {
+      for (auto & b : buffer)
+      {
+        b = static_cast<uint8_t>(rng());
+      }
+
+      buffers.emplace_back(buffer.data());
+    }
+
+    sha1_t digests[BATCH];
+    size_t rounds = BYTES / (size * BATCH);
+    size_t hashes = rounds * BATCH;
+
+    bench::Stopwatch singleWatch;
+
+    for (size_t i = 0; i < rounds; ++i)
+    {
+      for (size_t j = 0; j < BATCH; ++j)
+      {
+        Digest::Compute(buffers[j], size, digests[j]);
+      }
+
+      bench::Consume(digests[0][0]);
+    }
+
+    double seconds = singleWatch.Seconds();
+
+    bench::Report("digest", "Compute", size, hashes, seconds);
+    bench::Report("digest", "Compute bytes", size, hashes * size, seconds);
+
+    bench::Stopwatch batchWatch;
+
+    for (size_t i = 0; i < rounds; ++i)
+    {
+      Digest::ComputeBatch(buffers.data(), sizes.data(), BATCH, digests);
+      bench::Consume(digests[0][0]);
+    }
+
+    seconds = batchWatch.Seconds();
+
+    bench::Report("digest", "ComputeBatch", size, hashes, seconds);
+    bench::Report("digest", "ComputeBatch bytes", size, hashes * size, seconds);
+  }
+}
@@ -0,0 +1,154 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "EventLoop.h"
+#include "Bench.h"
+
+using namespace kad;
+
+static const size_t EVENTS = 200000;
+
+static const size_t INVOKES = 20000;
+
+
+// Runs an EventLoop on its own thread for the lifetime of the object
+class LoopThread
+{
+public:
+
+  LoopThread()
+  {
+    this->thread = std::thread([this]() { this->loop.Run(); });
+
+    while (!this->loop.IsRunning())
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  ~LoopThread()
+  {
+    this->loop.Quit();
+    this->thread.join();
+  }
+
+  EventLoop & Loop()    { return this->loop; }
+
+private:
+
+  EventLoop loop;
+
+  std::thread thread;
+};
+
+
+static void WaitFor(const std::atomic<size_t> & counter, size_t expected)
+{
+  while (counter.load(std::memory_order_acquire) < expected)
+  {
+    std::this_thread::yield();
+  }
+}
+
+
+BENCH_SUITE(eventloop)
+{
+  // Handlers posted from other threads and run by the loop
+  for (size_t producers : { 1, 2, 4 })
+  {
+    LoopThread loop;
+    std::atomic<size_t> executed{0};
+    std::vector<std::thread> threads;
+    size_t perProducer = EVENTS / producers;
+
+    bench::Stopwatch watch;
+
+    for (size_t i = 0; i < producers; ++i)
+    {
+      threads.emplace_back([&]()
+      {
+        for (size_t j = 0; j < perProducer; ++j)
+        {
+          loop.Loop().BeginInvoke([&executed](void *, void *) { executed.fetch_add(1, std::memory_order_release); });
+        }
+      });
+    }
+
+    for (auto & thread : threads)
+    {
+      thread.join();
+    }
+
+    WaitFor(executed, perProducer * producers);
+
+    bench::Report("eventloop", "BeginInvoke cross-thread", producers, perProducer * producers, watch.Seconds());
+  }
+
+  // A chain of handlers, each posting the next from the loop thread
+  {
+    LoopThread loop;
+    std::atomic<size_t> executed{0};
+    std::function<void(void *, void *)> step;
+
+    step = [&](void *, void *)
+    {
+      if (executed.fetch_add(1, std::memory_order_release) + 1 < EVENTS)
+      {
+        loop.Loop().BeginInvoke(step);
+      }
+    };
+
+    bench::Stopwatch watch;
+
+    loop.Loop().BeginInvoke(step);
+
+    WaitFor(executed, EVENTS);
+
+    bench::Report("eventloop", "BeginInvoke from loop", 1, EVENTS, watch.Seconds());
+  }
+
+  // Synchronous round trips: post, run and wait for completion
+  {
+    LoopThread loop;
+    size_t executed = 0;
+
+    bench::Stopwatch watch;
+
+    for (size_t i = 0; i < INVOKES; ++i)
+    {
+      loop.Loop().Invoke([&executed](void *, void *) { ++executed; });
+    }
+
+    bench::Report("eventloop", "Invoke", 1, INVOKES, watch.Seconds());
+
+    bench::Consume(executed);
+  }
+}
@@ -0,0 +1,271 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "BufferedOutputStream.h"
+#include "Distance.h"
+#include "Key.h"
+#include "SpanReader.h"
+#include "Bench.h"
+
+using namespace kad;
+
+static const size_t KEYS = 1024;
+
+static const size_t ITERATIONS = 1000000;
+
+
+static std::vector<KeyPtr> RandomKeys(size_t count, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<KeyPtr> keys;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    uint8_t buffer[Key::KEY_LEN];
+
+    for (auto & b : buffer)
+    {
+      b = static_cast<uint8_t>(rng());
+    }
+
+    keys.emplace_back(std::make_shared<Key>(buffer));
+  }
+
+  return keys;
+}
+
+
+// Runs op over pairs of keys ITERATIONS times and reports the rate
+template<typename F>
+static void Measure(const std::string & name, const std::vector<KeyPtr> & keys, size_t iterations, F op)
+{
+  bench::Stopwatch watch;
+
+  for (size_t i = 0; i < iterations; ++i)
+  {
+    op(* keys[i % KEYS], * keys[(i * 7 + 1) % KEYS]);
+  }
+
+  bench::Report("key", name, Key::KEY_LEN, iterations, watch.Seconds());
+}
+
+
+BENCH_SUITE(key)
+{
+  auto keys = RandomKeys(KEYS, 1);
+
+  Measure("GetDistance", keys, ITERATIONS, [](const Key & a, const Key & b) { bench::Consume(a.GetDistance(b)); });
+
+  Measure("operator<", keys, ITERATIONS, [](const Key & a, const Key & b) { bench::Consume(a < b); });
+
+  Measure("operator==", keys, ITERATIONS, [](const Key & a, const Key & b) { bench::Consume(a == b); });
+
+  Measure("distance compare", keys, ITERATIONS, [&keys](const Key & a, const Key & b)
+  {
+    bench::Consume(a.GetDistance(* keys[0]) < b.GetDistance(* keys[0]));
+  });
+
+  Measure("Bit x160", keys, ITERATIONS / 10, [](const Key & a, const Key &)
+  {
+    size_t count = 0;
+
+    for (size_t i = 0; i < Key::KEY_LEN_BITS; ++i)
+    {
+      count += a.Bit(i) ? 1 : 0;
+    }
+
+    bench::Consume(count);
+  });
+
+  Measure("GetHighestBit", keys, ITERATIONS, [](const Key & a, const Key & b) { bench::Consume(a.GetDistance(b).GetHighestBit()); });
+
+  Measure("ToString", keys, ITERATIONS / 10, [](const Key & a, const Key &) { bench::Consume(a.ToString()); });
+
+  Measure("ToString buffer", keys, ITERATIONS, [](const Key & a, const Key &)
+  {
+    char buffer[Key::HEX_LEN + 1];
+    a.ToString(buffer);
+    bench::Consume(buffer[0]);
+  });
+
+  {
+    std::vector<std::string> strings;
+
+    for (const auto & key : keys)
+    {
+      strings.emplace_back(key->ToString());
+    }
+
+    size_t iterations = ITERATIONS / 10;
+    Key key;
+    bench::Stopwatch watch;
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+      bench::Consume(key.FromString(strings[i % KEYS].c_str()));
+    }
+
+    bench::Report("key", "FromString", Key::KEY_LEN, iterations, watch.Seconds());
+  }
+
+  {
+    BufferedOutputStream output(Key::KEY_LEN * KEYS);
+    bench::Stopwatch watch;
+
+    for (size_t i = 0; i < ITERATIONS; ++i)
+    {
+      if (i % KEYS == 0)
+      {
+        output.Reset();
+      }
+
+      keys[i % KEYS]->Serialize(output);
+    }
+
+    bench::Report("key", "Serialize", Key::KEY_LEN, ITERATIONS, watch.Seconds());
+
+    Key key;
+    SpanReader input(output.Buffer(), output.Offset());
+    bench::Stopwatch decodeWatch;
+
+    for (size_t i = 0; i < ITERATIONS; ++i)
+    {
+      if (input.Remainder() < Key::KEY_LEN)
+      {
+        input = SpanReader(output.Buffer(), output.Offset());
+      }
+
+      key.Deserialize(input);
+      bench::Consume(key);
+    }
+
+    bench::Report("key", "Deserialize", Key::KEY_LEN, ITERATIONS, decodeWatch.Seconds());
+  }
+
+  // The ordered set of shared keys that Storage and Bucket used to index by, each
+  // entry owning a copy of its key
+  {
+    uint64_t allocations = bench::allocations;
+    std::set<KeyPtr, KeyCompare> index;
+
+    for (const auto & key : keys)
+    {
+      index.emplace(std::make_shared<Key>(* key));
+    }
+
+    uint64_t perKey = (bench::allocations - allocations) / KEYS;
+    auto probes = RandomKeys(KEYS, 2);
+    bench::Stopwatch watch;
+
+    for (size_t i = 0; i < ITERATIONS; ++i)
+    {
+      bench::Consume(index.find((i & 1) ? keys[i % KEYS] : probes[i % KEYS]) != index.end());
+    }
+
+    bench::Report("key", "set<KeyPtr>::find allocs=" + std::to_string(perKey), index.size(), ITERATIONS, watch.Seconds());
+  }
+
+  // The same index with the keys held by value
+  {
+    uint64_t allocations = bench::allocations;
+    std::set<Key> index;
+
+    for (const auto & key : keys)
+    {
+      index.emplace(* key);
+    }
+
+    uint64_t perKey = (bench::allocations - allocations) / KEYS;
+    auto probes = RandomKeys(KEYS, 2);
+    bench::Stopwatch watch;
+
+    for (size_t i = 0; i < ITERATIONS; ++i)
+    {
+      bench::Consume(index.find((i & 1) ? * keys[i % KEYS] : * probes[i % KEYS]) != index.end());
+    }
+
+    bench::Report("key", "set<Key>::find allocs=" + std::to_string(perKey), index.size(), ITERATIONS, watch.Seconds());
+  }
+
+  // The 20 keys closest to a target out of a table, picked by sorting every distance in
+  // a map the way the lookups used to, and by the bulk kernel
+  for (size_t size : { 160, 1024 })
+  {
+    std::vector<Key> table;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+      table.emplace_back(* keys[i % KEYS]);
+      table.back().SetBit(i % Key::KEY_LEN_BITS, !table.back().Bit(i % Key::KEY_LEN_BITS));
+    }
+
+    size_t iterations = ITERATIONS / size * 20;
+    bench::Stopwatch mapWatch;
+
+    for (size_t i = 0; i < iterations / 10; ++i)
+    {
+      std::map<Key, size_t> sorted;
+
+      for (size_t j = 0; j < size; ++j)
+      {
+        sorted[keys[i % KEYS]->GetDistance(table[j])] = j;
+      }
+
+      bench::Consume(sorted.begin()->second);
+    }
+
+    bench::Report("key", "closest 20 map", size, iterations / 10, mapWatch.Seconds());
+
+    std::vector<Distance::Entry> entries(size);
+    bench::Stopwatch selectWatch;
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+      Distance::SelectClosest(* keys[i % KEYS], table.data(), size, 20, entries.data());
+      bench::Consume(entries[0].index);
+    }
+
+    bench::Report("key", "closest 20 SelectClosest", size, iterations, selectWatch.Seconds());
+
+    std::vector<Key> distances(size);
+    bench::Stopwatch computeWatch;
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+      Distance::Compute(* keys[i % KEYS], table.data(), size, distances.data());
+      bench::Consume(distances[i % size]);
+    }
+
+    bench::Report("key", "Distance::Compute", size, iterations * size, computeWatch.Seconds());
+  }
+}
@@ -0,0 +1,714 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "Distance.h"
+#include "FlatMap.h"
+#include "KBuckets.h"
+#include "Bench.h"
+
+using namespace kad;
+
+static const size_t RANDOM_CONTACTS = 200;
+
+static const size_t SIMULATED_LOOKUPS = 500;
+
+static const size_t ALPHA = 3;
+
+// Round trips in ms between North America east and west, Europe, Asia, South America
+// and Oceania, roughly as measured between cloud regions, and how the nodes are spread
+static const size_t REGIONS = 6;
+
+static const double REGION_RTT[REGIONS][REGIONS] =
+{
+  {  15,  70,  85, 200, 120, 210 },
+  {  70,  15, 150, 130, 170, 150 },
+  {  85, 150,  20, 230, 200, 280 },
+  { 200, 130, 230,  30, 300, 120 },
+  { 120, 170, 200, 300,  25, 310 },
+  { 210, 150, 280, 120, 310,  20 }
+};
+
+static const double REGION_WEIGHTS[REGIONS] = { 25, 15, 30, 20, 5, 5 };
+
+
+namespace
+{
+  // One simulated node: its id and the indices of the nodes it knows, per bucket, in
+  // the order they were learned (least recently seen first)
+  struct Node
+  {
+    Key id;
+    std::vector<std::vector<uint32_t>> buckets;
+  };
+
+
+  using Selector = std::vector<uint32_t> (*)(const std::vector<Node> & nodes, const Node & node, const Key & target);
+
+
+  // Keeps the distances in a sorted vector, not a routing table, so that 10k nodes fit
+  std::vector<uint32_t> SortByDistance(const std::vector<Node> & nodes, std::vector<uint32_t> indices, const Key & target)
+  {
+    std::sort(indices.begin(), indices.end(), [&nodes, &target](uint32_t a, uint32_t b)
+    {
+      return nodes[a].id.GetDistance(target) < nodes[b].id.GetDistance(target);
+    });
+
+    return indices;
+  }
+
+
+  // What FindClosestContacts used to return: the target's bucket, then the buckets
+  // below it going down, then the ones above going up, each in LRU order
+  std::vector<uint32_t> BucketWalk(const std::vector<Node> & nodes, const Node & node, const Key & target)
+  {
+    std::vector<uint32_t> result;
+    int idx = std::max(0, node.id.GetDistance(target).GetHighestBit());
+
+    auto collect = [&](size_t i)
+    {
+      for (size_t j = 0; j < node.buckets[i].size() && result.size() < KBuckets::SizeK; ++j)
+      {
+        result.emplace_back(node.buckets[i][j]);
+      }
+    };
+
+    for (int i = idx; i >= 0; --i)
+    {
+      collect(i);
+    }
+
+    for (size_t i = idx + 1; i < Key::KEY_LEN_BITS; ++i)
+    {
+      collect(i);
+    }
+
+    return SortByDistance(nodes, std::move(result), target);
+  }
+
+
+  // The SizeK closest contacts the node knows, which is what FindClosestContacts returns now
+  std::vector<uint32_t> Exact(const std::vector<Node> & nodes, const Node & node, const Key & target)
+  {
+    std::vector<uint32_t> all;
+
+    for (const auto & bucket : node.buckets)
+    {
+      all.insert(all.end(), bucket.begin(), bucket.end());
+    }
+
+    all = SortByDistance(nodes, std::move(all), target);
+
+    if (all.size() > KBuckets::SizeK)
+    {
+      all.resize(KBuckets::SizeK);
+    }
+
+    return all;
+  }
+
+
+  struct Outcome
+  {
+    size_t hops = 0;
+    size_t queries = 0;
+    bool found = false;
+  };
+
+
+  // An iterative lookup as the actions run it: ask the ALPHA closest unasked nodes of
+  // the SizeK closest known so far, merge their answers, and stop once none is left.
+  // One hop is one round of parallel requests.
+  Outcome Lookup(const std::vector<Node> & nodes, Selector select, uint32_t origin, const Key & target, uint32_t closest)
+  {
+    Outcome outcome;
+    std::map<Key, uint32_t> shortlist;
+    std::set<uint32_t> asked;
+
+    for (uint32_t idx : select(nodes, nodes[origin], target))
+    {
+      shortlist[nodes[idx].id.GetDistance(target)] = idx;
+    }
+
+    while (true)
+    {
+      std::vector<uint32_t> round;
+      size_t rank = 0;
+
+      for (const auto & entry : shortlist)
+      {
+        if (rank++ >= KBuckets::SizeK || round.size() >= ALPHA)
+        {
+          break;
+        }
+
+        if (asked.find(entry.second) == asked.end())
+        {
+          round.emplace_back(entry.second);
+        }
+      }
+
+      if (round.empty())
+      {
+        break;
+      }
+
+      ++ outcome.hops;
+
+      for (uint32_t idx : round)
+      {
+        asked.emplace(idx);
+        ++ outcome.queries;
+
+        for (uint32_t next : select(nodes, nodes[idx], target))
+        {
+          shortlist[nodes[next].id.GetDistance(target)] = next;
+        }
+      }
+    }
+
+    outcome.found = shortlist.begin()->second == closest;
+
+    return outcome;
+  }
+}
+
+
+// Simulates networks of 1k and 10k nodes (capped by --max-keys). Each node learns the
+// 2 * SizeK nodes closest to it, as after joining, then 200 random ones. The old flat
+// table (at most SizeK per highest differing bit) is emulated and searched with the old
+// bucket walk and with exact selection; the tree table is built with KBuckets itself,
+// strict and relaxed. Reported per case: average rounds of requests (hops), requests
+// sent, and how often the node closest to the target was found.
+BENCH_SUITE(lookup)
+{
+  std::mt19937 rng(11);
+
+  auto randomKey = [&rng]()
+  {
+    uint8_t buffer[Key::KEY_LEN];
+
+    for (auto & b : buffer)
+    {
+      b = static_cast<uint8_t>(rng());
+    }
+
+    return Key(buffer);
+  };
+
+  for (size_t size : { 1000, 10000 })
+  {
+    if (size > bench::GetOptions().maxKeys)
+    {
+      break;
+    }
+
+    std::vector<Key> ids;
+    FlatMap<Key, uint32_t, KeyHash> indices;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+      ids.emplace_back(randomKey());
+      indices[ids.back()] = static_cast<uint32_t>(i);
+    }
+
+    std::vector<Node> flat(size);
+    std::vector<Node> tree(size);
+    std::vector<Node> relaxed(size);
+    std::vector<Distance::Entry> entries(size);
+    auto contact = std::make_shared<Contact>();
+
+    for (size_t i = 0; i < size; ++i)
+    {
+      std::vector<uint32_t> learned;
+
+      // The first entry is the node itself
+      size_t count = Distance::SelectClosest(ids[i], ids.data(), size, KBuckets::SizeK * 2 + 1, entries.data());
+
+      for (size_t j = 1; j < count; ++j)
+      {
+        learned.emplace_back(entries[j].index);
+      }
+
+      for (size_t j = 0; j < RANDOM_CONTACTS; ++j)
+      {
+        learned.emplace_back(rng() % size);
+      }
+
+      Node & node = flat[i];
+
+      node.id = ids[i];
+      node.buckets.resize(Key::KEY_LEN_BITS);
+
+      for (uint32_t idx : learned)
+      {
+        int bucket = node.id.GetDistance(ids[idx]).GetHighestBit();
+
+        if (bucket < 0 || node.buckets[bucket].size() >= KBuckets::SizeK)
+        {
+          continue;
+        }
+
+        auto & contacts = node.buckets[bucket];
+
+        if (std::find(contacts.begin(), contacts.end(), idx) == contacts.end())
+        {
+          contacts.emplace_back(idx);
+        }
+      }
+
+      for (auto * nodes : { & tree, & relaxed })
+      {
+        KBuckets table(std::make_shared<Key>(ids[i]), nodes == & relaxed);
+
+        for (uint32_t idx : learned)
+        {
+          table.AddContact(std::make_shared<Key>(ids[idx]), contact);
+        }
+
+        std::vector<std::pair<KeyPtr, ContactPtr>> contacts;
+        table.GetAllContacts(contacts);
+
+        (* nodes)[i].id = ids[i];
+        (* nodes)[i].buckets.resize(1);
+
+        for (const auto & entry : contacts)
+        {
+          (* nodes)[i].buckets[0].emplace_back(indices[* entry.first]);
+        }
+      }
+    }
+
+    std::vector<std::pair<uint32_t, Key>> lookups;
+    std::vector<uint32_t> closest;
+
+    for (size_t i = 0; i < SIMULATED_LOOKUPS; ++i)
+    {
+      Key target = randomKey();
+      Distance::SelectClosest(target, ids.data(), size, 1, entries.data());
+
+      lookups.emplace_back(rng() % size, target);
+      closest.emplace_back(entries[0].index);
+    }
+
+    struct Case
+    {
+      const char * name;
+      const std::vector<Node> * nodes;
+      Selector select;
+    };
+
+    for (const Case & test : { Case{ "bucket walk", & flat, & BucketWalk }, Case{ "exact", & flat, & Exact },
+                               Case{ "tree", & tree, & Exact }, Case{ "tree relaxed", & relaxed, & Exact } })
+    {
+      size_t hops = 0;
+      size_t queries = 0;
+      size_t found = 0;
+      size_t contacts = 0;
+      bench::Stopwatch watch;
+
+      for (size_t i = 0; i < lookups.size(); ++i)
+      {
+        Outcome outcome = Lookup(* test.nodes, test.select, lookups[i].first, lookups[i].second, closest[i]);
+
+        hops += outcome.hops;
+        queries += outcome.queries;
+        found += outcome.found ? 1 : 0;
+      }
+
+      double seconds = watch.Seconds();
+
+      for (const auto & node : * test.nodes)
+      {
+        for (const auto & bucket : node.buckets)
+        {
+          contacts += bucket.size();
+        }
+      }
+
+      char name[128];
+      snprintf(name, sizeof(name), "%s hops=%.2f rpcs=%.1f found=%.0f%% contacts=%.0f", test.name,
+               double(hops) / lookups.size(), double(queries) / lookups.size(), 100.0 * found / lookups.size(),
+               double(contacts) / size);
+
+      bench::Report("lookup", name, size, lookups.size(), seconds);
+    }
+  }
+}
+
+
+namespace
+{
+  // A node of the latency model: what its table holds, with the round trip it measured
+  // to each contact
+  struct Peer
+  {
+    Key id;
+    size_t region;
+    double access;
+    std::vector<std::pair<uint32_t, double>> contacts;
+  };
+
+
+  double RoundTrip(const Peer & a, const Peer & b)
+  {
+    return REGION_RTT[a.region][b.region] + a.access + b.access;
+  }
+
+
+  std::vector<uint32_t> Closest(const std::vector<Peer> & peers, const Peer & peer, const Key & target)
+  {
+    std::vector<std::pair<Key, uint32_t>> all;
+
+    for (const auto & contact : peer.contacts)
+    {
+      all.emplace_back(peers[contact.first].id.GetDistance(target), contact.first);
+    }
+
+    size_t count = std::min(all.size(), KBuckets::SizeK);
+    std::partial_sort(all.begin(), all.begin() + count, all.end());
+
+    std::vector<uint32_t> result;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      result.emplace_back(all[i].second);
+    }
+
+    return result;
+  }
+
+
+  struct Timing
+  {
+    size_t queries = 0;
+    double latency = 0;
+    bool found = false;
+  };
+
+
+  // The actions' lookup in time: the ALPHA closest are asked at once, and each answer
+  // sends out one more request, picked as Action::NextCandidate does, until none is in
+  // flight. The lookup takes as long as its last answer.
+  Timing TimedLookup(const std::vector<Peer> & peers, bool ties, uint32_t origin, const Key & target, uint32_t closest)
+  {
+    using Event = std::pair<double, uint32_t>;
+
+    Timing timing;
+    std::map<Key, uint32_t> shortlist;
+    std::set<uint32_t> asked;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> pending;
+    const Peer & self = peers[origin];
+
+    auto known = [&self](uint32_t idx)
+    {
+      for (const auto & contact : self.contacts)
+      {
+        if (contact.first == idx)
+        {
+          return contact.second;
+        }
+      }
+
+      return 0.0;
+    };
+
+    auto send = [&](uint32_t idx, double now)
+    {
+      asked.emplace(idx);
+      pending.emplace(now + RoundTrip(self, peers[idx]), idx);
+      ++ timing.queries;
+    };
+
+    auto next = [&]()
+    {
+      int result = -1;
+      int bit = 0;
+      double rtt = 0;
+      size_t alternatives = 0;
+      size_t rank = 0;
+
+      for (const auto & entry : shortlist)
+      {
+        if (rank++ >= KBuckets::SizeK)
+        {
+          break;
+        }
+
+        if (asked.find(entry.second) != asked.end())
+        {
+          continue;
+        }
+
+        if (result < 0)
+        {
+          result = static_cast<int>(entry.second);
+
+          if (!ties || (rtt = known(entry.second)) == 0)
+          {
+            break;
+          }
+
+          bit = entry.first.GetHighestBit();
+          continue;
+        }
+
+        if (entry.first.GetHighestBit() != bit || ++ alternatives >= ALPHA)
+        {
+          break;
+        }
+
+        double other = known(entry.second);
+
+        if (other != 0 && other < rtt)
+        {
+          result = static_cast<int>(entry.second);
+          rtt = other;
+        }
+      }
+
+      return result;
+    };
+
+    for (uint32_t idx : Closest(peers, self, target))
+    {
+      shortlist[peers[idx].id.GetDistance(target)] = idx;
+    }
+
+    size_t started = 0;
+
+    for (const auto & entry : shortlist)
+    {
+      if (started++ >= ALPHA)
+      {
+        break;
+      }
+
+      send(entry.second, 0);
+    }
+
+    while (!pending.empty())
+    {
+      Event event = pending.top();
+      pending.pop();
+
+      timing.latency = event.first;
+
+      for (uint32_t idx : Closest(peers, peers[event.second], target))
+      {
+        if (idx != origin)
+        {
+          shortlist[peers[idx].id.GetDistance(target)] = idx;
+        }
+      }
+
+      int idx = next();
+
+      if (idx >= 0)
+      {
+        send(static_cast<uint32_t>(idx), event.first);
+      }
+    }
+
+    timing.found = !shortlist.empty() && shortlist.begin()->second == closest;
+
+    return timing;
+  }
+}
+
+
+// Places 1k and 10k nodes (capped by --max-keys) in six regions and measures lookups
+// against the matrix above plus a 2-20 ms access delay per node. Tables are built with
+// KBuckets as OnMessage fills them: each node hears from its 2 * SizeK closest nodes and
+// 200 random ones, keeping those that do not fit as candidates, and measures the round
+// trip to each. "tree" picks candidates by distance only, "tree ties" lets the round
+// trip settle near ties, "PNS" also lets the buckets trade slow contacts for fast
+// candidates. Reported per case: requests sent, how often the node closest to the
+// target was found, and the average and 90th percentile time a lookup took.
+BENCH_SUITE(proximity)
+{
+  std::mt19937 rng(13);
+  std::discrete_distribution<size_t> regions(REGION_WEIGHTS, REGION_WEIGHTS + REGIONS);
+  std::uniform_real_distribution<double> access(2, 20);
+
+  auto randomKey = [&rng]()
+  {
+    uint8_t buffer[Key::KEY_LEN];
+
+    for (auto & b : buffer)
+    {
+      b = static_cast<uint8_t>(rng());
+    }
+
+    return Key(buffer);
+  };
+
+  for (size_t size : { 1000, 10000 })
+  {
+    if (size > bench::GetOptions().maxKeys)
+    {
+      break;
+    }
+
+    std::vector<Key> ids;
+    FlatMap<Key, uint32_t, KeyHash> indices;
+    std::vector<Peer> plain(size);
+
+    for (size_t i = 0; i < size; ++i)
+    {
+      ids.emplace_back(randomKey());
+      indices[ids.back()] = static_cast<uint32_t>(i);
+
+      plain[i].id = ids[i];
+      plain[i].region = regions(rng);
+      plain[i].access = access(rng);
+    }
+
+    std::vector<Peer> pns = plain;
+    std::vector<Distance::Entry> entries(size);
+    auto contact = std::make_shared<Contact>();
+
+    for (size_t i = 0; i < size; ++i)
+    {
+      std::vector<uint32_t> learned;
+
+      // The first entry is the node itself
+      size_t count = Distance::SelectClosest(ids[i], ids.data(), size, KBuckets::SizeK * 2 + 1, entries.data());
+
+      for (size_t j = 1; j < count; ++j)
+      {
+        learned.emplace_back(entries[j].index);
+      }
+
+      for (size_t j = 0; j < RANDOM_CONTACTS; ++j)
+      {
+        learned.emplace_back(rng() % size);
+      }
+
+      std::shuffle(learned.begin(), learned.end(), rng);
+
+      for (auto * peers : { & plain, & pns })
+      {
+        KBuckets table(std::make_shared<Key>(ids[i]), false, peers == & pns);
+
+        for (uint32_t idx : learned)
+        {
+          auto key = std::make_shared<Key>(ids[idx]);
+
+          if (!table.AddContact(key, contact))
+          {
+            table.AddReplacement(key, contact);
+          }
+
+          auto rtt = std::chrono::duration<double, std::milli>(RoundTrip((* peers)[i], (* peers)[idx]));
+          table.UpdateRtt(key, std::chrono::duration_cast<std::chrono::steady_clock::duration>(rtt));
+        }
+
+        std::vector<std::pair<KeyPtr, ContactPtr>> contacts;
+        table.GetAllContacts(contacts);
+
+        for (const auto & entry : contacts)
+        {
+          (* peers)[i].contacts.emplace_back(indices[* entry.first], table.GetRtt(* entry.first) / 1000.0);
+        }
+      }
+    }
+
+    std::vector<std::pair<uint32_t, Key>> lookups;
+    std::vector<uint32_t> closest;
+
+    for (size_t i = 0; i < SIMULATED_LOOKUPS; ++i)
+    {
+      Key target = randomKey();
+      Distance::SelectClosest(target, ids.data(), size, 1, entries.data());
+
+      lookups.emplace_back(rng() % size, target);
+      closest.emplace_back(entries[0].index);
+    }
+
+    struct Case
+    {
+      const char * name;
+      const std::vector<Peer> * peers;
+      bool ties;
+    };
+
+    for (const Case & test : { Case{ "tree", & plain, false }, Case{ "tree ties", & plain, true }, Case{ "PNS", & pns, true } })
+    {
+      size_t queries = 0;
+      size_t found = 0;
+      double contactRtt = 0;
+      size_t contacts = 0;
+      std::vector<double> latencies;
+      bench::Stopwatch watch;
+
+      for (size_t i = 0; i < lookups.size(); ++i)
+      {
+        Timing timing = TimedLookup(* test.peers, test.ties, lookups[i].first, lookups[i].second, closest[i]);
+
+        queries += timing.queries;
+        found += timing.found ? 1 : 0;
+        latencies.emplace_back(timing.latency);
+      }
+
+      double seconds = watch.Seconds();
+
+      for (const auto & peer : * test.peers)
+      {
+        for (const auto & entry : peer.contacts)
+        {
+          contactRtt += entry.second;
+          ++ contacts;
+        }
+      }
+
+      std::sort(latencies.begin(), latencies.end());
+
+      double total = 0;
+
+      for (double latency : latencies)
+      {
+        total += latency;
+      }
+
+      char name[160];
+      snprintf(name, sizeof(name), "%s rpcs=%.1f found=%.0f%% latency=%.0fms p90=%.0fms contact rtt=%.0fms", test.name,
+               double(queries) / lookups.size(), 100.0 * found / lookups.size(), total / latencies.size(),
+               latencies[latencies.size() * 9 / 10], contacts ? contactRtt / contacts : 0.0);
+
+      bench::Report("proximity", name, size, lookups.size(), seconds);
+    }
+  }
+}
@@ -0,0 +1,445 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "BufferedInputStream.h"
+#include "BufferedOutputStream.h"
+#include "Package.h"
+#include "SpanReader.h"
+#include "protocol/Protocol.h"
+#include "Bench.h"
+
+using namespace kad;
+
+static const size_t ITERATIONS = 100000;
+
+
+static KeyPtr MakeKey(uint8_t seed)
+{
+  uint8_t buffer[Key::KEY_LEN];
+
+  for (size_t i = 0; i < Key::KEY_LEN; ++i)
+  {
+    buffer[i] = static_cast<uint8_t>(seed * 31 + i);
+  }
+
+  return std::make_shared<Key>(buffer);
+}
+
+
+static BufferPtr MakeData(size_t size)
+{
+  std::string text(size, 'x');
+  return std::make_shared<Buffer>(reinterpret_cast<const uint8_t *>(text.data()), text.size(), true, true);
+}
+
+
+struct Sample
+{
+  std::string name;
+  std::shared_ptr<Package> package;
+};
+
+
+// One representative package per opcode, plus large payload variants
+static std::vector<Sample> Samples()
+{
+  std::vector<Sample> samples;
+
+  auto from = MakeKey(1);
+  auto target = std::make_shared<Contact>();
+
+  auto add = [&](const std::string & name, Instruction * instr)
+  {
+    samples.push_back(Sample{name, std::make_shared<Package>(Package::PackageType::Request, from, target, std::unique_ptr<Instruction>(instr))});
+  };
+
+  add("PING", new protocol::Ping());
+  add("PONG", new protocol::Pong());
+
+  {
+    auto instr = new protocol::FindNode();
+    instr->SetKey(MakeKey(2));
+    add("FIND_NODE", instr);
+  }
+
+  {
+    auto instr = new protocol::FindNodeResponse();
+    for (uint8_t i = 0; i < 20; ++i)
+    {
+      instr->AddNode(MakeKey(i), std::make_shared<Contact>());
+    }
+    add("FIND_NODE_RESPONSE/20", instr);
+  }
+
+  {
+    auto instr = new protocol::FindValue();
+    instr->SetKey(MakeKey(3));
+    add("FIND_VALUE", instr);
+  }
+
+  for (size_t size : { 1024, 65536 })
+  {
+    auto instr = new protocol::FindValueResponse();
+    instr->SetData(MakeData(size));
+    add("FIND_VALUE_RESPONSE/" + std::to_string(size), instr);
+  }
+
+  {
+    auto instr = new protocol::Query();
+    instr->SetKey(MakeKey(4));
+    instr->query = "type:doc name:x1";
+    add("QUERY", instr);
+  }
+
+  {
+    auto instr = new protocol::QueryResponse();
+    instr->SetData(MakeData(4096));
+    add("QUERY_RESPONSE/4096", instr);
+  }
+
+  for (size_t size : { 1024, 65536 })
+  {
+    auto instr = new protocol::Store();
+    instr->SetKey(MakeKey(5));
+    instr->SetData(MakeData(size));
+    add("STORE/" + std::to_string(size), instr);
+  }
+
+  add("STORE_RESPONSE", new protocol::StoreResponse());
+
+  {
+    auto instr = new protocol::StoreLog();
+    instr->SetKey(MakeKey(6));
+    instr->SetData(MakeData(1024));
+    add("STORE_LOG/1024", instr);
+  }
+
+  add("STORE_LOG_RESPONSE", new protocol::StoreLogResponse());
+
+  {
+    auto instr = new protocol::QueryLog();
+    instr->SetKey(MakeKey(7));
+    instr->query = "type:log:x";
+    add("QUERY_LOG", instr);
+  }
+
+  {
+    auto instr = new protocol::QueryLogResponse();
+    instr->SetData(MakeData(4096));
+    add("QUERY_LOG_RESPONSE/4096", instr);
+  }
+
+  {
+    auto instr = new protocol::Batch();
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+      auto item = std::make_shared<protocol::FindValue>();
+      item->SetKey(MakeKey(8 + i));
+      instr->AddItem(item);
+    }
+    add("BATCH/8", instr);
+  }
+
+  return samples;
+}
+
+
+// grow:  a fresh stream grown as the package is written
+// exact: a fresh stream sized once from SerializedSize
+// reuse: one stream reset and reused, as PackageDispatcher does
+BENCH_SUITE(encode)
+{
+  for (const auto & sample : Samples())
+  {
+    const Package & package = * sample.package;
+    size_t bytes = package.SerializedSize();
+    size_t iterations = bytes > 16384 ? ITERATIONS / 10 : ITERATIONS;
+
+    {
+      bench::Stopwatch watch;
+
+      for (size_t i = 0; i < iterations; ++i)
+      {
+        BufferedOutputStream output;
+        package.Serialize(output);
+      }
+
+      bench::Report("encode", sample.name + " grow", bytes, iterations, watch.Seconds());
+    }
+
+    {
+      bench::Stopwatch watch;
+
+      for (size_t i = 0; i < iterations; ++i)
+      {
+        BufferedOutputStream output(package.SerializedSize());
+        package.Serialize(output);
+      }
+
+      bench::Report("encode", sample.name + " exact", bytes, iterations, watch.Seconds());
+    }
+
+    {
+      BufferedOutputStream output;
+      bench::Stopwatch watch;
+
+      for (size_t i = 0; i < iterations; ++i)
+      {
+        output.Reset();
+        output.Reserve(package.SerializedSize());
+        package.Serialize(output);
+      }
+
+      bench::Report("encode", sample.name + " reuse", bytes, iterations, watch.Seconds());
+    }
+  }
+}
+
+
+// Decode a STORE the way PackageDispatcher does: over a shared receive buffer the
+// payload is sliced, over a raw pointer it is copied
+BENCH_SUITE(ingest)
+{
+  auto from = MakeKey(1);
+  auto sender = std::make_shared<Contact>();
+
+  for (size_t size : { 1024, 65536, 1048576 })
+  {
+    auto instr = new protocol::Store();
+    instr->SetKey(MakeKey(5));
+    instr->SetData(MakeData(size));
+
+    Package package(Package::PackageType::Request, from, sender, std::unique_ptr<Instruction>(instr));
+
+    BufferedOutputStream output(package.SerializedSize());
+    package.Serialize(output);
+
+    auto received = std::make_shared<Buffer>(output.Buffer(), output.Offset(), true, true);
+    size_t iterations = size >= 1048576 ? 1000 : 20000;
+
+    {
+      bench::Stopwatch watch;
+
+      for (size_t i = 0; i < iterations; ++i)
+      {
+        BufferedInputStream input(reinterpret_cast<const uint8_t *>(received->Data()), received->Size());
+        Package::Deserialize(sender, input);
+      }
+
+      bench::Report("ingest", "STORE copy", size, iterations, watch.Seconds());
+    }
+
+    {
+      bench::Stopwatch watch;
+
+      for (size_t i = 0; i < iterations; ++i)
+      {
+        BufferedInputStream input(received);
+        Package::Deserialize(sender, input);
+      }
+
+      bench::Report("ingest", "STORE slice", size, iterations, watch.Seconds());
+    }
+  }
+}
+
+
+// Decode every sample from a shared receive buffer, as PackageDispatcher does, and
+// count heap allocations per decoded package
+BENCH_SUITE(decode)
+{
+  auto sender = std::make_shared<Contact>();
+
+  for (const auto & sample : Samples())
+  {
+    BufferedOutputStream output(sample.package->SerializedSize());
+    sample.package->Serialize(output);
+
+    auto received = std::make_shared<Buffer>(output.Buffer(), output.Offset(), true, true);
+    size_t iterations = ITERATIONS;
+
+    uint64_t allocations = bench::allocations;
+    bench::Stopwatch watch;
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+      SpanReader input(received);
+      Package::Deserialize(sender, input);
+    }
+
+    double seconds = watch.Seconds();
+    uint64_t perPackage = (bench::allocations - allocations) / iterations;
+
+    bench::Report("decode", sample.name + " allocs=" + std::to_string(perPackage), received->Size(), iterations, seconds);
+  }
+}
+
+
+// One FIND_NODE round trip as a lookup sees it: the reply carries the 20 ids closest
+// to a random target out of 100k random node ids, with most nodes on the default port
+static std::vector<Sample> Lookup()
+{
+  std::mt19937 rng(42);
+
+  auto randomKey = [&rng]()
+  {
+    uint8_t buffer[Key::KEY_LEN];
+
+    for (auto & b : buffer)
+    {
+      b = static_cast<uint8_t>(rng());
+    }
+
+    return std::make_shared<Key>(buffer);
+  };
+
+  auto target = randomKey();
+
+  std::vector<std::pair<Key, KeyPtr>> nodes;
+
+  for (size_t i = 0; i < 100000; ++i)
+  {
+    auto key = randomKey();
+    nodes.emplace_back(target->GetDistance(* key), key);
+  }
+
+  std::partial_sort(nodes.begin(), nodes.begin() + 20, nodes.end(),
+    [](const std::pair<Key, KeyPtr> & lhs, const std::pair<Key, KeyPtr> & rhs) { return lhs.first < rhs.first; });
+
+  auto request = new protocol::FindNode();
+  request->SetKey(target);
+
+  auto response = new protocol::FindNodeResponse();
+
+  for (size_t i = 0; i < 20; ++i)
+  {
+    auto contact = std::make_shared<Contact>();
+    contact->addr = rng();
+    contact->port = (rng() % 5 == 0) ? static_cast<unsigned short>(1024 + rng() % 60000) : 6600;
+
+    response->AddNode(nodes[i].second, contact);
+  }
+
+  auto from = randomKey();
+  auto sender = std::make_shared<Contact>();
+
+  std::vector<Sample> samples;
+  samples.push_back(Sample{"lookup FIND_NODE", std::make_shared<Package>(Package::PackageType::Request, from, sender, std::unique_ptr<Instruction>(request))});
+  samples.push_back(Sample{"lookup FIND_NODE_RESPONSE", std::make_shared<Package>(Package::PackageType::Response, from, sender, std::unique_ptr<Instruction>(response))});
+
+  return samples;
+}
+
+
+// One replication window: the STORE of a 256 byte value on its own, and the BATCH
+// that carries Batch::MAX_ITEMS of them to one contact in a single round trip
+static std::vector<Sample> Replication()
+{
+  std::mt19937 rng(7);
+
+  auto randomKey = [&rng]()
+  {
+    uint8_t buffer[Key::KEY_LEN];
+
+    for (auto & b : buffer)
+    {
+      b = static_cast<uint8_t>(rng());
+    }
+
+    return std::make_shared<Key>(buffer);
+  };
+
+  std::vector<uint8_t> value(256, 'v');
+  auto data = std::make_shared<Buffer>(value.data(), value.size(), true, true);
+
+  auto store = [&]()
+  {
+    auto instr = std::make_shared<protocol::Store>();
+    instr->SetKey(randomKey());
+    instr->SetData(data);
+    instr->SetVersion(rng());
+    instr->SetTTL(86400);
+    return instr;
+  };
+
+  auto batch = new protocol::Batch();
+
+  for (size_t i = 0; i < protocol::Batch::MAX_ITEMS; ++i)
+  {
+    batch->AddItem(store());
+  }
+
+  auto from = randomKey();
+  auto sender = std::make_shared<Contact>();
+
+  std::vector<Sample> samples;
+  samples.push_back(Sample{"replicate STORE", std::make_shared<Package>(Package::PackageType::Request, from, sender, store())});
+  samples.push_back(Sample{"replicate BATCH x" + std::to_string(protocol::Batch::MAX_ITEMS), std::make_shared<Package>(Package::PackageType::Request, from, sender, std::unique_ptr<Instruction>(batch))});
+
+  return samples;
+}
+
+
+// Bytes on the wire (the parameter column) and encode rate per sample in each wire
+// version, sized exactly and written into a reused stream
+BENCH_SUITE(wire)
+{
+  auto samples = Samples();
+  auto lookup = Lookup();
+  auto replication = Replication();
+  samples.insert(samples.end(), lookup.begin(), lookup.end());
+  samples.insert(samples.end(), replication.begin(), replication.end());
+
+  for (const auto & sample : samples)
+  {
+    for (uint8_t version : { Instruction::WIRE_VERSION_0, Instruction::WIRE_VERSION_1 })
+    {
+      Package & package = * sample.package;
+      package.SetVersion(version, version);
+
+      size_t bytes = package.SerializedSize();
+      size_t iterations = bytes > 16384 ? ITERATIONS / 10 : ITERATIONS;
+
+      BufferedOutputStream output;
+      bench::Stopwatch watch;
+
+      for (size_t i = 0; i < iterations; ++i)
+      {
+        output.Reset();
+        output.Reserve(package.SerializedSize());
+        package.Serialize(output);
+      }
+
+      bench::Report("wire", sample.name + " v" + std::to_string(version), bytes, iterations, watch.Seconds());
+    }
+  }
+}
@@ -0,0 +1,197 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "RingQueue.h"
+#include "Bench.h"
+
+using namespace kad;
+
+static const size_t ITEMS_PER_PRODUCER = 200000;
+
+static const size_t BATCH = 32;
+
+
+// Baseline: the lock protected queue the ring replaces conceptually
+class MutexQueue
+{
+public:
+
+  bool Produce(size_t value)
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->items.push_back(value);
+    return true;
+  }
+
+  template<typename F>
+  size_t ConsumeAll(F && func)
+  {
+    std::deque<size_t> batch;
+
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      batch.swap(this->items);
+    }
+
+    for (auto value : batch)
+    {
+      func(std::move(value));
+    }
+
+    return batch.size();
+  }
+
+private:
+
+  std::mutex mutex;
+
+  std::deque<size_t> items;
+};
+
+
+template<typename Q, typename P>
+static double Run(Q & queue, size_t producers, P produce)
+{
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < producers; ++i)
+  {
+    threads.emplace_back([&]()
+    {
+      while (!go)
+      {
+        std::this_thread::yield();
+      }
+
+      produce(queue);
+    });
+  }
+
+  size_t expected = producers * ITEMS_PER_PRODUCER;
+  size_t received = 0;
+  size_t sum = 0;
+
+  bench::Stopwatch watch;
+  go = true;
+
+  while (received < expected)
+  {
+    size_t count = queue.ConsumeAll([&sum](size_t && value) { sum += value; });
+
+    if (count == 0)
+    {
+      std::this_thread::yield();
+    }
+
+    received += count;
+  }
+
+  double seconds = watch.Seconds();
+
+  for (auto & thread : threads)
+  {
+    thread.join();
+  }
+
+  return seconds;
+}
+
+
+BENCH_SUITE(queue)
+{
+  for (size_t producers : { 1, 2, 4, 8, 16 })
+  {
+    size_t ops = producers * ITEMS_PER_PRODUCER;
+
+    {
+      MutexQueue queue;
+      double seconds = Run(queue, producers, [](MutexQueue & q)
+      {
+        for (size_t i = 0; i < ITEMS_PER_PRODUCER; ++i)
+        {
+          q.Produce(i);
+        }
+      });
+
+      bench::Report("queue", "mutex-deque", producers, ops, seconds);
+    }
+
+    {
+      RingQueue<size_t> queue(65536, QueueFullPolicy::Spin);
+      double seconds = Run(queue, producers, [](RingQueue<size_t> & q)
+      {
+        for (size_t i = 0; i < ITEMS_PER_PRODUCER; ++i)
+        {
+          q.Produce(i);
+        }
+      });
+
+      bench::Report("queue", "ring", producers, ops, seconds);
+    }
+
+    {
+      RingQueue<size_t> queue(65536, QueueFullPolicy::Spin);
+      double seconds = Run(queue, producers, [](RingQueue<size_t> & q)
+      {
+        size_t values[BATCH];
+
+        for (size_t i = 0; i < ITEMS_PER_PRODUCER; i += BATCH)
+        {
+          size_t n = std::min(BATCH, ITEMS_PER_PRODUCER - i);
+
+          for (size_t j = 0; j < n; ++j)
+          {
+            values[j] = i + j;
+          }
+
+          q.ProduceBatch(values, n);
+        }
+      });
+
+      bench::Report("queue", "ring-batch", producers, ops, seconds);
+    }
+
+    {
+      RingQueue<size_t> queue(65536, QueueFullPolicy::Block);
+      double seconds = Run(queue, producers, [](RingQueue<size_t> & q)
+      {
+        for (size_t i = 0; i < ITEMS_PER_PRODUCER; ++i)
+        {
+          q.Produce(i);
+        }
+      });
+
+      bench::Report("queue", "ring-block", producers, ops, seconds);
+    }
+  }
+}
@@ -0,0 +1,278 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <random>
+#include <vector>
+#include "KBuckets.h"
+#include "Bench.h"
+
+using namespace kad;
+
+static const size_t LOOKUPS = 20000;
+
+
+// A key whose distance to self has its highest set bit at bucket
+static KeyPtr KeyInBucket(const Key & self, size_t bucket, std::mt19937 & rng)
+{
+  Key distance;
+
+  for (size_t i = 0; i < bucket; ++i)
+  {
+    distance.SetBit(i, (rng() & 1) != 0);
+  }
+
+  distance.SetBit(bucket, true);
+
+  return std::make_shared<Key>(self.GetDistance(distance));
+}
+
+
+// Fills a table with size contacts spread evenly over the buckets (each holds at most
+// SizeK, so a full table has SizeK * KEY_LEN_BITS), then times lookups of random targets
+BENCH_SUITE(routing)
+{
+  std::mt19937 rng(3);
+
+  auto randomKey = [&rng]()
+  {
+    uint8_t buffer[Key::KEY_LEN];
+
+    for (auto & b : buffer)
+    {
+      b = static_cast<uint8_t>(rng());
+    }
+
+    return std::make_shared<Key>(buffer);
+  };
+
+  auto self = randomKey();
+
+  std::vector<KeyPtr> targets;
+
+  for (size_t i = 0; i < 1024; ++i)
+  {
+    targets.emplace_back(randomKey());
+  }
+
+  for (size_t size : { 20, 160, 640, 1280, 3000 })
+  {
+    if (size > bench::GetOptions().maxKeys)
+    {
+      break;
+    }
+
+    KBuckets table(self);
+
+    std::vector<std::pair<KeyPtr, ContactPtr>> contacts;
+
+    for (size_t i = 0; contacts.size() < size; ++i)
+    {
+      size_t bucket = Key::KEY_LEN_BITS - 1 - (i % Key::KEY_LEN_BITS);
+
+      if (bucket < 4)
+      {
+        // The lowest buckets only have room for a few keys
+        continue;
+      }
+
+      auto contact = std::make_shared<Contact>();
+      contact->addr = rng();
+      contact->port = 6600;
+
+      contacts.emplace_back(KeyInBucket(* self, bucket, rng), contact);
+    }
+
+    bench::Stopwatch addWatch;
+
+    for (const auto & contact : contacts)
+    {
+      table.AddContact(contact.first, contact.second);
+    }
+
+    bench::Report("routing", "AddContact", table.Size(), contacts.size(), addWatch.Seconds());
+
+    std::vector<std::pair<KeyPtr, ContactPtr>> result;
+
+    bench::Stopwatch findWatch;
+
+    for (size_t i = 0; i < LOOKUPS; ++i)
+    {
+      result.clear();
+      table.FindClosestContacts(targets[i % targets.size()], result);
+      bench::Consume(result.size());
+    }
+
+    bench::Report("routing", "FindClosestContacts", table.Size(), LOOKUPS, findWatch.Seconds());
+
+    bench::Stopwatch restrictWatch;
+
+    for (size_t i = 0; i < LOOKUPS; ++i)
+    {
+      result.clear();
+      table.FindClosestContacts(targets[i % targets.size()], result, true);
+      bench::Consume(result.size());
+    }
+
+    bench::Report("routing", "FindClosestContacts restrict", table.Size(), LOOKUPS, restrictWatch.Seconds());
+
+    bench::Stopwatch publishWatch;
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+      // Erase and add back one contact, so every Publish has a change to copy
+      table.EraseContact(contacts[i % contacts.size()].first);
+      table.AddContact(contacts[i % contacts.size()].first, contacts[i % contacts.size()].second);
+      table.Publish();
+    }
+
+    bench::Report("routing", "Publish", table.Size(), 100, publishWatch.Seconds());
+
+    // The routing table file as SaveBuckets writes it and InitBuckets reads it back
+    char path[] = "/tmp/kad-routing-XXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd >= 0)
+    {
+      close(fd);
+
+      std::vector<RoutingTableFile::Record> records;
+      bench::Stopwatch saveWatch;
+
+      for (size_t i = 0; i < 20; ++i)
+      {
+        records.clear();
+        table.GetRecords(records);
+        RoutingTableFile::Save(path, records);
+      }
+
+      bench::Report("routing", "Save", table.Size(), 20, saveWatch.Seconds());
+
+      bench::Stopwatch loadWatch;
+
+      for (size_t i = 0; i < 20; ++i)
+      {
+        KBuckets loaded(self);
+
+        records.clear();
+        RoutingTableFile::Load(path, records);
+
+        for (const auto & record : records)
+        {
+          loaded.AddRecord(record);
+        }
+
+        bench::Consume(loaded.Size());
+      }
+
+      bench::Report("routing", "Load", table.Size(), 20, loadWatch.Seconds());
+
+      unlink(path);
+    }
+
+    bench::Stopwatch lookupWatch;
+
+    for (size_t i = 0; i < LOOKUPS; ++i)
+    {
+      bench::Consume(table.FindContact(contacts[i % contacts.size()].first));
+    }
+
+    bench::Report("routing", "FindContact", table.Size(), LOOKUPS, lookupWatch.Seconds());
+
+    // What every incoming message does to its sender
+    bench::Stopwatch updateWatch;
+
+    for (size_t i = 0; i < LOOKUPS; ++i)
+    {
+      bench::Consume(table.UpdateContact(contacts[(i * 7) % contacts.size()].first));
+    }
+
+    bench::Report("routing", "UpdateContact", table.Size(), LOOKUPS, updateWatch.Seconds());
+
+    std::vector<std::pair<KeyPtr, ContactPtr>> old;
+    bench::Stopwatch oldWatch;
+
+    for (size_t i = 0; i < LOOKUPS; ++i)
+    {
+      old.clear();
+      table.GetOldContacts(contacts[i % contacts.size()].first, 1, old);
+      bench::Consume(old.size());
+    }
+
+    bench::Report("routing", "GetOldContacts", table.Size(), LOOKUPS, oldWatch.Seconds());
+
+    // Unknown senders in the top buckets, as OnMessage sees them. Pings are answered in
+    // groups of 1000 messages; the old code pinged once per sender turned away.
+    std::vector<KeyPtr> senders;
+
+    for (size_t i = 0; i < LOOKUPS; ++i)
+    {
+      senders.emplace_back(KeyInBucket(* self, Key::KEY_LEN_BITS - 1 - i % 8, rng));
+    }
+
+    size_t tableSize = table.Size();
+    size_t turnedAway = 0;
+    size_t pings = 0;
+    std::vector<KeyPtr> probed;
+    auto sender = std::make_shared<Contact>();
+    bench::Stopwatch probeWatch;
+
+    for (size_t i = 0; i < LOOKUPS; ++i)
+    {
+      std::pair<KeyPtr, ContactPtr> oldest;
+
+      if (!table.AddContact(senders[i], sender) && table.AddReplacement(senders[i], sender))
+      {
+        ++ turnedAway;
+
+        if (table.BeginProbe(senders[i], oldest))
+        {
+          ++ pings;
+          probed.emplace_back(oldest.first);
+        }
+      }
+
+      if (i % 1000 == 999)
+      {
+        for (const auto & key : probed)
+        {
+          table.EndProbe(key, true);
+        }
+
+        probed.clear();
+      }
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "full bucket senders=%zu pings=%zu", turnedAway, pings);
+
+    bench::Report("routing", name, tableSize, LOOKUPS, probeWatch.Seconds());
+  }
+}
@@ -0,0 +1,252 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "Config.h"
+#include "FlatMap.h"
+#include "Storage.h"
+#include "Bench.h"
+
+using namespace kad;
+
+static const size_t LOADS = 10000;
+
+static const size_t LOOKUPS = 1000000;
+
+
+// Stands in for Storage's private index entry
+struct IndexEntry
+{
+  uint64_t version;
+  int64_t timestamp;
+  int64_t expiration;
+};
+
+
+static int RemoveEntry(const char * path, const struct stat *, int, struct FTW *)
+{
+  return remove(path);
+}
+
+
+// Grows the persistent store through 10k, 100k and 1M keys (capped by --max-keys),
+// timing the saves of each step and then loads and a query at that size. Everything
+// is written under a temporary root that is removed afterwards.
+BENCH_SUITE(storage)
+{
+  char root[] = "/tmp/kad-bench-XXXXXX";
+
+  if (!mkdtemp(root))
+  {
+    perror("mkdtemp");
+    return;
+  }
+
+  Config::Initialize(root);
+
+  Storage * storage = Storage::Persist();
+
+  std::mt19937 rng(5);
+
+  auto randomKey = [&rng]()
+  {
+    uint8_t buffer[Key::KEY_LEN];
+
+    for (auto & b : buffer)
+    {
+      b = static_cast<uint8_t>(rng());
+    }
+
+    return std::make_shared<Key>(buffer);
+  };
+
+  std::vector<KeyPtr> keys;
+  std::vector<KeyPtr> missing;
+
+  for (size_t i = 0; i < LOADS; ++i)
+  {
+    missing.emplace_back(randomKey());
+  }
+
+  for (size_t size : { 10000, 100000, 1000000 })
+  {
+    if (size > bench::GetOptions().maxKeys)
+    {
+      break;
+    }
+
+    size_t start = keys.size();
+
+    std::vector<BufferPtr> documents;
+
+    for (size_t i = start; i < size; ++i)
+    {
+      std::string document = "{\"type\":\"doc\",\"name\":\"n" + std::to_string(i) + "\"}";
+
+      keys.emplace_back(randomKey());
+      documents.emplace_back(std::make_shared<Buffer>(reinterpret_cast<const uint8_t *>(document.data()), document.size(), true, true));
+    }
+
+    bench::Stopwatch saveWatch;
+
+    for (size_t i = start; i < size; ++i)
+    {
+      storage->Save(keys[i], 1, documents[i - start], 86400);
+    }
+
+    bench::Report("storage", "Save", size, size - start, saveWatch.Seconds());
+
+    documents.clear();
+
+    bench::Stopwatch loadWatch;
+
+    for (size_t i = 0; i < LOADS; ++i)
+    {
+      bench::Consume(storage->Load(keys[rng() % keys.size()]));
+    }
+
+    bench::Report("storage", "Load", size, LOADS, loadWatch.Seconds());
+
+    bench::Stopwatch missWatch;
+
+    for (size_t i = 0; i < LOADS; ++i)
+    {
+      bench::Consume(storage->Load(missing[i]));
+    }
+
+    bench::Report("storage", "Load miss", size, LOADS, missWatch.Seconds());
+
+    bench::Stopwatch queryWatch;
+
+    bench::Consume(storage->MatchQuery("type:doc name:n7"));
+
+    bench::Report("storage", "MatchQuery", size, 1, queryWatch.Seconds());
+
+    // What a restart pays: list the folder and parse every file name back into the index
+    bench::Stopwatch initWatch;
+
+    storage->Initialize(true);
+
+    bench::Report("storage", "Initialize", size, size, initWatch.Seconds());
+  }
+
+  nftw(root, &RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+
+// Fills one index type with size keys and times inserts, hits, misses and erases
+template<typename Map>
+static void MeasureIndex(const std::string & name, const std::vector<Key> & keys, const std::vector<Key> & missing, size_t size)
+{
+  Map index;
+  bench::Stopwatch insertWatch;
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    index[keys[i]] = { 1, 0, static_cast<int64_t>(i) };
+  }
+
+  bench::Report("index", name + " insert", size, size, insertWatch.Seconds());
+
+  std::mt19937 rng(9);
+  bench::Stopwatch findWatch;
+
+  for (size_t i = 0; i < LOOKUPS; ++i)
+  {
+    bench::Consume(index.find(keys[rng() % size])->second.expiration);
+  }
+
+  bench::Report("index", name + " find", size, LOOKUPS, findWatch.Seconds());
+
+  bench::Stopwatch missWatch;
+
+  for (size_t i = 0; i < LOOKUPS; ++i)
+  {
+    bench::Consume(index.find(missing[i % missing.size()]) == index.end());
+  }
+
+  bench::Report("index", name + " find miss", size, LOOKUPS, missWatch.Seconds());
+
+  bench::Stopwatch eraseWatch;
+
+  for (size_t i = 0; i < size; i += 2)
+  {
+    index.erase(keys[i]);
+  }
+
+  bench::Report("index", name + " erase", size, size / 2, eraseWatch.Seconds());
+}
+
+
+// Storage::index on its own, in memory: the ordered map it used to be against the
+// hash table it is now, at 10k, 100k and 1M keys (capped by --max-keys)
+BENCH_SUITE(index)
+{
+  std::mt19937 rng(5);
+
+  auto randomKeys = [&rng](size_t count)
+  {
+    std::vector<Key> keys;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      uint8_t buffer[Key::KEY_LEN];
+
+      for (auto & b : buffer)
+      {
+        b = static_cast<uint8_t>(rng());
+      }
+
+      keys.emplace_back(buffer);
+    }
+
+    return keys;
+  };
+
+  auto missing = randomKeys(LOADS);
+
+  for (size_t size : { 10000, 100000, 1000000 })
+  {
+    if (size > bench::GetOptions().maxKeys)
+    {
+      break;
+    }
+
+    auto keys = randomKeys(size);
+
+    MeasureIndex<std::map<Key, IndexEntry>>("map", keys, missing, size);
+
+    MeasureIndex<FlatMap<Key, IndexEntry, KeyHash>>("FlatMap", keys, missing, size);
+  }
+}
@@ -0,0 +1,103 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+#include "Bench.h"
+
+std::atomic<uint64_t> bench::allocations{0};
+
+
+void * operator new(size_t size)
+{
+  ++ bench::allocations;
+
+  void * ptr = malloc(size ? size : 1);
+
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+
+  return ptr;
+}
+
+
+void operator delete(void * ptr) noexcept
+{
+  free(ptr);
+}
+
+
+void operator delete(void * ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+// Usage: test-bench [--json] [--max-keys=N] [suite ...]
+// Runs every registered suite, or only the named ones. --json prints one JSON object
+// per result, for tracking results across commits; --max-keys caps the routing table
+// and storage sizes the scaling suites go up to.
+int main(int argc, char ** argv)
+{
+  std::vector<const char *> names;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--json") == 0)
+    {
+      bench::GetOptions().json = true;
+    }
+    else if (strncmp(argv[i], "--max-keys=", 11) == 0)
+    {
+      bench::GetOptions().maxKeys = strtoull(argv[i] + 11, nullptr, 10);
+    }
+    else
+    {
+      names.push_back(argv[i]);
+    }
+  }
+
+  for (auto & suite : bench::Suites())
+  {
+    bool selected = names.empty();
+
+    for (size_t i = 0; i < names.size() && !selected; ++i)
+    {
+      selected = (strcmp(names[i], suite.name) == 0);
+    }
+
+    if (selected)
+    {
+      suite.func();
+    }
+  }
+
+  return 0;
+}
@@ -43,6 +43,7 @@
 #include "TcpTransport.h"
 #include "Digest.h"
 #include "Kademlia.h"
+#include "Thread.h"
 
 #include <arpa/inet.h>
 #include <json/json.h>
@@ -135,6 +136,45 @@ static void GetValue(Kademlia & controller, const std::string & keyStr)
 }
 
 
+static void GetValues(Kademlia & controller, const std::vector<std::string> & keyStrs)
+{
+  std::vector<const void *> inputs;
+  std::vector<size_t> sizes;
+
+  for (const auto & keyStr : keyStrs)
+  {
+    inputs.emplace_back(keyStr.c_str());
+    sizes.emplace_back(keyStr.size());
+  }
+
+  std::unique_ptr<sha1_t[]> digests(new sha1_t[keyStrs.size()]);
+  Digest::ComputeBatch(inputs.data(), sizes.data(), keyStrs.size(), digests.get());
+
+  std::vector<KeyPtr> keys;
+
+  for (size_t i = 0; i < keyStrs.size(); ++i)
+  {
+    keys.emplace_back(std::make_shared<Key>(digests[i]));
+  }
+
+  auto result = AsyncResultPtr(new AsyncResult<std::vector<BufferPtr>>());
+
+  controller.FindValues(keys, result);
+
+  result->Wait();
+
+  const auto & buffers = AsyncResultHelper::GetResult<std::vector<BufferPtr>>(result.get());
+
+  for (size_t i = 0; i < buffers.size(); ++i)
+  {
+    if (buffers[i] && buffers[i]->Size() > 0)
+    {
+      printf("RESULT: %s %s\n", keyStrs[i].c_str(), std::string(reinterpret_cast<const char *>(buffers[i]->Data()), buffers[i]->Size()).c_str());
+    }
+  }
+}
+
+
 static void Publish(Kademlia & controller, const std::string & path)
 {
   uint8_t * buffer = nullptr;
@@ -503,6 +543,10 @@ int main(int argc, char ** argv)
     {
       GetValue(controller, words[1]);
     }
+    else if (words.size() > 2 && words[0] == "get")
+    {
+      GetValues(controller, std::vector<std::string>(words.begin() + 1, words.end()));
+    }
     else if (words.size() == 2 && words[0] == "publish")
     {
       Publish(controller, words[1]);
@@ -546,6 +590,10 @@ int main(int argc, char ** argv)
     {
       SaveBuckets(controller);
     }
+    else if (words.size() == 1 && words[0] == "profile")
+    {
+      Thread::PrintProfiles();
+    }
     else if (words.size() != 0)
     {
       handled = false;
@@ -0,0 +1,134 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "EventLoop.h"
+#include "RingQueue.h"
+
+// Checks what happens when the event loop's ring fills up: a rejected value must stay
+// with the caller, and handlers a loop posts to itself while full must spill to the
+// overflow list intact and still run.
+//
+// Usage: test-eventloop
+
+using namespace kad;
+
+
+static void Check(bool condition, const char * what)
+{
+  if (!condition)
+  {
+    fprintf(stderr, "FAILED: %s\n", what);
+    abort();
+  }
+}
+
+
+static void CheckRejectKeepsValue()
+{
+  RingQueue<std::string> queue(2, QueueFullPolicy::Reject);
+
+  std::string a = "a";
+  std::string b = "b";
+
+  Check(queue.Produce(a) && queue.TryProduce(b), "ring has room for two");
+
+  std::string c = "c";
+
+  Check(!queue.TryProduce(c), "TryProduce on a full ring");
+  Check(c == "c", "TryProduce kept the rejected value");
+
+  Check(!queue.Produce(c), "Produce under Reject on a full ring");
+  Check(c == "c", "Produce kept the rejected value");
+
+  std::string first;
+
+  Check(queue.Consume(first) && first == "a", "consume the oldest value");
+
+  std::string values[] = { "d", "e", "f" };
+
+  Check(queue.ProduceBatch(values, 3) == 1, "ProduceBatch fills the one free slot");
+  Check(values[1] == "e" && values[2] == "f", "ProduceBatch kept the rejected values");
+}
+
+
+static void CheckSpilledHandlersRun()
+{
+  static const size_t POSTS = 1000;
+
+  EventLoop loop(4);
+
+  std::thread thread([&loop]() { loop.Run(); });
+
+  std::atomic<size_t> count{0};
+
+  // Posting from the loop's own thread may not block, so all but the first few
+  // handlers spill
+  loop.BeginInvoke([&loop, &count](void *, void *)
+  {
+    for (size_t i = 0; i < POSTS; ++i)
+    {
+      loop.BeginInvoke([&count](void *, void *) { ++ count; });
+    }
+  });
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+  while (count < POSTS && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  Check(count == POSTS, "every spilled handler ran");
+
+  // A handler posted from another thread once the spill is drained still runs
+  bool invoked = false;
+  loop.Invoke([&invoked](void *, void *) { invoked = true; });
+
+  Check(invoked, "Invoke after a spill");
+
+  loop.Quit();
+  thread.join();
+}
+
+
+int main()
+{
+  CheckRejectKeepsValue();
+
+  CheckSpilledHandlersRun();
+
+  printf("OK\n");
+
+  return 0;
+}
@@ -0,0 +1,621 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "BufferedInputStream.h"
+#include "BufferedOutputStream.h"
+#include "Package.h"
+#include "SpanReader.h"
+#include "protocol/Protocol.h"
+
+// Differential fuzzer for the package decoder. Every input is decoded through a
+// SpanReader (copying and slicing) and through the IInputStream wrapper, and each
+// verdict is checked against Expected(), a direct statement of the wire grammar the
+// stream-based decoders accepted. Accepted packages must also survive an encode /
+// decode round trip unchanged.
+//
+// Usage: test-fuzz [iterations] [seed]
+//
+// Built with -DKAD_LIBFUZZER and clang's -fsanitize=fuzzer, main() is left out and
+// LLVMFuzzerTestOneInput drives the same checks.
+
+using namespace kad;
+
+static const size_t HEADER_LEN = sizeof(uint8_t) * 2 + sizeof(uint16_t) + Key::KEY_LEN;
+
+static const size_t CONTACT_LEN = sizeof(int32_t) + sizeof(int16_t);
+
+
+static uint64_t Load(const uint8_t * data, size_t size)
+{
+  uint64_t value = 0;
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    value = (value << 8) | data[i];
+  }
+
+  return value;
+}
+
+
+// Walks the wire grammar of one package version without decoding anything
+class Grammar
+{
+public:
+
+  Grammar(const uint8_t * data, size_t size, size_t offset, uint8_t version)
+    : data(data), size(size), offset(offset), version(version)
+  {
+  }
+
+  size_t Offset() const     { return this->offset; }
+
+  size_t Remainder() const  { return this->size - this->offset; }
+
+  uint8_t Next() const      { return this->data[this->offset]; }
+
+  bool Fixed(uint64_t length)
+  {
+    if (this->Remainder() < length)
+    {
+      return false;
+    }
+
+    this->offset += length;
+    return true;
+  }
+
+  // A width byte integer: big-endian in version 0, a varint that must fit width
+  // bytes afterwards
+  bool Integer(size_t width, uint64_t * value = nullptr)
+  {
+    uint64_t result = 0;
+
+    if (this->version == Instruction::WIRE_VERSION_0)
+    {
+      if (this->Remainder() < width)
+      {
+        return false;
+      }
+
+      result = Load(this->data + this->offset, width);
+      this->offset += width;
+    }
+    else
+    {
+      size_t bits = width * 8;
+
+      for (size_t i = 0, shift = 0; ; ++i, shift += 7)
+      {
+        if (shift >= bits || i >= this->Remainder())
+        {
+          return false;
+        }
+
+        uint64_t group = this->data[this->offset + i] & 0x7F;
+
+        if (bits - shift < 7 && (group >> (bits - shift)) != 0)
+        {
+          return false;
+        }
+
+        result |= group << shift;
+
+        if ((this->data[this->offset + i] & 0x80) == 0)
+        {
+          this->offset += i + 1;
+          break;
+        }
+      }
+    }
+
+    if (value)
+    {
+      * value = result;
+    }
+
+    return true;
+  }
+
+  // A length-prefixed byte string
+  bool Bytes()
+  {
+    uint64_t length = 0;
+    return this->Integer(sizeof(uint32_t), & length) && this->Fixed(length);
+  }
+
+  bool Contacts()
+  {
+    uint64_t count = 0;
+
+    if (this->version == Instruction::WIRE_VERSION_0)
+    {
+      return this->Integer(sizeof(uint8_t), & count) && this->Fixed(count * (Key::KEY_LEN + CONTACT_LEN));
+    }
+
+    if (!this->Integer(sizeof(uint32_t), & count) || count > this->Remainder() / (1 + sizeof(int32_t)))
+    {
+      return false;
+    }
+
+    for (uint64_t i = 0; i < count; ++i)
+    {
+      if (this->Remainder() < 1)
+      {
+        return false;
+      }
+
+      uint8_t header = this->data[this->offset++];
+
+      // Low five bits: shared key prefix, top bit: port repeated, the rest reserved
+      size_t shared = header & 0x1F;
+
+      if ((header & 0x60) != 0 || shared > Key::KEY_LEN || (i == 0 && header != 0))
+      {
+        return false;
+      }
+
+      if (!this->Fixed(Key::KEY_LEN - shared + sizeof(int32_t) + ((header & 0x80) ? 0 : sizeof(int16_t))))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+private:
+
+  const uint8_t * data;
+
+  size_t size;
+
+  size_t offset;
+
+  uint8_t version;
+};
+
+
+// One instruction: the opcode and its fields. Batches hold up to Batch::MAX_ITEMS
+// instructions of any other kind.
+static bool Body(Grammar & grammar, bool nested)
+{
+  uint64_t code = 0;
+
+  if (!grammar.Integer(sizeof(uint16_t), & code))
+  {
+    return false;
+  }
+
+  switch (static_cast<OpCode>(code))
+  {
+    case OpCode::PING:
+    case OpCode::PONG:
+      return true;
+
+    case OpCode::STORE_RESPONSE:
+    case OpCode::STORE_LOG_RESPONSE:
+      return grammar.Integer(sizeof(uint16_t));
+
+    case OpCode::FIND_NODE:
+    case OpCode::FIND_VALUE:
+      return grammar.Fixed(Key::KEY_LEN);
+
+    case OpCode::QUERY:
+    case OpCode::QUERY_LOG:
+    {
+      if (!grammar.Fixed(Key::KEY_LEN))
+      {
+        return false;
+      }
+
+      // The query string is read but its absence never fails the package
+      Grammar query = grammar;
+
+      if (query.Bytes())
+      {
+        grammar = query;
+      }
+
+      return true;
+    }
+
+    case OpCode::FIND_NODE_RESPONSE:
+      return grammar.Contacts();
+
+    case OpCode::FIND_VALUE_RESPONSE:
+    case OpCode::QUERY_RESPONSE:
+    case OpCode::QUERY_LOG_RESPONSE:
+      return grammar.Integer(sizeof(uint64_t)) && grammar.Integer(sizeof(uint32_t)) && grammar.Bytes();
+
+    case OpCode::STORE:
+    case OpCode::STORE_LOG:
+      return grammar.Integer(sizeof(uint64_t)) && grammar.Integer(sizeof(uint32_t)) && grammar.Fixed(sizeof(uint8_t) + Key::KEY_LEN) && grammar.Bytes();
+
+    case OpCode::BATCH:
+    {
+      uint64_t count = 0;
+
+      if (nested || !grammar.Integer(sizeof(uint16_t), & count) || count > protocol::Batch::MAX_ITEMS)
+      {
+        return false;
+      }
+
+      for (uint64_t i = 0; i < count; ++i)
+      {
+        if (!Body(grammar, true))
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
+
+
+// Number of bytes a valid package occupies at the start of data, or -1 if the
+// decoder must reject it
+static long Expected(const uint8_t * data, size_t size)
+{
+  if (size < HEADER_LEN || data[0] > Instruction::LATEST_WIRE_VERSION || data[1] >= static_cast<uint8_t>(Package::PackageType::__MAX__))
+  {
+    return -1;
+  }
+
+  Grammar grammar(data, size, HEADER_LEN, data[0]);
+
+  if (!Body(grammar, false))
+  {
+    return -1;
+  }
+
+  // Optional trailer advertising the sender's highest version
+  if (grammar.Remainder() >= 2 && grammar.Next() == 0x56)
+  {
+    grammar.Fixed(2);
+  }
+
+  return static_cast<long>(grammar.Offset());
+}
+
+
+static std::string Encode(const Package & package)
+{
+  BufferedOutputStream output(package.SerializedSize());
+  package.Serialize(output);
+
+  return std::string(reinterpret_cast<const char *>(output.Buffer()), output.Offset());
+}
+
+
+static void Fail(const char * what, const uint8_t * data, size_t size)
+{
+  fprintf(stderr, "FAIL: %s, input (%zu bytes):", what, size);
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    fprintf(stderr, " %02X", data[i]);
+  }
+
+  fprintf(stderr, "\n");
+  abort();
+}
+
+
+static void Check(const uint8_t * data, size_t size)
+{
+  static auto sender = std::make_shared<Contact>();
+
+  long expected = Expected(data, size);
+
+  // Copy into an exactly sized heap block so sanitizers catch any over-read
+  auto owned = std::make_shared<Buffer>(data, size, true, true);
+
+  SpanReader copying(owned->Data(), size);
+  auto package = Package::Deserialize(sender, copying);
+
+  SpanReader slicing(owned);
+  auto sliced = Package::Deserialize(sender, slicing);
+
+  BufferedInputStream stream(owned);
+  auto streamed = Package::Deserialize(sender, stream);
+
+  if ((package != nullptr) != (expected >= 0) || (sliced != nullptr) != (expected >= 0) || (streamed != nullptr) != (expected >= 0))
+  {
+    Fail(expected >= 0 ? "valid package rejected" : "malformed package accepted", data, size);
+  }
+
+  if (!package)
+  {
+    return;
+  }
+
+  if (copying.Offset() != static_cast<size_t>(expected) || slicing.Offset() != copying.Offset() || stream.Offset() != copying.Offset())
+  {
+    Fail("decoder consumed the wrong number of bytes", data, size);
+  }
+
+  std::string encoded = Encode(* package);
+
+  if (Encode(* sliced) != encoded || Encode(* streamed) != encoded)
+  {
+    Fail("decoders disagree", data, size);
+  }
+
+  SpanReader again(encoded.data(), encoded.size());
+  auto decoded = Package::Deserialize(sender, again);
+
+  if (!decoded || again.Remainder() != 0 || Encode(* decoded) != encoded)
+  {
+    Fail("round trip changed the package", data, size);
+  }
+}
+
+
+static std::vector<std::string> Corpus()
+{
+  std::vector<std::string> corpus;
+
+  uint8_t bytes[Key::KEY_LEN];
+
+  for (size_t i = 0; i < Key::KEY_LEN; ++i)
+  {
+    bytes[i] = static_cast<uint8_t>(i * 13 + 7);
+  }
+
+  auto key = std::make_shared<Key>(bytes);
+  auto data = std::make_shared<Buffer>(reinterpret_cast<const uint8_t *>("payload"), 7, true, true);
+
+  // Each sample in version 0, version 0 advertising version 1, and version 1
+  auto add = [&](Instruction * instr)
+  {
+    Package package(Package::PackageType::Request, key, std::make_shared<Contact>(), std::unique_ptr<Instruction>(instr));
+
+    corpus.push_back(Encode(package));
+
+    package.SetVersion(Instruction::WIRE_VERSION_0, Instruction::WIRE_VERSION_1);
+    corpus.push_back(Encode(package));
+
+    package.SetVersion(Instruction::WIRE_VERSION_1, Instruction::WIRE_VERSION_1);
+    corpus.push_back(Encode(package));
+  };
+
+  add(new protocol::Ping());
+  add(new protocol::Pong());
+
+  for (auto instr : std::vector<protocol::FindNode *>{ new protocol::FindNode(), new protocol::FindValue() })
+  {
+    instr->SetKey(key);
+    add(instr);
+  }
+
+  {
+    auto instr = new protocol::FindNodeResponse();
+
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+      uint8_t near[Key::KEY_LEN];
+      memcpy(near, bytes, sizeof(near));
+      near[i * 4] ^= 0x40;
+
+      auto contact = std::make_shared<Contact>();
+      contact->addr = 0x0100007F + i;
+      contact->port = i < 2 ? 6600 : 6601 + i;
+
+      instr->AddNode(std::make_shared<Key>(near), contact);
+    }
+
+    instr->AddNode(key, std::make_shared<Contact>());
+    add(instr);
+  }
+
+  {
+    auto instr = new protocol::Query();
+    instr->SetKey(key);
+    instr->query = "type:doc";
+    add(instr);
+  }
+
+  {
+    auto instr = new protocol::QueryLog();
+    instr->SetKey(key);
+    instr->query = "type:log";
+    add(instr);
+  }
+
+  {
+    auto instr = new protocol::FindValueResponse();
+    instr->SetData(data);
+    add(instr);
+  }
+
+  {
+    auto instr = new protocol::QueryResponse();
+    instr->SetData(data);
+    add(instr);
+  }
+
+  {
+    auto instr = new protocol::QueryLogResponse();
+    instr->SetData(data);
+    add(instr);
+  }
+
+  {
+    auto instr = new protocol::Store();
+    instr->SetKey(key);
+    instr->SetData(data);
+    add(instr);
+  }
+
+  {
+    auto instr = new protocol::StoreLog();
+    instr->SetKey(key);
+    instr->SetData(data);
+    add(instr);
+  }
+
+  add(new protocol::StoreResponse());
+  add(new protocol::StoreLogResponse());
+
+  {
+    auto instr = new protocol::Batch();
+    auto findValue = std::make_shared<protocol::FindValue>();
+    auto store = std::make_shared<protocol::Store>();
+    auto query = std::make_shared<protocol::Query>();
+
+    findValue->SetKey(key);
+    store->SetKey(key);
+    store->SetData(data);
+    query->SetKey(key);
+
+    instr->AddItem(std::make_shared<protocol::Ping>());
+    instr->AddItem(findValue);
+    instr->AddItem(store);
+    instr->AddItem(query);
+    instr->AddItem(std::make_shared<protocol::StoreResponse>());
+    add(instr);
+  }
+
+  return corpus;
+}
+
+
+static void Mutate(std::string & input, std::mt19937 & rng, const std::vector<std::string> & corpus)
+{
+  auto pick = [&](size_t n) { return n ? static_cast<size_t>(rng() % n) : 0; };
+
+  switch (rng() % 6)
+  {
+    case 0: // flip a bit
+      if (!input.empty())
+      {
+        input[pick(input.size())] ^= static_cast<char>(1 << pick(8));
+      }
+      break;
+
+    case 1: // overwrite a byte
+      if (!input.empty())
+      {
+        input[pick(input.size())] = static_cast<char>(rng());
+      }
+      break;
+
+    case 2: // truncate
+      input.resize(pick(input.size() + 1));
+      break;
+
+    case 3: // append garbage
+      for (size_t n = pick(32); n > 0; --n)
+      {
+        input.push_back(static_cast<char>(rng()));
+      }
+      break;
+
+    case 4: // overwrite what may be a length field with a boundary value
+      if (input.size() >= sizeof(uint32_t))
+      {
+        static const uint32_t values[] = { 0, 1, 0xFF, 0x100, 0xFFFF, 0x7FFFFFFF, 0xFFFFFFFF };
+        uint32_t value = values[pick(sizeof(values) / sizeof(values[0]))];
+        size_t offset = pick(input.size() - sizeof(uint32_t) + 1);
+
+        for (size_t i = 0; i < sizeof(uint32_t); ++i)
+        {
+          input[offset + i] = static_cast<char>(value >> (24 - i * 8));
+        }
+      }
+      break;
+
+    default: // splice in the tail of another sample
+    {
+      const std::string & other = corpus[pick(corpus.size())];
+      input = input.substr(0, pick(input.size() + 1)) + other.substr(pick(other.size() + 1));
+      break;
+    }
+  }
+}
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+  Check(data, size);
+  return 0;
+}
+
+
+#ifndef KAD_LIBFUZZER
+
+int main(int argc, char ** argv)
+{
+  size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+  unsigned seed = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], nullptr, 10)) : std::random_device()();
+
+  printf("seed=%u iterations=%zu\n", seed, iterations);
+
+  auto corpus = Corpus();
+
+  // Every prefix of every valid package
+  for (const auto & sample : corpus)
+  {
+    for (size_t len = 0; len <= sample.size(); ++len)
+    {
+      Check(reinterpret_cast<const uint8_t *>(sample.data()), len);
+    }
+  }
+
+  std::mt19937 rng(seed);
+
+  for (size_t i = 0; i < iterations; ++i)
+  {
+    std::string input = corpus[rng() % corpus.size()];
+
+    for (size_t n = 1 + rng() % 4; n > 0; --n)
+    {
+      Mutate(input, rng, corpus);
+    }
+
+    Check(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+  }
+
+  printf("OK\n");
+
+  return 0;
+}
+
+#endif
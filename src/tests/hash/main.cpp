@@ -0,0 +1,122 @@
+/**
+ *
+ * MIT License
+ * 
+ * Copyright (c) 2018 drvcoin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * =============================================================================
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>
+#include <vector>
+#include "FlatMap.h"
+#include "Key.h"
+
+// Checks that KeyHash spreads keys a peer can choose freely. Keys that differ only in
+// a few high bits of one word must still land in different home slots of a table,
+// or STOREs built that way pile up in one probe run of the storage index.
+//
+// Usage: test-hash
+
+using namespace kad;
+
+static const size_t SLOTS = 65536;
+
+
+static void Check(bool condition, const char * what)
+{
+  if (!condition)
+  {
+    fprintf(stderr, "FAILED: %s\n", what);
+    abort();
+  }
+}
+
+
+// 4096 keys that differ only in bits 52 to 63 of the 64 bit word starting at offset
+static std::vector<Key> HighBitKeys(size_t offset)
+{
+  std::vector<Key> keys;
+
+  for (size_t i = 0; i < 4096; ++i)
+  {
+    uint8_t buffer[Key::KEY_LEN] = {};
+
+    // Little endian words, so the top 12 bits are the high nibble of byte 6 and byte 7
+    buffer[offset + 6] = static_cast<uint8_t>((i & 0x0F) << 4);
+    buffer[offset + 7] = static_cast<uint8_t>(i >> 4);
+
+    keys.emplace_back(buffer);
+  }
+
+  return keys;
+}
+
+
+static void CheckSpread(const std::vector<Key> & keys, const char * what)
+{
+  KeyHash hash;
+
+  std::set<size_t> homes;
+
+  for (const auto & key : keys)
+  {
+    homes.insert(hash(key) & (SLOTS - 1));
+  }
+
+  // Random placement of 4096 keys in 65536 slots leaves about 3970 distinct homes
+  if (homes.size() < keys.size() * 9 / 10)
+  {
+    fprintf(stderr, "%s: %zu keys share %zu home slots\n", what, keys.size(), homes.size());
+    Check(false, what);
+  }
+
+  FlatMap<Key, size_t, KeyHash> map;
+  map.reserve(SLOTS / 2);
+
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    map[keys[i]] = i;
+  }
+
+  Check(map.size() == keys.size(), "every key inserted");
+
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    auto itr = map.find(keys[i]);
+    Check(itr != map.end() && itr->second == i, "every key found");
+  }
+}
+
+
+int main()
+{
+  CheckSpread(HighBitKeys(8), "high bits of the middle word");
+
+  CheckSpread(HighBitKeys(0), "high bits of the first word");
+
+  printf("OK\n");
+
+  return 0;
+}